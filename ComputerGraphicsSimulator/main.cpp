@@ -24,8 +24,149 @@ struct Ellipse {
 	sf::Color color;
 };
 
+// --- Slot Map (stable handles, O(1) delete) ---
+// Shapes stay densely packed for drawing. A handle names a slot, and the slot
+// knows where its shape lives now: deleting swaps the last shape into the
+// hole, so nothing else is copied and every other handle stays valid. The
+// generation makes a handle to a deleted shape go stale instead of naming
+// whatever reuses its slot.
+struct Handle {
+	static const unsigned int NONE = 0xFFFFFFFFu;
+	unsigned int slot = NONE;
+	unsigned int generation = 0;
+
+	bool operator==(const Handle& other) const { return slot == other.slot && generation == other.generation; }
+};
+
+template <typename T>
+class SlotMap {
+public:
+	Handle insert(const T& value) {
+		unsigned int slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			slot = (unsigned int)slots.size();
+			slots.push_back(Slot());
+		}
+		slots[slot].dense = (unsigned int)items.size();
+		items.push_back(value);
+		owners.push_back(slot);
+		return Handle{ slot, slots[slot].generation };
+	}
+
+	bool contains(Handle h) const {
+		return h.slot < slots.size() && slots[h.slot].generation == h.generation &&
+			slots[h.slot].dense != Handle::NONE;
+	}
+
+	// Null for a stale handle
+	T* get(Handle h) {
+		return contains(h) ? &items[slots[h.slot].dense] : nullptr;
+	}
+
+	// Swap-and-pop; stale handles are ignored
+	void erase(Handle h) {
+		if (!contains(h)) return;
+		unsigned int hole = slots[h.slot].dense;
+		unsigned int last = (unsigned int)items.size() - 1;
+		if (hole != last) {
+			items[hole] = items[last];
+			owners[hole] = owners[last];
+			slots[owners[hole]].dense = hole;
+		}
+		items.pop_back();
+		owners.pop_back();
+		slots[h.slot].dense = Handle::NONE;
+		slots[h.slot].generation++;
+		freeSlots.push_back(h.slot);
+	}
+
+	// One swap-and-pop each, so deleting k shapes costs O(k)
+	void erase(const std::vector<Handle>& handles) {
+		for (const Handle& h : handles) erase(h);
+	}
+
+	void clear() {
+		for (unsigned int slot : owners) {
+			slots[slot].dense = Handle::NONE;
+			slots[slot].generation++;
+			freeSlots.push_back(slot);
+		}
+		items.clear();
+		owners.clear();
+	}
+
+	// Dense access, in no particular order
+	size_t size() const { return items.size(); }
+	T& operator[](size_t i) { return items[i]; }
+	Handle handleAt(size_t i) const { return Handle{ owners[i], slots[owners[i]].generation }; }
+	typename std::vector<T>::iterator begin() { return items.begin(); }
+	typename std::vector<T>::iterator end() { return items.end(); }
+
+private:
+	struct Slot {
+		unsigned int dense = Handle::NONE;   // index into items, NONE when free
+		unsigned int generation = 0;
+	};
+
+	std::vector<T> items;
+	std::vector<unsigned int> owners;   // slot of each item
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+};
+
+// --- Selection: handles per shape kind ---
+struct Selection {
+	std::vector<Handle> lines, circles, ellipses;
+
+	bool empty() const { return lines.empty() && circles.empty() && ellipses.empty(); }
+	void clear() { lines.clear(); circles.clear(); ellipses.clear(); }
+	size_t size() const { return lines.size() + circles.size() + ellipses.size(); }
+};
+
+// Adds the handle unless it is already there; false when it was
+bool addToSelection(std::vector<Handle>& group, Handle h) {
+	if (std::find(group.begin(), group.end(), h) != group.end()) return false;
+	group.push_back(h);
+	return true;
+}
+
+// --- Pixel Batch (one vertex array per frame) ---
+// Every plotted pixel is a 2x2 quad in one vertex array that is kept between
+// frames, so once it has grown a frame allocates nothing and the whole
+// drawing goes to the GPU in a single draw call.
+class PixelBatch {
+public:
+	PixelBatch() : used(0) {}
+
+	void plot(float x, float y, sf::Color color) {
+		if (used + 4 > quads.size()) quads.resize(std::max<size_t>(1024, quads.size() * 2));
+		sf::Vertex* v = &quads[used];
+		v[0].position.x = x;     v[0].position.y = y;
+		v[1].position.x = x + 2; v[1].position.y = y;
+		v[2].position.x = x + 2; v[2].position.y = y + 2;
+		v[3].position.x = x;     v[3].position.y = y + 2;
+		v[0].color = v[1].color = v[2].color = v[3].color = color;
+		used += 4;
+	}
+
+	// Keeps the vertices; they are overwritten next frame
+	void clear() { used = 0; }
+
+	void draw(sf::RenderWindow& window) const {
+		if (used > 0) window.draw(quads.data(), used, sf::Quads);
+	}
+
+private:
+	std::vector<sf::Vertex> quads;
+	size_t used;   // vertices written this frame
+};
+
 // --- Draw Functions ---
-void drawDDALine(std::vector<sf::RectangleShape>& pixels, sf::Vector2f p1, sf::Vector2f p2, sf::Color color) {
+void drawDDALine(PixelBatch& pixels, sf::Vector2f p1, sf::Vector2f p2, sf::Color color) {
 	float dx = p2.x - p1.x;
 	float dy = p2.y - p1.y;
 	float steps = std::max(std::abs(dx), std::abs(dy));
@@ -33,16 +174,13 @@ void drawDDALine(std::vector<sf::RectangleShape>& pixels, sf::Vector2f p1, sf::V
 	float yInc = dy / steps;
 	float x = p1.x, y = p1.y;
 	for (int i = 0; i <= steps; i++) {
-		sf::RectangleShape r(sf::Vector2f(2, 2));
-		r.setPosition(std::round(x), std::round(y));
-		r.setFillColor(color);
-		pixels.push_back(r);
+		pixels.plot(std::round(x), std::round(y), color);
 		x += xInc;
 		y += yInc;
 	}
 }
 
-void drawBresenhamLine(std::vector<sf::RectangleShape>& pixels, sf::Vector2f p1, sf::Vector2f p2, sf::Color color) {
+void drawBresenhamLine(PixelBatch& pixels, sf::Vector2f p1, sf::Vector2f p2, sf::Color color) {
 	int x1 = (int)std::round(p1.x);
 	int y1 = (int)std::round(p1.y);
 	int x2 = (int)std::round(p2.x);
@@ -55,10 +193,7 @@ void drawBresenhamLine(std::vector<sf::RectangleShape>& pixels, sf::Vector2f p1,
 	int err = dx - dy;
 
 	while (true) {
-		sf::RectangleShape r(sf::Vector2f(2, 2));
-		r.setPosition((float)x1, (float)y1);
-		r.setFillColor(color);
-		pixels.push_back(r);
+		pixels.plot((float)x1, (float)y1, color);
 
 		if (x1 == x2 && y1 == y2) break;
 
@@ -69,28 +204,22 @@ void drawBresenhamLine(std::vector<sf::RectangleShape>& pixels, sf::Vector2f p1,
 }
 
 // --- Circle Drawing (Midpoint Circle Algorithm) ---
-void drawCircle(std::vector<sf::RectangleShape>& pixels, Circle c) {
+void drawCircle(PixelBatch& pixels, const Circle& c) {
 	int x = 0;
 	int y = (int)c.radius;
 	int d = 1 - y;
 
+	// The eight symmetric points, plotted straight into the batch
 	auto plotCirclePoints = [&](int x, int y) {
-		std::vector<sf::Vector2f> pts = {
-			{c.center.x + x, c.center.y + y},
-			{c.center.x - x, c.center.y + y},
-			{c.center.x + x, c.center.y - y},
-			{c.center.x - x, c.center.y - y},
-			{c.center.x + y, c.center.y + x},
-			{c.center.x - y, c.center.y + x},
-			{c.center.x + y, c.center.y - x},
-			{c.center.x - y, c.center.y - x}
-		};
-		for (auto& p : pts) {
-			sf::RectangleShape r(sf::Vector2f(2, 2));
-			r.setPosition(p);
-			r.setFillColor(c.color);
-			pixels.push_back(r);
-		}
+		float cx = c.center.x, cy = c.center.y;
+		pixels.plot(cx + x, cy + y, c.color);
+		pixels.plot(cx - x, cy + y, c.color);
+		pixels.plot(cx + x, cy - y, c.color);
+		pixels.plot(cx - x, cy - y, c.color);
+		pixels.plot(cx + y, cy + x, c.color);
+		pixels.plot(cx - y, cy + x, c.color);
+		pixels.plot(cx + y, cy - x, c.color);
+		pixels.plot(cx - y, cy - x, c.color);
 		};
 
 	while (x <= y) {
@@ -102,7 +231,7 @@ void drawCircle(std::vector<sf::RectangleShape>& pixels, Circle c) {
 }
 
 // --- Ellipse Drawing (Midpoint Ellipse Algorithm) ---
-void drawEllipse(std::vector<sf::RectangleShape>& pixels, Ellipse e) {
+void drawEllipse(PixelBatch& pixels, const Ellipse& e) {
 	float rx2 = e.rx * e.rx;
 	float ry2 = e.ry * e.ry;
 	float x = 0, y = e.ry;
@@ -110,18 +239,10 @@ void drawEllipse(std::vector<sf::RectangleShape>& pixels, Ellipse e) {
 	float dy = 2 * rx2 * y;
 
 	auto plotEllipsePoints = [&](float x, float y) {
-		std::vector<sf::Vector2f> pts = {
-			{e.center.x + x, e.center.y + y},
-			{e.center.x - x, e.center.y + y},
-			{e.center.x + x, e.center.y - y},
-			{e.center.x - x, e.center.y - y}
-		};
-		for (auto& p : pts) {
-			sf::RectangleShape r(sf::Vector2f(2, 2));
-			r.setPosition(p);
-			r.setFillColor(e.color);
-			pixels.push_back(r);
-		}
+		pixels.plot(e.center.x + x, e.center.y + y, e.color);
+		pixels.plot(e.center.x - x, e.center.y + y, e.color);
+		pixels.plot(e.center.x + x, e.center.y - y, e.color);
+		pixels.plot(e.center.x - x, e.center.y - y, e.color);
 		};
 
 	// Region 1
@@ -188,26 +309,50 @@ float distancePointToLine(sf::Vector2f p, sf::Vector2f a, sf::Vector2f b) {
 	return std::sqrt(dx * dx + dy * dy);
 }
 
+// --- Keys that transform the selected shape while held ---
+bool isTransformKeyHeld() {
+	static const sf::Keyboard::Key keys[] = {
+		sf::Keyboard::Left, sf::Keyboard::Right, sf::Keyboard::Up, sf::Keyboard::Down,
+		sf::Keyboard::Q, sf::Keyboard::E, sf::Keyboard::W, sf::Keyboard::S
+	};
+	for (sf::Keyboard::Key key : keys) {
+		if (sf::Keyboard::isKeyPressed(key)) return true;
+	}
+	return false;
+}
+
 int main() {
 	sf::RenderWindow window(sf::VideoMode(1000, 700), "Mini-CAD: Line, Circle, Ellipse Editor");
 
-	std::vector<Line> lines;
-	std::vector<Circle> circles;
-	std::vector<Ellipse> ellipses;
+	SlotMap<Line> lines;
+	SlotMap<Circle> circles;
+	SlotMap<Ellipse> ellipses;
 	std::vector<sf::Vector2f> tempPoints;
 
 	enum Mode { SELECTION = 1, DRAW_DDA = 2, DRAW_BRES = 3, DRAW_CIRCLE = 4, DRAW_ELLIPSE = 5 };
 	Mode currentMode = SELECTION;
 
-	int selectedLine = -1, selectedCircle = -1, selectedEllipse = -1;
+	// Click selects one shape; Shift+click adds to the selection, Ctrl+A takes everything
+	Selection selection;
 	const float moveAmount = 0.50f;
 	const float rotateAmount = 0.5f;   // degrees per key press
 	const float scaleFactorUp = 1.01f;
 	const float scaleFactorDown = 0.99f;
 
+	bool needsRedraw = true;
+	PixelBatch pixels;   // reused every frame
+
 	while (window.isOpen()) {
+		// Sleep until input arrives unless a redraw is pending or a held key
+		// is transforming the selection
+		bool transforming = !selection.empty() && isTransformKeyHeld();
 		sf::Event event;
-		while (window.pollEvent(event)) {
+		bool hasEvent = (!needsRedraw && !transforming) ? window.waitEvent(event) : window.pollEvent(event);
+
+		while (hasEvent) {
+			// Plain pointer motion changes nothing on screen
+			if (event.type != sf::Event::MouseMoved) needsRedraw = true;
+
 			if (event.type == sf::Event::Closed) window.close();
 
 			// --- Keyboard mode switching ---
@@ -220,26 +365,27 @@ int main() {
 				case sf::Keyboard::Num5: currentMode = DRAW_ELLIPSE; break;
 				case sf::Keyboard::C:
 					lines.clear(); circles.clear(); ellipses.clear();
-					selectedLine = selectedCircle = selectedEllipse = -1;
+					selection.clear();
 					tempPoints.clear();
 					break;
+				case sf::Keyboard::A:
+					if (event.key.control) {
+						selection.clear();
+						for (size_t i = 0; i < lines.size(); i++) selection.lines.push_back(lines.handleAt(i));
+						for (size_t i = 0; i < circles.size(); i++) selection.circles.push_back(circles.handleAt(i));
+						for (size_t i = 0; i < ellipses.size(); i++) selection.ellipses.push_back(ellipses.handleAt(i));
+					}
+					break;
 				}
 			}
 
+			// Deleting the whole selection is linear in its size
 			if (event.type == sf::Event::KeyPressed) {
 				if (event.key.code == sf::Keyboard::Delete) {
-					if (selectedLine != -1) {
-						lines.erase(lines.begin() + selectedLine);
-						selectedLine = -1;
-					}
-					else if (selectedCircle != -1) {
-						circles.erase(circles.begin() + selectedCircle);
-						selectedCircle = -1;
-					}
-					else if (selectedEllipse != -1) {
-						ellipses.erase(ellipses.begin() + selectedEllipse);
-						selectedEllipse = -1;
-					}
+					lines.erase(selection.lines);
+					circles.erase(selection.circles);
+					ellipses.erase(selection.ellipses);
+					selection.clear();
 				}
 			}
 
@@ -249,12 +395,14 @@ int main() {
 
 				// Selection Mode
 				if (currentMode == SELECTION) {
-					selectedLine = selectedCircle = selectedEllipse = -1;
+					bool adding = sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
+						sf::Keyboard::isKeyPressed(sf::Keyboard::RShift);
+					if (!adding) selection.clear();
 
 					// Check lines
 					for (size_t i = 0; i < lines.size(); i++) {
 						if (distancePointToLine(mousePos, lines[i].p1, lines[i].p2) < 8.0f) {
-							selectedLine = (int)i; break;
+							addToSelection(selection.lines, lines.handleAt(i)); break;
 						}
 					}
 					//Check circles
@@ -265,12 +413,12 @@ int main() {
 
 						// Edge-only selection
 						if (std::abs(dist - circles[i].radius) < 8.0f) {
-							selectedCircle = (int)i;
+							addToSelection(selection.circles, circles.handleAt(i));
 							break;
 						}
 
 						// Or: interior selection (more intuitive)
-						// if (dist <= circles[i].radius) { selectedCircle = (int)i; break; }
+						// if (dist <= circles[i].radius) { addToSelection(selection.circles, circles.handleAt(i)); break; }
 					}
 					// Check ellipses
 /// Check ellipses - edge-only selection
@@ -286,7 +434,7 @@ int main() {
 
 						// Edge-only: select if close to boundary (≈1.0)
 						if (std::abs(val - 1.0f) < 0.05f) {   // tolerance can be tuned
-							selectedEllipse = static_cast<int>(i);
+							addToSelection(selection.ellipses, ellipses.handleAt(i));
 							break;
 						}
 					}
@@ -303,7 +451,7 @@ int main() {
 						l.p2 = tempPoints[1];
 						l.color = sf::Color::Green;   // DDA lines = Green
 						l.useDDA = true;
-						lines.push_back(l);
+						lines.insert(l);
 						tempPoints.clear();
 					}
 				}
@@ -317,7 +465,7 @@ int main() {
 						l.p2 = tempPoints[1];
 						l.color = sf::Color::Red;     // Bresenham lines = Red
 						l.useDDA = false;
-						lines.push_back(l);
+						lines.insert(l);
 						tempPoints.clear();
 					}
 				}
@@ -332,7 +480,7 @@ int main() {
 						float dy = tempPoints[1].y - tempPoints[0].y;
 						c.radius = std::sqrt(dx * dx + dy * dy);
 						c.color = sf::Color::Blue;
-						circles.push_back(c);
+						circles.insert(c);
 						tempPoints.clear();
 					}
 				}
@@ -346,44 +494,55 @@ int main() {
 						e.rx = std::abs(tempPoints[1].x - tempPoints[0].x);
 						e.ry = std::abs(tempPoints[1].y - tempPoints[0].y);
 						e.color = sf::Color::Magenta;
-						ellipses.push_back(e);
+						ellipses.insert(e);
 						tempPoints.clear();
 					}
 				}
 			}
+
+			hasEvent = window.pollEvent(event);
 		}
 
 		// --- Real-time transformations ---
-		if (selectedLine != -1) {
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateLine(lines[selectedLine], -moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateLine(lines[selectedLine], moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateLine(lines[selectedLine], 0, -moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateLine(lines[selectedLine], 0, moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q)) rotateLine(lines[selectedLine], -rotateAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::E)) rotateLine(lines[selectedLine], rotateAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleLine(lines[selectedLine], scaleFactorUp);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleLine(lines[selectedLine], scaleFactorDown);
+		if (transforming) needsRedraw = true;
+		for (Handle h : selection.lines) {
+			Line* line = lines.get(h);
+			if (!line) continue;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateLine(*line, -moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateLine(*line, moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateLine(*line, 0, -moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateLine(*line, 0, moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q)) rotateLine(*line, -rotateAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::E)) rotateLine(*line, rotateAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleLine(*line, scaleFactorUp);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleLine(*line, scaleFactorDown);
 		}
-		if (selectedCircle != -1) {
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateCircle(circles[selectedCircle], -moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateCircle(circles[selectedCircle], moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateCircle(circles[selectedCircle], 0, -moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateCircle(circles[selectedCircle], 0, moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleCircle(circles[selectedCircle], scaleFactorUp);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleCircle(circles[selectedCircle], scaleFactorDown);
+		for (Handle h : selection.circles) {
+			Circle* circle = circles.get(h);
+			if (!circle) continue;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateCircle(*circle, -moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateCircle(*circle, moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateCircle(*circle, 0, -moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateCircle(*circle, 0, moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleCircle(*circle, scaleFactorUp);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleCircle(*circle, scaleFactorDown);
 		}
-		if (selectedEllipse != -1) {
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateEllipse(ellipses[selectedEllipse], -moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateEllipse(ellipses[selectedEllipse], moveAmount, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateEllipse(ellipses[selectedEllipse], 0, -moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateEllipse(ellipses[selectedEllipse], 0, moveAmount);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleEllipse(ellipses[selectedEllipse], scaleFactorUp);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleEllipse(ellipses[selectedEllipse], scaleFactorDown);
+		for (Handle h : selection.ellipses) {
+			Ellipse* ellipse = ellipses.get(h);
+			if (!ellipse) continue;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) translateEllipse(*ellipse, -moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) translateEllipse(*ellipse, moveAmount, 0);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) translateEllipse(*ellipse, 0, -moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) translateEllipse(*ellipse, 0, moveAmount);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) scaleEllipse(*ellipse, scaleFactorUp);
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) scaleEllipse(*ellipse, scaleFactorDown);
 		}
 
+		if (!needsRedraw) continue;
+
 		// --- Draw ---
 		window.clear(sf::Color(30, 30, 30));
-		std::vector<sf::RectangleShape> pixels;
+		pixels.clear();
 
 		for (auto& line : lines) {
 			if (line.useDDA) drawDDALine(pixels, line.p1, line.p2, line.color);
@@ -392,36 +551,32 @@ int main() {
 		for (auto& c : circles) drawCircle(pixels, c);
 		for (auto& e : ellipses) drawEllipse(pixels, e);
 
-		for (auto& r : pixels) window.draw(r);
-
-		// Highlight selected shapes
-		if (selectedLine != -1) {
-			auto& line = lines[selectedLine];
-			sf::Vertex highlight[2] = {
-				sf::Vertex(line.p1, sf::Color::Yellow),
-				sf::Vertex(line.p2, sf::Color::Yellow)
-			};
-			window.draw(highlight, 2, sf::Lines);
+		// Highlight selected shapes: the same algorithms again, in yellow and
+		// on top, so they ride in the same batch
+		for (Handle h : selection.lines) {
+			Line* line = lines.get(h);
+			if (!line) continue;
+			if (line->useDDA) drawDDALine(pixels, line->p1, line->p2, sf::Color::Yellow);
+			else drawBresenhamLine(pixels, line->p1, line->p2, sf::Color::Yellow);
 		}
-		 if (selectedCircle != -1) {
-            auto& c = circles[selectedCircle];
-            sf::CircleShape highlight(c.radius);
-            // CircleShape position is top-left of bounding box, so offset by radius
-            highlight.setPosition(c.center.x - c.radius, c.center.y - c.radius);
-            highlight.setFillColor(sf::Color::Transparent);
-            highlight.setOutlineColor(sf::Color::Yellow);
-            highlight.setOutlineThickness(2);
-            window.draw(highlight);
-        }
-
-		 if (selectedEllipse != -1) {
-			 Ellipse e = ellipses[selectedEllipse];
-			 Ellipse highlight = e;
-			 highlight.color = sf::Color::Yellow; // override color
-			 drawEllipse(pixels, highlight);      // same algorithm, now yellow
-		 }
+		for (Handle h : selection.circles) {
+			if (!circles.get(h)) continue;
+			Circle highlight = *circles.get(h);
+			highlight.color = sf::Color::Yellow;
+			drawCircle(pixels, highlight);
+		}
+		for (Handle h : selection.ellipses) {
+			if (!ellipses.get(h)) continue;
+			Ellipse highlight = *ellipses.get(h);
+			highlight.color = sf::Color::Yellow; // override color
+			drawEllipse(pixels, highlight);      // same algorithm, now yellow
+		}
+
+		// One draw call for the whole frame
+		pixels.draw(window);
 
         window.display();
+        needsRedraw = false;
     }
 
     return 0;
@@ -4,8 +4,40 @@
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <initializer_list>
+#include <unordered_map>
+#include <deque>
+#include <set>
+#include <queue>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // ============================================================================
 // CONSTANTS AND CONFIGURATION
@@ -18,38 +50,30 @@ const float SCALE_FACTOR_DOWN = 0.98f;
 const float PI = 3.14159265358979323846f;
 const int WINDOW_WIDTH = 1200;
 const int WINDOW_HEIGHT = 800;
-
-// ============================================================================
-// UTILITY STRUCTURES
-// ============================================================================
-struct Transform2D {
-	float tx, ty;      // Translation
-	float rotation;    // Rotation in radians
-	float sx, sy;      // Scale
-
-	Transform2D() : tx(0), ty(0), rotation(0), sx(1), sy(1) {}
-};
-
-// ============================================================================
-// BASE SHAPE CLASS (POLYMORPHIC DESIGN)
-// ============================================================================
-class Shape {
-public:
-	sf::Color color;
-	bool isSelected;
-	Transform2D transform;
-
-	Shape() : color(sf::Color::White), isSelected(false) {}
-	virtual ~Shape() = default;
-
-	virtual void draw(std::vector<sf::RectangleShape>& pixels) = 0;
-	virtual bool containsPoint(sf::Vector2f point) = 0;
-	virtual void translate(float dx, float dy) = 0;
-	virtual void rotate(float angleDegrees) = 0;
-	virtual void scale(float factor) = 0;
-	virtual sf::Vector2f getCenter() = 0;
-	virtual std::string getInfo() = 0;
-};
+const size_t PARALLEL_DRAW_MIN = 64;   // below this many shapes, rasterize serially
+const float LOD_DOT_SIZE = 1.5f;       // screen radius below which a shape is a dot
+const float BEZIER_SEGMENT_PIXELS = 4.0f;
+const int SPLINE_DEGREE = 3;
+const int SPLINE_MAX_SAMPLES = 32;     // curve points per B-spline span, at most
+const float SPLINE_FLATNESS = 0.25f;   // chord-to-curve gap allowed: pixels drawn, world units picked
+const float NURBS_MIN_WEIGHT = 0.01f;
+const float NURBS_MAX_WEIGHT = 100.0f;
+const float NURBS_HEAVY_WEIGHT = 4.0f; // weight of a shift-clicked NURBS control point
+const float ZOOM_MIN = 0.01f;
+const float ZOOM_MAX = 50.0f;
+const float ZOOM_STEP = 1.1f;
+const unsigned int EXPORT_SIZE = 20000;      // longest side of an F6 export, in pixels
+const int EXPORT_TILE = 256;                 // export band height and tile width
+const float SNAP_PIXELS = 10.0f;             // snap reach around the cursor, on screen
+const float SNAP_CELL = 16.0f;               // snap grid cell size, in world units
+const int MAX_LAYERS = 16;                   // layer numbers fit in four bits of a scene record
+const float MAX_STROKE_WIDTH = 32.0f;        // widest stroke, in world units
+const size_t UNDO_MEMORY = 256u << 20;       // bytes of undo history kept
+const size_t UNDO_LEVELS = 1000;
+const int FILL_TOLERANCE = 24;               // per-channel colour difference the paint bucket ignores
+const int AA_ATLAS_WIDTH = 2048;             // texels per row of the on-screen coverage atlas
+const int AA_BLOCK_ROWS = 4;                 // rows per anti-aliased coverage block
+const int AA_SETTLE_MS = 150;                // input quiet time before rough frames are smoothed
 
 // ============================================================================
 // MATRIX OPERATIONS FOR TRANSFORMATIONS
@@ -92,6 +116,22 @@ struct Matrix3x3 {
 		return sf::Vector2f(x, y);
 	}
 
+	// Batched version of transform(); the loop body is branch-free so the
+	// compiler can vectorize it across the whole vertex array
+	void transformAll(const std::vector<sf::Vector2f>& in, std::vector<sf::Vector2f>& out) const {
+		out.resize(in.size());
+		const float a = m[0][0], b = m[0][1], c = m[0][2];
+		const float d = m[1][0], e = m[1][1], f = m[1][2];
+		const sf::Vector2f* src = in.data();
+		sf::Vector2f* dst = out.data();
+		for (size_t i = 0; i < in.size(); i++) {
+			float x = src[i].x;
+			float y = src[i].y;
+			dst[i].x = a * x + b * y + c;
+			dst[i].y = d * x + e * y + f;
+		}
+	}
+
 	Matrix3x3 multiply(const Matrix3x3& other) const {
 		Matrix3x3 result;
 		for (int i = 0; i < 3; i++) {
@@ -107,660 +147,7508 @@ struct Matrix3x3 {
 };
 
 // ============================================================================
-// LINE CLASS
+// UTILITY STRUCTURES
 // ============================================================================
-class Line : public Shape {
-public:
-	sf::Vector2f p1, p2;
-	enum Algorithm { DDA, BRESENHAM } algorithm;
+struct Transform2D {
+	float tx, ty;      // Translation
+	float rotation;    // Rotation in radians
+	float sx, sy;      // Scale
 
-	Line(sf::Vector2f start, sf::Vector2f end, Algorithm algo, sf::Color col)
-		: p1(start), p2(end), algorithm(algo) {
-		color = col;
+	Transform2D() : tx(0), ty(0), rotation(0), sx(1), sy(1) {}
+
+	// Scale and rotate about the pivot, then translate
+	Matrix3x3 toMatrix(sf::Vector2f pivot) const {
+		return Matrix3x3::translation(pivot.x + tx, pivot.y + ty)
+			.multiply(Matrix3x3::rotation(rotation))
+			.multiply(Matrix3x3::scaling(sx, sy))
+			.multiply(Matrix3x3::translation(-pivot.x, -pivot.y));
 	}
+};
 
-	void draw(std::vector<sf::RectangleShape>& pixels) override {
-		if (algorithm == DDA) {
-			drawDDA(pixels);
-		}
-		else {
-			drawBresenham(pixels);
-		}
+// Bounds include the 2x2 plot size so they cover every emitted pixel
+sf::FloatRect boundsOf(const std::vector<sf::Vector2f>& points) {
+	if (points.empty()) return sf::FloatRect();
+	float minX = points[0].x, maxX = points[0].x;
+	float minY = points[0].y, maxY = points[0].y;
+	for (auto& p : points) {
+		minX = std::min(minX, p.x);
+		maxX = std::max(maxX, p.x);
+		minY = std::min(minY, p.y);
+		maxY = std::max(maxY, p.y);
+	}
+	return sf::FloatRect(minX, minY, maxX - minX + 2, maxY - minY + 2);
+}
+
+sf::FloatRect boundsOf(sf::Vector2f a, sf::Vector2f b) {
+	float minX = std::min(a.x, b.x);
+	float minY = std::min(a.y, b.y);
+	return sf::FloatRect(minX, minY, std::abs(b.x - a.x) + 2, std::abs(b.y - a.y) + 2);
+}
+
+sf::Vector2f centroid(const std::vector<sf::Vector2f>& points) {
+	sf::Vector2f sum(0, 0);
+	for (auto& p : points) {
+		sum += p;
+	}
+	return points.empty() ? sum : sum / static_cast<float>(points.size());
+}
+
+// World-to-screen mapping used while rasterizing: uniform zoom plus offset.
+// Shapes rasterize in screen pixels, so detail follows their projected size.
+struct RasterView {
+	float zoom;             // screen pixels per world unit
+	sf::Vector2f offset;    // screen position of the world origin
+	sf::FloatRect screen;   // visible screen area, for culling
+	bool antialias;         // polygons, circles, ellipses and strokes by coverage
+
+	RasterView() : zoom(1), offset(0, 0), screen(0, 0,
+		static_cast<float>(WINDOW_WIDTH), static_cast<float>(WINDOW_HEIGHT)), antialias(false) {}
+
+	sf::Vector2f toScreen(sf::Vector2f p) const {
+		return sf::Vector2f(p.x * zoom + offset.x, p.y * zoom + offset.y);
 	}
 
-	bool containsPoint(sf::Vector2f point) override {
-		return distanceToSegment(point) < SELECTION_THRESHOLD;
+	Matrix3x3 matrix() const {
+		return Matrix3x3::translation(offset.x, offset.y).multiply(Matrix3x3::scaling(zoom, zoom));
 	}
 
-	void translate(float dx, float dy) override {
-		p1.x += dx; p1.y += dy;
-		p2.x += dx; p2.y += dy;
+	bool isVisible(float minX, float minY, float maxX, float maxY) const {
+		sf::Vector2f a = toScreen(sf::Vector2f(minX, minY));
+		sf::Vector2f b = toScreen(sf::Vector2f(maxX, maxY));
+		return b.x >= screen.left && a.x <= screen.left + screen.width &&
+			b.y >= screen.top && a.y <= screen.top + screen.height;
 	}
 
-	void rotate(float angleDegrees) override {
-		sf::Vector2f center = getCenter();
-		float angleRad = angleDegrees * PI / 180.0f;
+	// Screen area a 2x2 plot or span can still reach: they start up to two
+	// pixels left of and above what they cover
+	sf::FloatRect plotClip() const {
+		return sf::FloatRect(screen.left - 2, screen.top - 2, screen.width + 4, screen.height + 4);
+	}
+};
+
+// Liang-Barsky: the part of a -> b inside clip is [t0, t1] of its length,
+// false if there is none
+bool clipSegment(sf::Vector2f a, sf::Vector2f b, const sf::FloatRect& clip, float& t0, float& t1) {
+	sf::Vector2f d = b - a;
+	const float p[4] = { -d.x, d.x, -d.y, d.y };
+	const float q[4] = { a.x - clip.left, clip.left + clip.width - a.x,
+		a.y - clip.top, clip.top + clip.height - a.y };
+
+	t0 = 0;
+	t1 = 1;
+	for (int i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0) return false;   // parallel to this side and outside it
+			continue;
+		}
+		float t = q[i] / p[i];
+		if (p[i] < 0) t0 = std::max(t0, t);
+		else t1 = std::min(t1, t);
+		if (t0 > t1) return false;
+	}
+	return true;
+}
+
+// ============================================================================
+// PIXEL BUFFER (RECTANGLE RUNS, SUBMITTED AS ONE VERTEX ARRAY)
+// ============================================================================
+// A run is a solid block: a 2x2 plotted pixel, a filled span or a marker.
+// A coverage block is a run of up to AA_BLOCK_ROWS rows whose pixels each
+// take their own alpha; anti-aliased edges are blocks, so an edge pixel
+// costs a byte rather than a run of its own. The alphas are coverage,
+// with the run's colour alpha still to apply. They are kept in shelves of
+// AA_BLOCK_ROWS rows of AA_ATLAS_WIDTH bytes, blocks side by side, which
+// is the layout the on-screen coverage atlas uploads as it is.
+struct PixelRun {
+	float x, y, w, h;
+	sf::Color color;
+	std::uint32_t block;   // 0 for a solid run, else 1 + where its alphas start
+};
+
+class PixelBuffer {
+public:
+	std::vector<PixelRun> runs;
+	std::vector<sf::Uint8> coverage;   // the blocks' alphas, shelf after shelf
 
-		// Manual rotation calculation
-		auto rotatePoint = [&](sf::Vector2f& p) {
-			float dx = p.x - center.x;
-			float dy = p.y - center.y;
-			float xNew = dx * cos(angleRad) - dy * sin(angleRad);
-			float yNew = dx * sin(angleRad) + dy * cos(angleRad);
-			p.x = center.x + xNew;
-			p.y = center.y + yNew;
-			};
+	PixelBuffer() : blocks(0), blockPixels(0), shelfColumn(AA_ATLAS_WIDTH) {}
 
-		rotatePoint(p1);
-		rotatePoint(p2);
+	void plot(float x, float y, sf::Color color) {
+		rect(x, y, 2, 2, color);
 	}
 
-	void scale(float factor) override {
-		sf::Vector2f center = getCenter();
-		p1 = center + (p1 - center) * factor;
-		p2 = center + (p2 - center) * factor;
+	void plot(sf::Vector2f p, sf::Color color) {
+		rect(p.x, p.y, 2, 2, color);
 	}
 
-	sf::Vector2f getCenter() override {
-		return (p1 + p2) / 2.0f;
+	// Inclusive pixel range [x0, x1] on row y, at the same 2px plot size
+	void span(int y, int x0, int x1, sf::Color color) {
+		rect(static_cast<float>(x0), static_cast<float>(y),
+			static_cast<float>(x1 - x0 + 2), 2, color);
 	}
 
-	std::string getInfo() override {
-		std::stringstream ss;
-		float length = sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2));
-		ss << "Line (" << (algorithm == DDA ? "DDA" : "Bresenham") << ") | "
-			<< "Length: " << std::fixed << std::setprecision(1) << length;
-		return ss.str();
+	void rect(float x, float y, float w, float h, sf::Color color) {
+		PixelRun run;
+		run.x = x; run.y = y;
+		run.w = w; run.h = h;
+		run.color = color;
+		run.block = 0;
+		runs.push_back(run);
 	}
 
-private:
-	void drawDDA(std::vector<sf::RectangleShape>& pixels) {
-		float dx = p2.x - p1.x;
-		float dy = p2.y - p1.y;
-		float steps = std::max(std::abs(dx), std::abs(dy));
+	// A w x h coverage block at (x, y), at most AA_ATLAS_WIDTH by
+	// AA_BLOCK_ROWS. The caller writes its alphas at the address returned,
+	// rows AA_ATLAS_WIDTH bytes apart.
+	sf::Uint8* block(int x, int y, int w, int h, sf::Color color) {
+		const size_t shelf = static_cast<size_t>(AA_ATLAS_WIDTH) * AA_BLOCK_ROWS;
+		if (shelfColumn + w > AA_ATLAS_WIDTH) {
+			coverage.resize(coverage.size() + shelf);
+			shelfColumn = 0;
+		}
+		size_t at = coverage.size() - shelf + shelfColumn;
+		shelfColumn += w;
+		rect(static_cast<float>(x), static_cast<float>(y), static_cast<float>(w), static_cast<float>(h), color);
+		runs.back().block = static_cast<std::uint32_t>(at + 1);
+		blockPixels += static_cast<size_t>(w) * h;
+		blocks++;
+		return coverage.data() + at;
+	}
 
-		if (steps == 0) return;
+	// The top-left alpha of a block, or null for a solid run
+	const sf::Uint8* alphasOf(const PixelRun& run) const {
+		return run.block ? coverage.data() + (run.block - 1) : nullptr;
+	}
 
-		float xInc = dx / steps;
-		float yInc = dy / steps;
-		float x = p1.x;
-		float y = p1.y;
-
-		for (int i = 0; i <= steps; i++) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(std::round(x), std::round(y));
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
-			x += xInc;
-			y += yInc;
-		}
+	// Appends a sprite's runs shifted by whole pixels (dx, dy) and drawn in
+	// one colour, each at its own alpha of that colour's
+	void blit(const PixelBuffer& source, float dx, float dy, sf::Color color) {
+		for (auto& r : source.runs) copy(source, r, dx, dy, color);
 	}
 
-	void drawBresenham(std::vector<sf::RectangleShape>& pixels) {
-		int x1 = static_cast<int>(std::round(p1.x));
-		int y1 = static_cast<int>(std::round(p1.y));
-		int x2 = static_cast<int>(std::round(p2.x));
-		int y2 = static_cast<int>(std::round(p2.y));
+	// As above, keeping only the runs that overlap clip
+	void blit(const PixelBuffer& source, float dx, float dy, sf::Color color,
+		const sf::FloatRect& clip) {
+		float left = clip.left - dx, right = clip.left + clip.width - dx;
+		float top = clip.top - dy, bottom = clip.top + clip.height - dy;
+		for (auto& r : source.runs) {
+			if (r.x + r.w <= left || r.x >= right || r.y + r.h <= top || r.y >= bottom) continue;
+			copy(source, r, dx, dy, color);
+		}
+	}
 
-		int dx = std::abs(x2 - x1);
-		int dy = std::abs(y2 - y1);
-		int sx = (x1 < x2) ? 1 : -1;
-		int sy = (y1 < y2) ? 1 : -1;
-		int err = dx - dy;
+	void clear() {
+		runs.clear();
+		coverage.clear();
+		blocks = 0;
+		blockPixels = 0;
+		shelfColumn = AA_ATLAS_WIDTH;
+	}
 
-		while (true) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(static_cast<float>(x1), static_cast<float>(y1));
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
+	size_t size() const {
+		return runs.size();
+	}
 
-			if (x1 == x2 && y1 == y2) break;
+	// A solid run is one quad and a block one per pixel
+	size_t quadCount() const {
+		return runs.size() - blocks + blockPixels;
+	}
 
-			int e2 = 2 * err;
-			if (e2 > -dy) {
-				err -= dy;
-				x1 += sx;
-			}
-			if (e2 < dx) {
-				err += dx;
-				y1 += sy;
+	// Writes 4 vertices per quad starting at out
+	void toQuads(sf::Vertex* out) const {
+		for (auto& r : runs) {
+			if (r.block) {
+				const sf::Uint8* alphas = alphasOf(r);
+				sf::Color color = r.color;
+				for (int row = 0; row < static_cast<int>(r.h); row++, alphas += AA_ATLAS_WIDTH) {
+					float y = r.y + row;
+					for (int i = 0; i < static_cast<int>(r.w); i++) {
+						color.a = static_cast<sf::Uint8>(alphas[i] * r.color.a / 255);
+						float x = r.x + i;
+						out[0] = sf::Vertex(sf::Vector2f(x, y), color);
+						out[1] = sf::Vertex(sf::Vector2f(x + 1, y), color);
+						out[2] = sf::Vertex(sf::Vector2f(x + 1, y + 1), color);
+						out[3] = sf::Vertex(sf::Vector2f(x, y + 1), color);
+						out += 4;
+					}
+				}
+				continue;
 			}
+			out[0] = sf::Vertex(sf::Vector2f(r.x, r.y), r.color);
+			out[1] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y), r.color);
+			out[2] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y + r.h), r.color);
+			out[3] = sf::Vertex(sf::Vector2f(r.x, r.y + r.h), r.color);
+			out += 4;
 		}
 	}
 
-	float distanceToSegment(sf::Vector2f p) {
-		float dx = p2.x - p1.x;
-		float dy = p2.y - p1.y;
-		float lengthSquared = dx * dx + dy * dy;
+	// A block is one quad too when drawn from the coverage atlas
+	size_t texturedQuadCount() const {
+		return runs.size();
+	}
 
-		if (lengthSquared == 0) {
-			dx = p.x - p1.x;
-			dy = p.y - p1.y;
-			return sqrt(dx * dx + dy * dy);
+	// As toQuads with one quad per block too, textured from a coverage
+	// atlas whose row 'firstRow' holds the buffer's first shelf. Solid runs
+	// keep texture coordinate (0, 0), the atlas's opaque texel.
+	void toTexturedQuads(sf::Vertex* out, unsigned int firstRow) const {
+		for (auto& r : runs) {
+			if (!r.block) {
+				out[0] = sf::Vertex(sf::Vector2f(r.x, r.y), r.color);
+				out[1] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y), r.color);
+				out[2] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y + r.h), r.color);
+				out[3] = sf::Vertex(sf::Vector2f(r.x, r.y + r.h), r.color);
+				out += 4;
+				continue;
+			}
+			size_t at = r.block - 1;
+			float u = static_cast<float>(at % AA_ATLAS_WIDTH);
+			float v = static_cast<float>(firstRow + at / AA_ATLAS_WIDTH);
+			out[0] = sf::Vertex(sf::Vector2f(r.x, r.y), r.color, sf::Vector2f(u, v));
+			out[1] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y), r.color, sf::Vector2f(u + r.w, v));
+			out[2] = sf::Vertex(sf::Vector2f(r.x + r.w, r.y + r.h), r.color, sf::Vector2f(u + r.w, v + r.h));
+			out[3] = sf::Vertex(sf::Vector2f(r.x, r.y + r.h), r.color, sf::Vector2f(u, v + r.h));
+			out += 4;
 		}
+	}
 
-		float t = ((p.x - p1.x) * dx + (p.y - p1.y) * dy) / lengthSquared;
-		t = std::max(0.0f, std::min(1.0f, t));
+private:
+	size_t blocks;
+	size_t blockPixels;
+	int shelfColumn;   // first free column of the last shelf
+
+	void copy(const PixelBuffer& source, const PixelRun& r, float dx, float dy, sf::Color color) {
+		color.a = static_cast<sf::Uint8>(color.a * r.color.a / 255);
+		const sf::Uint8* alphas = source.alphasOf(r);
+		if (!alphas) {
+			rect(r.x + dx, r.y + dy, r.w, r.h, color);
+			return;
+		}
+		int w = static_cast<int>(r.w), h = static_cast<int>(r.h);
+		sf::Uint8* out = block(static_cast<int>(r.x + dx), static_cast<int>(r.y + dy), w, h, color);
+		for (int row = 0; row < h; row++) {
+			std::memcpy(out + row * AA_ATLAS_WIDTH, alphas + row * AA_ATLAS_WIDTH, w);
+		}
+	}
+};
 
-		float projX = p1.x + t * dx;
-		float projY = p1.y + t * dy;
+// Bresenham's line, stepped only where it can land in clip. Each step moves
+// one pixel along the major axis; the minor axis has then moved
+// #{j : (2j + 1) major < 2 k minor} times after k steps, so the error term
+// restarts exactly and the pixels match those of the whole line.
+void plotBresenham(PixelBuffer& pixels, sf::Vector2f p1, sf::Vector2f p2,
+	const sf::FloatRect& clip, sf::Color color) {
+	int x1 = static_cast<int>(std::round(p1.x));
+	int y1 = static_cast<int>(std::round(p1.y));
+	int x2 = static_cast<int>(std::round(p2.x));
+	int y2 = static_cast<int>(std::round(p2.y));
+
+	long long dx = std::abs(x2 - x1);
+	long long dy = std::abs(y2 - y1);
+	int sx = (x1 < x2) ? 1 : -1;
+	int sy = (y1 < y2) ? 1 : -1;
+	long long steps = std::max(dx, dy);
+
+	float t0, t1;
+	if (!clipSegment(sf::Vector2f(static_cast<float>(x1), static_cast<float>(y1)),
+		sf::Vector2f(static_cast<float>(x2), static_cast<float>(y2)), clip, t0, t1)) return;
+	// Pixels stay within half a pixel of the line: one step of slack
+	long long first = std::max(0LL, static_cast<long long>(std::floor(t0 * steps)) - 1);
+	long long last = std::min(steps, static_cast<long long>(std::ceil(t1 * steps)) + 1);
+
+	auto minorSteps = [](long long k, long long major, long long minor) {
+		long long n = 2 * k * minor - major;
+		return (n <= 0) ? 0 : (n - 1) / (2 * major) + 1;
+	};
+	long long i = (dx >= dy) ? first : minorSteps(first, dy, dx);   // x steps taken
+	long long j = (dx >= dy) ? minorSteps(first, dx, dy) : first;   // y steps taken
+	long long x = x1 + i * sx;
+	long long y = y1 + j * sy;
+	long long err = dx - dy - i * dy + j * dx;
 
-		dx = p.x - projX;
-		dy = p.y - projY;
-		return sqrt(dx * dx + dy * dy);
+	for (long long k = first; ; k++) {
+		pixels.plot(static_cast<float>(x), static_cast<float>(y), color);
+
+		if (k == last) break;
+
+		long long e2 = 2 * err;
+		if (e2 > -dy) { err -= dy; x += sx; }
+		if (e2 < dx) { err += dx; y += sy; }
 	}
-};
+}
 
 // ============================================================================
-// CIRCLE CLASS (MIDPOINT CIRCLE ALGORITHM)
+// SCAN-LINE FILLER (EDGE TABLE + ACTIVE EDGE TABLE)
 // ============================================================================
-class Circle : public Shape {
-public:
-	sf::Vector2f center;
-	float radius;
+enum class FillRule { EVEN_ODD, NON_ZERO };
 
-	Circle(sf::Vector2f c, float r, sf::Color col)
-		: center(c), radius(r) {
-		color = col;
-	}
+// Horizontal run of covered pixels on row y, inclusive on both ends
+struct Span {
+	int y;
+	int x0, x1;
+};
 
-	void draw(std::vector<sf::RectangleShape>& pixels) override {
-		// Midpoint Circle Algorithm
-		int x = 0;
-		int y = static_cast<int>(radius);
-		int d = 1 - y;
+class ScanlineFiller {
+public:
+	void reset() {
+		edgeTable.clear();
+		clipLeft = clipTop = -UNCLIPPED;
+		clipRight = clipBottom = UNCLIPPED;
+	}
 
-		while (x <= y) {
-			plot8Points(pixels, x, y);
+	// Only rows and columns inside clip are scanned and emitted
+	void reset(const sf::FloatRect& clip) {
+		edgeTable.clear();
+		clipLeft = static_cast<int>(std::floor(clip.left));
+		clipTop = static_cast<int>(std::floor(clip.top));
+		clipRight = static_cast<int>(std::ceil(clip.left + clip.width));
+		clipBottom = static_cast<int>(std::ceil(clip.top + clip.height));
+	}
 
-			if (d < 0) {
-				d += 2 * x + 3;
-			}
-			else {
-				d += 2 * (x - y) + 5;
-				y--;
-			}
-			x++;
+	// Closed contour; several contours may be added before fill()
+	void addContour(const std::vector<sf::Vector2f>& points) {
+		for (size_t i = 0; i < points.size(); i++) {
+			addEdge(points[i], points[(i + 1) % points.size()]);
 		}
 	}
 
-	bool containsPoint(sf::Vector2f point) override {
-		float dx = point.x - center.x;
-		float dy = point.y - center.y;
-		float distance = sqrt(dx * dx + dy * dy);
-		return std::abs(distance - radius) < SELECTION_THRESHOLD;
-	}
+	void addEdge(sf::Vector2f a, sf::Vector2f b) {
+		if (a.y == b.y) return;   // horizontal edges never cross a scanline
 
-	void translate(float dx, float dy) override {
-		center.x += dx;
-		center.y += dy;
-	}
+		Edge edge;
+		edge.winding = (a.y < b.y) ? 1 : -1;
+		if (a.y > b.y) std::swap(a, b);
 
-	void rotate(float angleDegrees) override {
-		// Circle is rotationally symmetric, no visual change
-	}
+		// Sample rows y with a.y <= y < b.y, as the old per-row test did,
+		// trimmed to the clip rows so the AET never walks hidden ones
+		if (b.y <= clipTop || a.y >= clipBottom) return;
+		edge.yTop = std::max(static_cast<int>(std::ceil(a.y)), clipTop);
+		edge.yBottom = std::min(static_cast<int>(std::ceil(b.y)), clipBottom);
+		if (edge.yTop >= edge.yBottom) return;
 
-	void scale(float factor) override {
-		radius *= factor;
-		if (radius < 1.0f) radius = 1.0f;
+		edge.dxdy = (b.x - a.x) / (b.y - a.y);
+		edge.x = a.x + (edge.yTop - a.y) * edge.dxdy;
+		edgeTable.push_back(edge);
 	}
 
-	sf::Vector2f getCenter() override {
-		return center;
-	}
+	void fill(FillRule rule, std::vector<Span>& spans) {
+		if (edgeTable.empty()) return;
 
-	std::string getInfo() override {
-		std::stringstream ss;
-		float area = PI * radius * radius;
-		float circumference = 2 * PI * radius;
-		ss << "Circle | Radius: " << std::fixed << std::setprecision(1) << radius
-			<< " | Area: " << area << " | Circum: " << circumference;
-		return ss.str();
+		// Edges are sorted once by their first scanline
+		std::sort(edgeTable.begin(), edgeTable.end(),
+			[](const Edge& a, const Edge& b) { return a.yTop < b.yTop; });
+
+		active.clear();
+		size_t next = 0;
+		int y = edgeTable[0].yTop;
+
+		while (next < edgeTable.size() || !active.empty()) {
+			if (active.empty()) {
+				y = std::max(y, edgeTable[next].yTop);
+			}
+
+			// Move edges starting on this row into the AET
+			while (next < edgeTable.size() && edgeTable[next].yTop <= y) {
+				active.push_back(edgeTable[next++]);
+			}
+
+			// Drop edges that ended above this row
+			active.erase(std::remove_if(active.begin(), active.end(),
+				[y](const Edge& e) { return e.yBottom <= y; }), active.end());
+
+			// x order barely changes between rows, so insertion sort is ~O(n)
+			for (size_t i = 1; i < active.size(); i++) {
+				Edge e = active[i];
+				size_t j = i;
+				while (j > 0 && active[j - 1].x > e.x) {
+					active[j] = active[j - 1];
+					j--;
+				}
+				active[j] = e;
+			}
+
+			emitRow(rule, y, spans);
+
+			// Step x incrementally instead of re-intersecting every edge
+			for (auto& e : active) {
+				e.x += e.dxdy;
+			}
+			y++;
+		}
 	}
 
 private:
-	void plot8Points(std::vector<sf::RectangleShape>& pixels, int x, int y) {
-		std::vector<sf::Vector2f> points = {
-			{center.x + x, center.y + y}, {center.x - x, center.y + y},
-			{center.x + x, center.y - y}, {center.x - x, center.y - y},
-			{center.x + y, center.y + x}, {center.x - y, center.y + x},
-			{center.x + y, center.y - x}, {center.x - y, center.y - x}
-		};
+	struct Edge {
+		int yTop, yBottom;   // first row covered, first row past the edge
+		float x;             // intersection with the current row
+		float dxdy;
+		int winding;         // +1 downward, -1 upward
+	};
 
-		for (auto& p : points) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(p);
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
+	static constexpr int UNCLIPPED = 1 << 30;
+
+	std::vector<Edge> edgeTable;
+	std::vector<Edge> active;
+	int clipLeft = -UNCLIPPED, clipTop = -UNCLIPPED;
+	int clipRight = UNCLIPPED, clipBottom = UNCLIPPED;   // exclusive
+
+	void emitRow(FillRule rule, int y, std::vector<Span>& spans) {
+		if (rule == FillRule::EVEN_ODD) {
+			for (size_t i = 0; i + 1 < active.size(); i += 2) {
+				pushSpan(spans, y, active[i].x, active[i + 1].x);
+			}
+			return;
+		}
+
+		int winding = 0;
+		float start = 0;
+		for (auto& e : active) {
+			int before = winding;
+			winding += e.winding;
+			if (before == 0 && winding != 0) start = e.x;
+			else if (before != 0 && winding == 0) pushSpan(spans, y, start, e.x);
 		}
 	}
+
+	void pushSpan(std::vector<Span>& spans, int y, float xa, float xb) const {
+		if (xb < clipLeft || xa >= clipRight) return;
+		Span s;
+		s.y = y;
+		s.x0 = std::max(static_cast<int>(std::floor(xa)), clipLeft);
+		s.x1 = std::min(static_cast<int>(std::floor(xb)), clipRight - 1);
+		if (s.x1 >= s.x0) spans.push_back(s);
+	}
 };
 
 // ============================================================================
-// ELLIPSE CLASS (MIDPOINT ELLIPSE ALGORITHM)
+// ANALYTIC COVERAGE (SIGNED-AREA ACCUMULATION)
 // ============================================================================
-class Ellipse : public Shape {
+const float AA_HAIRLINE = 2.0f;     // anti-aliased outline width in pixels, as heavy as a 2x2 plot
+const size_t AA_BAND_CELLS = 1 << 16;   // accumulation buffer per band; a band takes as many rows as fit
+
+// Anti-aliased filling the way font rasterizers do it. Each edge is walked
+// through the pixel cells it crosses, and every cell collects 'cover', the
+// signed height of edge inside it, and 'area', that height times the part
+// of the cell right of the edge. A pixel's coverage is the sum of the
+// covers left of it plus its own area, so the exact covered fraction comes
+// out with no supersampling. Edges are kept until fill(), which takes the
+// shape a band of rows at a time and accumulates them into a dense buffer:
+// a cell gets its area and the next cell the rest of its cover, so a
+// running sum along the row is the coverage. A bitmap marks the cells
+// written. Rows are swept AA_BLOCK_ROWS at a time: each stretch of columns
+// marked in any of them goes out as one coverage block, and between them
+// each row's sum is constant and goes out as a solid run, shared by the
+// rows that agree, so an interior or a gap costs a run rather than a visit
+// per pixel, and an edge a block rather than a run per row.
+class AreaCoverage {
 public:
-	sf::Vector2f center;
-	float rx, ry;
-
-	Ellipse(sf::Vector2f c, float radiusX, float radiusY, sf::Color col)
-		: center(c), rx(radiusX), ry(radiusY) {
-		color = col;
-		if (rx < 1.0f) rx = 1.0f;
-		if (ry < 1.0f) ry = 1.0f;
+	// Per-thread scratch, so rasterization workers never share one
+	static AreaCoverage& local() {
+		thread_local AreaCoverage coverage;
+		return coverage;
 	}
 
-	void draw(std::vector<sf::RectangleShape>& pixels) override {
-		// Midpoint Ellipse Algorithm
-		float rx2 = rx * rx;
-		float ry2 = ry * ry;
-		float x = 0, y = ry;
-		float dx = 2 * ry2 * x;
-		float dy = 2 * rx2 * y;
-
-		// Region 1: slope > -1
-		float p1 = ry2 - (rx2 * ry) + (0.25f * rx2);
-		while (dx < dy) {
-			plot4Points(pixels, x, y);
+	// Only pixels inside 'clip' are emitted
+	void reset(const sf::FloatRect& clip) {
+		edges.clear();
+		left = std::floor(clip.left);
+		top = std::floor(clip.top);
+		right = std::ceil(clip.left + clip.width);
+		bottom = std::ceil(clip.top + clip.height);
+		minX = right;
+		maxX = left;
+		minY = bottom;
+		maxY = top;
+	}
 
-			if (p1 < 0) {
-				x++;
-				dx += 2 * ry2;
-				p1 += dx + ry2;
-			}
-			else {
-				x++;
-				y--;
-				dx += 2 * ry2;
-				dy -= 2 * rx2;
-				p1 += dx - dy + ry2;
-			}
+	// Closed contour; several contours may be added before fill()
+	void addContour(const std::vector<sf::Vector2f>& points, bool reversed = false) {
+		for (size_t i = 0; i < points.size(); i++) {
+			const sf::Vector2f& a = points[i];
+			const sf::Vector2f& b = points[(i + 1) % points.size()];
+			if (reversed) addEdge(b, a);
+			else addEdge(a, b);
 		}
+	}
 
-		// Region 2: slope < -1
-		float p2 = ry2 * (x + 0.5f) * (x + 0.5f) + rx2 * (y - 1) * (y - 1) - rx2 * ry2;
-		while (y >= 0) {
-			plot4Points(pixels, x, y);
+	// Square-capped band of the given half-width along a -> b. Every band
+	// winds the same way whatever its direction, so where bands overlap at
+	// the joins their covers add up instead of cancelling.
+	void addSegment(sf::Vector2f a, sf::Vector2f b, float half) {
+		sf::Vector2f d = b - a;
+		float length = std::sqrt(d.x * d.x + d.y * d.y);
+		d = (length > 0) ? d * (half / length) : sf::Vector2f(half, 0);
+		sf::Vector2f n(-d.y, d.x);
+		a -= d;
+		b += d;
+		addEdge(a - n, b - n);
+		addEdge(b - n, b + n);
+		addEdge(b + n, a + n);
+		addEdge(a + n, a - n);
+	}
 
-			if (p2 > 0) {
-				y--;
-				dy -= 2 * rx2;
-				p2 += rx2 - dy;
-			}
-			else {
-				y--;
-				x++;
-				dx += 2 * ry2;
-				dy -= 2 * rx2;
-				p2 += dx - dy + rx2;
-			}
+	// Ellipse with semi-axes a and b turned by 'rotation', as a polygon
+	// whose chords stay within an eighth of a pixel of the curve. The
+	// angle steps by rotating a unit vector, not by a sine per vertex.
+	void addEllipse(sf::Vector2f c, float a, float b, float rotation, bool reversed = false) {
+		int n = static_cast<int>(std::ceil(PI * std::sqrt(4.0f * std::max({ a, b, 0.5f }))));
+		n = std::max(16, std::min(n, 4096));
+		float cs = std::cos(rotation), sn = std::sin(rotation);
+		float stepCos = std::cos(2 * PI / n), stepSin = std::sin(2 * PI / n);
+		float ux = 1, uy = 0;
+		contour.resize(n);
+		for (int i = 0; i < n; i++) {
+			float u = a * ux, v = b * uy;
+			contour[i] = sf::Vector2f(c.x + u * cs - v * sn, c.y + u * sn + v * cs);
+			float next = ux * stepCos - uy * stepSin;
+			uy = ux * stepSin + uy * stepCos;
+			ux = next;
 		}
+		addContour(contour, reversed);
 	}
 
-	bool containsPoint(sf::Vector2f point) override {
-		float dx = point.x - center.x;
-		float dy = point.y - center.y;
-		float value = (dx * dx) / (rx * rx) + (dy * dy) / (ry * ry);
-		return std::abs(value - 1.0f) < 0.15f;
+	void addEdge(sf::Vector2f a, sf::Vector2f b) {
+		if (a.y == b.y || std::max(a.y, b.y) <= top || std::min(a.y, b.y) >= bottom) return;
+		if (a.y < top) a = atY(a, b, top);
+		if (b.y < top) b = atY(a, b, top);
+		if (a.y > bottom) a = atY(a, b, bottom);
+		if (b.y > bottom) b = atY(a, b, bottom);
+
+		// Right of the clip an edge only covers pixels further right; left
+		// of it, its cover lands on the clip's left column instead
+		if (a.x >= right && b.x >= right) return;
+		if (a.x > right) a = atX(a, b, right);
+		if (b.x > right) b = atX(a, b, right);
+		if (a.x <= left && b.x <= left) {
+			keep(sf::Vector2f(left, a.y), sf::Vector2f(left, b.y));
+		}
+		else if (a.x < left) {
+			sf::Vector2f m = atX(a, b, left);
+			keep(sf::Vector2f(left, a.y), m);
+			keep(m, b);
+		}
+		else if (b.x < left) {
+			sf::Vector2f m = atX(a, b, left);
+			keep(a, m);
+			keep(m, sf::Vector2f(left, b.y));
+		}
+		else {
+			keep(a, b);
+		}
 	}
 
-	void translate(float dx, float dy) override {
-		center.x += dx;
-		center.y += dy;
-	}
+	// Sweeps the shape a band at a time into blocks and runs
+	void fill(FillRule rule, sf::Color color, PixelBuffer& pixels) {
+		if (edges.empty()) return;
+
+		// A row spans the kept edges' columns, with a cell of margin each
+		// side for rounding and one more for the rest of the last cover
+		origin = floorInt(minX) - 1;
+		stride = static_cast<size_t>(floorInt(maxX) - origin) + 3;
+		words = (stride + 63) / 64;
+		const int firstRow = floorInt(minY), lastRow = -floorInt(-maxY);
+		const int fit = static_cast<int>(AA_BAND_CELLS / stride) / AA_BLOCK_ROWS * AA_BLOCK_ROWS;
+		const int bandRows = std::max(AA_BLOCK_ROWS, std::min(lastRow - firstRow, fit));
+
+		// Sweeping leaves both buffers zeroed, so they only ever grow
+		if (accumulation.size() < stride * bandRows) accumulation.resize(stride * bandRows, 0.0f);
+		if (marks.size() < words * bandRows) marks.resize(words * bandRows, 0);
+		if (merged.size() < words) merged.resize(words);
+
+		// Most shapes fit one band, which needs no edge order
+		if (bandRows >= lastRow - firstRow) {
+			for (const Edge& e : edges) walk(e, firstRow, lastRow);
+			sweepBand(firstRow, lastRow, rule, color, pixels);
+			return;
+		}
 
-	void rotate(float angleDegrees) override {
-		// For axis-aligned ellipse, rotation would require storing angle
-		// Advanced: could store rotation angle and apply during drawing
+		std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.from.y < b.from.y; });
+		size_t next = 0;
+		active.clear();
+		for (int bandTop = firstRow; bandTop < lastRow; bandTop += bandRows) {
+			const int bandBottom = std::min(lastRow, bandTop + bandRows);
+			for (; next < edges.size() && edges[next].from.y < bandBottom; next++) active.push_back(edges[next]);
+			for (const Edge& e : active) walk(e, bandTop, bandBottom);
+			active.erase(std::remove_if(active.begin(), active.end(),
+				[&](const Edge& e) { return e.to.y <= bandBottom; }), active.end());
+			sweepBand(bandTop, bandBottom, rule, color, pixels);
+		}
 	}
 
-	void scale(float factor) override {
-		rx *= factor;
-		ry *= factor;
-		if (rx < 1.0f) rx = 1.0f;
-		if (ry < 1.0f) ry = 1.0f;
+private:
+	// Kept top to bottom; 'sign' is -1 for an edge that went up
+	struct Edge {
+		sf::Vector2f from, to;
+		float sign, dxdy, perX;
+	};
+
+	std::vector<Edge> edges;
+	std::vector<Edge> active;               // edges reaching into the current band
+	std::vector<float> accumulation;        // band rows of 'stride' cells
+	std::vector<std::uint64_t> marks;       // band rows of 'words' bitmap words
+	std::vector<std::uint64_t> merged;      // the marks of the rows being swept together
+	std::vector<sf::Vector2f> contour;
+	float left, top, right, bottom;
+	float minX, maxX, minY, maxY;           // extent of the kept edges
+	int origin;                             // column of a row's first cell
+	size_t stride, words;
+
+	void keep(sf::Vector2f a, sf::Vector2f b) {
+		float sign = 1;
+		if (a.y > b.y) {
+			std::swap(a, b);
+			sign = -1;
+		}
+		if (a.y == b.y) return;
+		float dx = std::fabs(b.x - a.x);
+		edges.push_back(Edge{ a, b, sign, (b.x - a.x) / (b.y - a.y), (dx > 0) ? sign * (b.y - a.y) / dx : 0 });
+		minX = std::min(minX, std::min(a.x, b.x));
+		maxX = std::max(maxX, std::max(a.x, b.x));
+		minY = std::min(minY, a.y);
+		maxY = std::max(maxY, b.y);
 	}
 
-	sf::Vector2f getCenter() override {
-		return center;
+	static sf::Vector2f atY(sf::Vector2f a, sf::Vector2f b, float y) {
+		return sf::Vector2f(a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y), y);
 	}
 
-	std::string getInfo() override {
-		std::stringstream ss;
-		float area = PI * rx * ry;
-		ss << "Ellipse | Rx: " << std::fixed << std::setprecision(1) << rx
-			<< " | Ry: " << ry << " | Area: " << area;
-		return ss.str();
+	// std::floor is a library call on plain x86-64, and this runs per cell
+	static int floorInt(float v) {
+		int i = static_cast<int>(v);
+		return (v < i) ? i - 1 : i;
 	}
 
-private:
-	void plot4Points(std::vector<sf::RectangleShape>& pixels, float x, float y) {
-		std::vector<sf::Vector2f> points = {
-			{center.x + x, center.y + y}, {center.x - x, center.y + y},
-			{center.x + x, center.y - y}, {center.x - x, center.y - y}
-		};
+	static sf::Vector2f atX(sf::Vector2f a, sf::Vector2f b, float x) {
+		return sf::Vector2f(x, a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x));
+	}
 
-		for (auto& p : points) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(p);
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
+	// Even-odd folds the winding into [0, 2) and back down from 1; both
+	// rules go without branches, as this runs per swept cell
+	static float coverageOf(float sum, FillRule rule) {
+		float c = std::fabs(sum);
+		if (rule == FillRule::EVEN_ODD) {
+			c -= 2.0f * floorInt(0.5f * c);
+			return std::min(c, 2.0f - c);
 		}
+		return std::min(c, 1.0f);
 	}
-};
 
-// ============================================================================
-// POLYGON CLASS (SCAN-LINE FILL ALGORITHM)
-// ============================================================================
-class Polygon : public Shape {
-public:
-	std::vector<sf::Vector2f> vertices;
-	bool filled;
+	static unsigned int alphaOf(float coverage, FillRule rule, unsigned int alpha) {
+		return static_cast<unsigned int>(coverageOf(coverage, rule) * alpha + 0.5f);
+	}
 
-	Polygon(std::vector<sf::Vector2f> verts, sf::Color col, bool fill = false)
-		: vertices(verts), filled(fill) {
-		color = col;
+	// Splits the edge at every row of the band, then each row's piece at
+	// every column
+	void walk(const Edge& e, int bandTop, int bandBottom) {
+		int first = std::max(floorInt(e.from.y), bandTop);
+		int last = std::min(-floorInt(-e.to.y), bandBottom);
+		float y0 = std::max(e.from.y, static_cast<float>(first));
+		float x0 = e.from.x + (y0 - e.from.y) * e.dxdy;
+		for (int y = first; y < last; y++) {
+			float y1 = std::min(e.to.y, static_cast<float>(y + 1));
+			float x1 = e.from.x + (y1 - e.from.y) * e.dxdy;
+			rowPiece(static_cast<size_t>(y - bandTop), x0, x1, e.sign * (y1 - y0), e.perX);
+			x0 = x1;
+			y0 = y1;
+		}
 	}
 
-	void draw(std::vector<sf::RectangleShape>& pixels) override {
-		if (vertices.size() < 2) return;
+	// 'perX' is the cover per unit of x, which a straight piece keeps
+	// constant, so the piece is shared out by horizontal length
+	void rowPiece(size_t row, float xa, float xb, float cover, float perX) {
+		if (xa > xb) std::swap(xa, xb);
+		int column = floorInt(xa);
+		size_t i = static_cast<size_t>(column - origin);
+		float* cells = &accumulation[row * stride];
+		std::uint64_t* bits = &marks[row * words];
+		if (xb <= column + 1) {
+			float area = cover * (column + 1 - 0.5f * (xa + xb));
+			cells[i] += area;
+			cells[i + 1] += cover - area;
+			bits[i >> 6] |= std::uint64_t(1) << (i & 63);
+			bits[(i + 1) >> 6] |= std::uint64_t(1) << ((i + 1) & 63);
+			return;
+		}
 
-		// Draw edges using Bresenham
-		for (size_t i = 0; i < vertices.size(); i++) {
-			sf::Vector2f p1 = vertices[i];
-			sf::Vector2f p2 = vertices[(i + 1) % vertices.size()];
-			drawBresenhamLine(pixels, p1, p2);
+		size_t first = i;
+		for (float x = xa; x < xb; column++, i++) {
+			float next = std::min(xb, static_cast<float>(column + 1));
+			float c = (next - x) * perX;
+			float area = c * (column + 1 - 0.5f * (x + next));
+			cells[i] += area;
+			cells[i + 1] += c - area;
+			x = next;
 		}
 
-		// Fill if needed (scan-line algorithm)
-		if (filled && vertices.size() >= 3) {
-			scanLineFill(pixels);
+		// Cells [first, i] now hold something to sum
+		size_t w = first >> 6, last = i >> 6;
+		std::uint64_t head = ~std::uint64_t(0) << (first & 63);
+		std::uint64_t tail = ~std::uint64_t(0) >> (63 - (i & 63));
+		if (w == last) {
+			bits[w] |= head & tail;
+			return;
 		}
+		bits[w] |= head;
+		while (++w < last) bits[w] = ~std::uint64_t(0);
+		bits[last] |= tail;
 	}
 
-	bool containsPoint(sf::Vector2f point) override {
-		// Check if point is on any edge
-		for (size_t i = 0; i < vertices.size(); i++) {
-			sf::Vector2f p1 = vertices[i];
-			sf::Vector2f p2 = vertices[(i + 1) % vertices.size()];
-			if (distanceToSegment(point, p1, p2) < SELECTION_THRESHOLD) {
-				return true;
-			}
-		}
-		return false;
+	// Index of the lowest set bit, by de Bruijn multiplication since the
+	// bit-scan intrinsics differ between compilers
+	static int lowestBit(std::uint64_t word) {
+		static const int positions[64] = {
+			0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+			62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+			63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+			46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6 };
+		return positions[((word & (~word + 1)) * 0x03f79d71b4cb0a89ULL) >> 58];
 	}
 
-	void translate(float dx, float dy) override {
-		for (auto& v : vertices) {
-			v.x += dx;
-			v.y += dy;
+	// First cell at or after 'from' whose merged mark is 'set', else the
+	// end of the last word
+	size_t findMark(size_t from, bool set) const {
+		size_t w = from >> 6;
+		if (w >= words) return words * 64;
+		std::uint64_t flip = set ? 0 : ~std::uint64_t(0);
+		std::uint64_t word = (merged[w] ^ flip) & (~std::uint64_t(0) << (from & 63));
+		while (!word) {
+			if (++w == words) return words * 64;
+			word = merged[w] ^ flip;
 		}
+		return w * 64 + lowestBit(word);
 	}
 
-	void rotate(float angleDegrees) override {
-		sf::Vector2f center = getCenter();
-		float angleRad = angleDegrees * PI / 180.0f;
-
-		for (auto& v : vertices) {
-			float dx = v.x - center.x;
-			float dy = v.y - center.y;
-			float xNew = dx * cos(angleRad) - dy * sin(angleRad);
-			float yNew = dx * sin(angleRad) + dy * cos(angleRad);
-			v.x = center.x + xNew;
-			v.y = center.y + yNew;
+	void sweepBand(int bandTop, int bandBottom, FillRule rule, sf::Color color, PixelBuffer& pixels) {
+		for (int y = bandTop; y < bandBottom; y += AA_BLOCK_ROWS) {
+			sweep(y, static_cast<size_t>(y - bandTop), std::min(AA_BLOCK_ROWS, bandBottom - y), rule, color, pixels);
 		}
 	}
 
-	void scale(float factor) override {
-		sf::Vector2f center = getCenter();
-		for (auto& v : vertices) {
-			v = center + (v - center) * factor;
+	// Runs the sums of 'rows' rows from 'row' over their marked cells,
+	// clearing them as it goes. Cells right of the clip only ever follow
+	// the visible ones, so they are cleared without being shown.
+	void sweep(int y, size_t row, int rows, FillRule rule, sf::Color color, PixelBuffer& pixels) {
+		for (size_t w = 0; w < words; w++) {
+			std::uint64_t word = 0;
+			for (int r = 0; r < rows; r++) {
+				std::uint64_t& bits = marks[(row + r) * words + w];
+				word |= bits;
+				bits = 0;
+			}
+			merged[w] = word;
 		}
+
+		const int clipLeft = static_cast<int>(left), clipRight = static_cast<int>(right);
+		float sums[AA_BLOCK_ROWS] = {};
+		int after = clipLeft;   // first pixel the sums have not reached yet
+		for (size_t start = findMark(0, true); start < words * 64; start = findMark(start, true)) {
+			size_t end = findMark(start, false);
+			int x0 = origin + static_cast<int>(start), x1 = origin + static_cast<int>(end);
+			if (x0 > after && after < clipRight) gap(after, std::min(x0, clipRight), y, rows, sums, rule, color, pixels);
+
+			int shownLeft = std::max(x0, clipLeft), shownRight = std::min(x1, clipRight);
+			sumCells(row, rows, x0, shownLeft, sums, nullptr, rule);
+			for (int bx = shownLeft; bx < shownRight; bx += AA_ATLAS_WIDTH) {
+				int bw = std::min(AA_ATLAS_WIDTH, shownRight - bx);
+				sumCells(row, rows, bx, bx + bw, sums, pixels.block(bx, y, bw, rows, color), rule);
+			}
+			sumCells(row, rows, std::max(shownLeft, shownRight), x1, sums, nullptr, rule);
+			after = std::max(after, x1);
+			start = end;
+		}
+		if (after < clipRight) gap(after, clipRight, y, rows, sums, rule, color, pixels);
 	}
 
-	sf::Vector2f getCenter() override {
-		sf::Vector2f sum(0, 0);
-		for (auto& v : vertices) {
-			sum += v;
+	// Adds columns [x0, x1) of each row into its sum, zeroing the cells,
+	// and writes each sum's coverage to 'out' if given
+	void sumCells(size_t row, int rows, int x0, int x1, float* sums, sf::Uint8* out, FillRule rule) {
+		if (x0 >= x1) return;
+		const int count = x1 - x0;
+		for (int r = 0; r < rows; r++) {
+			float* cells = &accumulation[(row + r) * stride + (x0 - origin)];
+			float sum = sums[r];
+			if (!out) {
+				for (int i = 0; i < count; i++) {
+					sum += cells[i];
+					cells[i] = 0;
+				}
+			}
+			else if (rule == FillRule::EVEN_ODD) {
+				for (int i = 0; i < count; i++) {
+					sum += cells[i];
+					cells[i] = 0;
+					out[i] = static_cast<sf::Uint8>(coverageOf(sum, FillRule::EVEN_ODD) * 255 + 0.5f);
+				}
+				out += AA_ATLAS_WIDTH;
+			}
+			else {
+				for (int i = 0; i < count; i++) {
+					sum += cells[i];
+					cells[i] = 0;
+					out[i] = static_cast<sf::Uint8>(coverageOf(sum, FillRule::NON_ZERO) * 255 + 0.5f);
+				}
+				out += AA_ATLAS_WIDTH;
+			}
+			sums[r] = sum;
 		}
-		return sum / static_cast<float>(vertices.size());
 	}
 
-	std::string getInfo() override {
-		std::stringstream ss;
-		ss << "Polygon | Vertices: " << vertices.size()
-			<< " | " << (filled ? "Filled" : "Outline");
-		return ss.str();
+	// Solid runs over columns [x0, x1) of the rows, one per stretch of rows
+	// whose sums give the same alpha
+	static void gap(int x0, int x1, int y, int rows, const float* sums, FillRule rule, sf::Color color,
+		PixelBuffer& pixels) {
+		for (int r = 0; r < rows;) {
+			unsigned int alpha = alphaOf(sums[r], rule, color.a);
+			int next = r + 1;
+			while (next < rows && alphaOf(sums[next], rule, color.a) == alpha) next++;
+			if (alpha > 0) {
+				pixels.rect(static_cast<float>(x0), static_cast<float>(y + r), static_cast<float>(x1 - x0),
+					static_cast<float>(next - r), sf::Color(color.r, color.g, color.b, static_cast<sf::Uint8>(alpha)));
+			}
+			r = next;
+		}
+	}
+};
+
+// ============================================================================
+// STROKE STYLES (SPAN STROKER)
+// ============================================================================
+enum class LineJoin : std::uint8_t { MITER, ROUND, BEVEL };
+enum class LineCap : std::uint8_t { BUTT, ROUND, SQUARE };
+
+const float MITER_LIMIT = 4.0f;   // longer miters fall back to bevels, as in SVG
+
+// Width and dash lengths are in world units, so strokes scale with the
+// shape and the zoom. Width 0 without dashes keeps the one-plot hairline
+// algorithms (DDA, Bresenham, midpoint).
+struct StrokeStyle {
+	static const int MAX_DASHES = 4;
+
+	float width;
+	LineJoin join;
+	LineCap cap;
+	std::uint8_t dashCount;
+	float dashes[MAX_DASHES];   // alternating on/off lengths
+
+	StrokeStyle() : width(0), join(LineJoin::MITER), cap(LineCap::BUTT), dashCount(0), dashes() {}
+
+	bool isHairline() const {
+		return width <= 0 && dashCount == 0;
+	}
+
+	// How far past the path the stroke can reach, per unit of scale
+	float reach() const {
+		if (isHairline()) return 0;
+		float factor = (join == LineJoin::MITER) ? MITER_LIMIT : 1.5f;
+		return 0.5f * std::max(width, 1.0f) * factor;
+	}
+};
+
+// Turns a screen-space path into filled spans. The path is cut into
+// dashes and each dash becomes one outline contour: the left offset going
+// forward, the right offset coming back, with joins and caps in between.
+// Every contour goes into the same edge table, so the whole stroke is one
+// non-zero pass of the active-edge-table filler, about what filling the
+// outline polygon costs. Inner corners that are too tight to meet cleanly
+// detour through the vertex itself, which keeps the winding number equal
+// to how many segment quads cover a pixel, so folds never punch holes.
+class Stroker {
+public:
+	// Per-thread scratch, so rasterization workers never share one
+	static Stroker& local() {
+		thread_local Stroker stroker;
+		return stroker;
+	}
+
+	// Scratch for callers assembling a path to stroke
+	std::vector<sf::Vector2f> path;
+
+	// 'pixelScale' maps world units to pixels for width and dashes. Only
+	// pixels inside 'clip' are drawn; with 'antialias' the outline goes to
+	// the coverage accumulator instead of the span filler.
+	void stroke(PixelBuffer& pixels, const std::vector<sf::Vector2f>& points, bool closed,
+		const StrokeStyle& style, float pixelScale, sf::Color color,
+		const sf::FloatRect& clip, bool antialias) {
+		if (points.empty()) return;
+		half = 0.5f * std::max(1.0f, style.width * pixelScale);
+		join = style.join;
+		cap = style.cap;
+		coverage = nullptr;
+		if (antialias) {
+			coverage = &AreaCoverage::local();
+			coverage->reset(clip);
+		}
+		filler.reset(clip);
+
+		if (!dashPath(points, closed, style, pixelScale)) {
+			strokePiece(points, closed);
+		}
+
+		if (coverage) {
+			coverage->fill(FillRule::NON_ZERO, color, pixels);
+			return;
+		}
+		spans.clear();
+		filler.fill(FillRule::NON_ZERO, spans);
+		for (auto& s : spans) {
+			pixels.span(s.y, s.x0, s.x1, color);
+		}
+	}
+
+	// Segments for a polygonal circle of the given pixel radius whose
+	// chords stay within a quarter pixel of the arc
+	static int arcSegments(float radius) {
+		int n = static_cast<int>(std::ceil(PI * std::sqrt(2.0f * std::max(radius, 0.5f))));
+		return std::max(8, std::min(n, 2048));
+	}
+
+private:
+	ScanlineFiller filler;
+	std::vector<Span> spans;
+	std::vector<sf::Vector2f> piece;
+	std::vector<sf::Vector2f> clean;
+	std::vector<sf::Vector2f> left, right;   // offset sides, both in path order
+	float half;
+	LineJoin join;
+	LineCap cap;
+	AreaCoverage* coverage;   // set while stroking anti-aliased
+
+	// Splits the path into its dashes and strokes each one. Returns false
+	// when there is no usable pattern, or when the dashes would be too
+	// small or too many to tell apart, so the path is drawn solid.
+	bool dashPath(const std::vector<sf::Vector2f>& points, bool closed,
+		const StrokeStyle& style, float pixelScale) {
+		int count = std::min<int>(style.dashCount, StrokeStyle::MAX_DASHES);
+		if (count < 2) return false;
+
+		float pattern[StrokeStyle::MAX_DASHES];
+		float period = 0;
+		for (int i = 0; i < count; i++) {
+			pattern[i] = std::max(0.0f, style.dashes[i] * pixelScale);
+			period += pattern[i];
+		}
+		if (period < 2.0f) return false;
+
+		size_t segmentCount = closed ? points.size() : points.size() - 1;
+		float length = 0;
+		for (size_t i = 0; i < segmentCount; i++) {
+			length += distance(points[i], points[(i + 1) % points.size()]);
+		}
+		if (length / period > 100000.0f) return false;
+
+		int index = 0;
+		bool on = true;
+		float remaining = pattern[0];
+		piece.assign(1, points[0]);
+
+		for (size_t i = 0; i < segmentCount; i++) {
+			sf::Vector2f a = points[i];
+			sf::Vector2f b = points[(i + 1) % points.size()];
+			float segment = distance(a, b);
+			float travelled = 0;
+
+			while (segment - travelled > remaining) {
+				travelled += remaining;
+				sf::Vector2f cut = a + (b - a) * (travelled / segment);
+				if (on) {
+					piece.push_back(cut);
+					strokePiece(piece, false);
+				}
+				piece.assign(1, cut);
+				on = !on;
+				index = (index + 1) % count;
+				remaining = pattern[index];
+			}
+			remaining -= segment - travelled;
+			if (on) piece.push_back(b);
+		}
+		if (on) strokePiece(piece, false);
+		return true;
+	}
+
+	void strokePiece(const std::vector<sf::Vector2f>& points, bool closed) {
+		// Repeated points have no direction
+		clean.clear();
+		for (auto& p : points) {
+			if (clean.empty() || distance(clean.back(), p) > 1e-3f) clean.push_back(p);
+		}
+		if (closed && clean.size() > 2 && distance(clean.front(), clean.back()) <= 1e-3f) clean.pop_back();
+
+		if (clean.size() == 1) {
+			// A zero-length dash still shows its caps
+			if (cap == LineCap::ROUND) addDot(clean[0], arcSegments(half));
+			else if (cap == LineCap::SQUARE) addDot(clean[0], 4);
+			return;
+		}
+		if (clean.size() < 3) closed = false;
+
+		size_t n = clean.size();
+		left.clear();
+		right.clear();
+
+		if (!closed) {
+			sf::Vector2f normal = leftNormal(clean[0], clean[1]) * half;
+			left.push_back(clean[0] + normal);
+			right.push_back(clean[0] - normal);
+		}
+		for (size_t i = closed ? 0 : 1; i < (closed ? n : n - 1); i++) {
+			addVertex(clean[(i + n - 1) % n], clean[i], clean[(i + 1) % n]);
+		}
+
+		if (closed) {
+			// A ring: the outer and inner boundaries wind opposite ways
+			addContour(left, false);
+			addContour(right, true);
+			return;
+		}
+
+		sf::Vector2f normal = leftNormal(clean[n - 2], clean[n - 1]) * half;
+		left.push_back(clean[n - 1] + normal);
+		right.push_back(clean[n - 1] - normal);
+
+		addCap(left, clean[n - 1], unit(clean[n - 1] - clean[n - 2]));
+		left.insert(left.end(), right.rbegin(), right.rend());
+		addCap(left, clean[0], unit(clean[0] - clean[1]));
+		addContour(left, false);
+	}
+
+	// Offsets for one corner, appended to both sides in path order
+	void addVertex(sf::Vector2f previous, sf::Vector2f vertex, sf::Vector2f next) {
+		sf::Vector2f d0 = unit(vertex - previous);
+		sf::Vector2f d1 = unit(next - vertex);
+		sf::Vector2f n0(-d0.y, d0.x);
+		sf::Vector2f n1(-d1.y, d1.x);
+		float cross = d0.x * d1.y - d0.y * d1.x;
+
+		if (std::abs(cross) < 1e-4f && d0.x * d1.x + d0.y * d1.y > 0) {
+			left.push_back(vertex + n0 * half);
+			right.push_back(vertex - n0 * half);
+			return;
+		}
+
+		// The side the path turns away from gets the join
+		float side = (cross > 0) ? -1.0f : 1.0f;
+		std::vector<sf::Vector2f>& outer = (cross > 0) ? right : left;
+		std::vector<sf::Vector2f>& inner = (cross > 0) ? left : right;
+		sf::Vector2f o0 = n0 * side;
+		sf::Vector2f o1 = n1 * side;
+
+		// |n0 + n1| is twice the cosine of half the turn
+		sf::Vector2f bisector = o0 + o1;
+		float cosHalf = 0.5f * std::sqrt(bisector.x * bisector.x + bisector.y * bisector.y);
+		sf::Vector2f miter = (cosHalf > 1e-4f) ? bisector * (half / (2 * cosHalf * cosHalf)) : sf::Vector2f(0, 0);
+
+		// The inner offsets meet short of the vertex unless the corner is
+		// sharp for segments this short; then go through the vertex
+		float shortest = std::min(distance(previous, vertex), distance(vertex, next));
+		float overlap = (cosHalf > 1e-4f) ? half * std::sqrt(std::max(0.0f, 1 - cosHalf * cosHalf)) / cosHalf : shortest;
+		if (2 * overlap <= shortest) {
+			inner.push_back(vertex - miter);
+		}
+		else {
+			inner.push_back(vertex - o0 * half);
+			inner.push_back(vertex);
+			inner.push_back(vertex - o1 * half);
+		}
+
+		// Gentle bends, as on flattened curves, meet at the miter point
+		// whatever the join, within a percent of the width
+		if (cosHalf > 0.99f || (join == LineJoin::MITER && cosHalf * MITER_LIMIT >= 1)) {
+			outer.push_back(vertex + miter);
+		}
+		else if (join == LineJoin::ROUND) {
+			float a0 = std::atan2(o0.y, o0.x);
+			float sweep = std::remainder(std::atan2(o1.y, o1.x) - a0, 2 * PI);
+			addArc(outer, vertex, a0, sweep);
+		}
+		else {
+			outer.push_back(vertex + o0 * half);
+			outer.push_back(vertex + o1 * half);
+		}
+	}
+
+	// Cap points between the two sides at an end; 'outward' points away
+	// from the path, and the contour turns from the left side to the right
+	void addCap(std::vector<sf::Vector2f>& contour, sf::Vector2f end, sf::Vector2f outward) {
+		sf::Vector2f normal(-outward.y, outward.x);
+		if (cap == LineCap::SQUARE) {
+			contour.push_back(end + (normal + outward) * half);
+			contour.push_back(end + (outward - normal) * half);
+		}
+		else if (cap == LineCap::ROUND) {
+			float a0 = std::atan2(normal.y, normal.x);
+			size_t first = contour.size();
+			addArc(contour, end, a0, -PI);
+			// The ends of the arc are already on the sides
+			contour.pop_back();
+			contour.erase(contour.begin() + first);
+		}
+	}
+
+	// Points from angle a0 through a0 + sweep, both ends included
+	void addArc(std::vector<sf::Vector2f>& out, sf::Vector2f centre, float a0, float sweep) {
+		int steps = std::max(1, static_cast<int>(std::ceil(std::abs(sweep) / (2 * PI) * arcSegments(half))));
+		for (int k = 0; k <= steps; k++) {
+			float a = a0 + sweep * k / steps;
+			out.push_back(centre + sf::Vector2f(std::cos(a), std::sin(a)) * half);
+		}
+	}
+
+	// A disc or square for a dash with no length, wound like the outlines
+	void addDot(sf::Vector2f centre, int corners) {
+		piece.clear();
+		float start = (corners == 4) ? PI / 4 : 0;
+		float radius = (corners == 4) ? half * std::sqrt(2.0f) : half;
+		for (int k = 0; k < corners; k++) {
+			float a = start - 2 * PI * k / corners;
+			piece.push_back(centre + sf::Vector2f(std::cos(a), std::sin(a)) * radius);
+		}
+		addContour(piece, false);
+	}
+
+	void addContour(const std::vector<sf::Vector2f>& points, bool reversed) {
+		for (size_t i = 0; i < points.size(); i++) {
+			const sf::Vector2f& a = points[i];
+			const sf::Vector2f& b = points[(i + 1) % points.size()];
+			if (coverage) coverage->addEdge(reversed ? b : a, reversed ? a : b);
+			else if (reversed) filler.addEdge(b, a);
+			else filler.addEdge(a, b);
+		}
+	}
+
+	static float distance(sf::Vector2f a, sf::Vector2f b) {
+		float dx = b.x - a.x, dy = b.y - a.y;
+		return std::sqrt(dx * dx + dy * dy);
+	}
+
+	static sf::Vector2f unit(sf::Vector2f v) {
+		float length = std::sqrt(v.x * v.x + v.y * v.y);
+		return (length > 0) ? v / length : sf::Vector2f(1, 0);
+	}
+
+	static sf::Vector2f leftNormal(sf::Vector2f a, sf::Vector2f b) {
+		sf::Vector2f d = unit(b - a);
+		return sf::Vector2f(-d.y, d.x);
+	}
+};
+
+std::string describeStroke(const StrokeStyle& style) {
+	static const char* joins[] = { "miter", "round", "bevel" };
+	static const char* caps[] = { "butt", "round", "square" };
+	std::stringstream ss;
+	if (style.width <= 0) ss << "Hairline";
+	else ss << "Stroke " << style.width;
+	if (style.dashCount > 0) ss << " dashed";
+	if (!style.isHairline()) {
+		ss << " " << joins[static_cast<int>(style.join)] << "/" << caps[static_cast<int>(style.cap)];
+	}
+	return ss.str();
+}
+
+// ============================================================================
+// BASE SHAPE CLASS (POLYMORPHIC DESIGN)
+// ============================================================================
+enum class ShapeKind : unsigned char { LINE, CIRCLE, ELLIPSE, POLYGON, BEZIER, INSTANCE, FILL, SPLINE };
+const int SHAPE_KINDS = 8;
+
+// Each shape keeps its local geometry untouched and only edits the retained
+// transform, so a key press costs O(1) and repeated rotations do not drift.
+class Shape {
+public:
+	sf::Color color;
+	bool isSelected;
+	Transform2D transform;
+	StrokeStyle stroke;
+
+	Shape() : color(sf::Color::White), isSelected(false), pivot(0, 0), worldDirty(true) {}
+	virtual ~Shape() = default;
+
+	virtual void draw(PixelBuffer& pixels, const RasterView& view) = 0;
+	virtual bool containsPoint(sf::Vector2f point) = 0;
+	virtual sf::FloatRect getBounds() = 0;   // world-space, axis-aligned
+	virtual std::string getInfo() = 0;
+
+	virtual void translate(float dx, float dy) {
+		transform.tx += dx;
+		transform.ty += dy;
+		worldDirty = true;
+	}
+
+	virtual void rotate(float angleDegrees) {
+		float angleRad = angleDegrees * PI / 180.0f;
+		transform.rotation = std::remainder(transform.rotation + angleRad, 2 * PI);
+		worldDirty = true;
+	}
+
+	virtual void scale(float factor) {
+		transform.sx *= factor;
+		transform.sy *= factor;
+		worldDirty = true;
+	}
+
+	virtual sf::Vector2f getCenter() {
+		return sf::Vector2f(pivot.x + transform.tx, pivot.y + transform.ty);
+	}
+
+	Matrix3x3 worldMatrix() const {
+		return transform.toMatrix(pivot);
+	}
+
+	// Replaces the whole transform, as undo does
+	void setTransform(const Transform2D& t) {
+		transform = t;
+		worldDirty = true;
+	}
+
+	// World-space margin the stroke adds around the path
+	float strokeReach() const {
+		return stroke.reach() * std::max(transform.sx, transform.sy);
+	}
+
+protected:
+	sf::Vector2f pivot;   // local-space point the shape rotates and scales about
+	bool worldDirty;      // cached world-space geometry needs rebuilding
+
+	void strokePath(PixelBuffer& pixels, const std::vector<sf::Vector2f>& screenPath,
+		bool closed, const RasterView& view) {
+		Stroker::local().stroke(pixels, screenPath, closed, stroke, view.zoom * transform.sx, color,
+			view.antialias ? view.screen : view.plotClip(), view.antialias);
+	}
+};
+
+// ============================================================================
+// LINE CLASS
+// ============================================================================
+class Line final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::LINE;
+
+	sf::Vector2f p1, p2;
+	enum Algorithm { DDA, BRESENHAM } algorithm;
+
+	Line(sf::Vector2f start, sf::Vector2f end, Algorithm algo, sf::Color col)
+		: p1(start), p2(end), algorithm(algo) {
+		color = col;
+		pivot = (p1 + p2) / 2.0f;
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		updateWorld();
+		sf::Vector2f a = view.toScreen(w1);
+		sf::Vector2f b = view.toScreen(w2);
+		if (!stroke.isHairline()) {
+			std::vector<sf::Vector2f>& path = Stroker::local().path;
+			path.assign({ a, b });
+			strokePath(pixels, path, false, view);
+		}
+		else if (algorithm == DDA) {
+			drawDDA(pixels, a, b, view.plotClip());
+		}
+		else {
+			plotBresenham(pixels, a, b, view.plotClip(), color);
+		}
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		updateWorld();
+		return distanceToSegment(point) < SELECTION_THRESHOLD;
+	}
+
+	sf::FloatRect getBounds() override {
+		updateWorld();
+		return boundsOf(w1, w2);
+	}
+
+	// Points the cursor can snap to, in world space
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		updateWorld();
+		out.push_back(w1);
+		out.push_back(w2);
+	}
+
+	std::string getInfo() override {
+		updateWorld();
+		std::stringstream ss;
+		float length = sqrt(pow(w2.x - w1.x, 2) + pow(w2.y - w1.y, 2));
+		ss << "Line (" << (algorithm == DDA ? "DDA" : "Bresenham") << ") | "
+			<< "Length: " << std::fixed << std::setprecision(1) << length;
+		return ss.str();
+	}
+
+private:
+	sf::Vector2f w1, w2;   // world-space endpoints
+
+	void updateWorld() {
+		if (!worldDirty) return;
+		Matrix3x3 mat = worldMatrix();
+		w1 = mat.transform(p1);
+		w2 = mat.transform(p2);
+		worldDirty = false;
+	}
+
+	// Steps only where the line can land in clip, with one step of slack
+	void drawDDA(PixelBuffer& pixels, sf::Vector2f a, sf::Vector2f b, const sf::FloatRect& clip) {
+		float dx = b.x - a.x;
+		float dy = b.y - a.y;
+		float steps = std::max(std::abs(dx), std::abs(dy));
+
+		if (steps == 0) return;
+
+		float t0, t1;
+		if (!clipSegment(a, b, clip, t0, t1)) return;
+		int first = std::max(0, static_cast<int>(std::floor(t0 * steps)) - 1);
+		float last = std::min(steps, std::ceil(t1 * steps) + 1);
+
+		float xInc = dx / steps;
+		float yInc = dy / steps;
+		float x = a.x + first * xInc;
+		float y = a.y + first * yInc;
+
+		for (int i = first; i <= last; i++) {
+			pixels.plot(std::round(x), std::round(y), color);
+			x += xInc;
+			y += yInc;
+		}
+	}
+
+	float distanceToSegment(sf::Vector2f p) {
+		float dx = w2.x - w1.x;
+		float dy = w2.y - w1.y;
+		float lengthSquared = dx * dx + dy * dy;
+
+		if (lengthSquared == 0) {
+			dx = p.x - w1.x;
+			dy = p.y - w1.y;
+			return sqrt(dx * dx + dy * dy);
+		}
+
+		float t = ((p.x - w1.x) * dx + (p.y - w1.y) * dy) / lengthSquared;
+		t = std::max(0.0f, std::min(1.0f, t));
+
+		float projX = w1.x + t * dx;
+		float projY = w1.y + t * dy;
+
+		dx = p.x - projX;
+		dy = p.y - projY;
+		return sqrt(dx * dx + dy * dy);
+	}
+};
+
+// ============================================================================
+// CIRCLE CLASS (MIDPOINT CIRCLE ALGORITHM)
+// ============================================================================
+class Circle final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::CIRCLE;
+
+	sf::Vector2f center;
+	float radius;
+
+	Circle(sf::Vector2f c, float r, sf::Color col)
+		: center(c), radius(r) {
+		color = col;
+		if (radius < 1.0f) radius = 1.0f;
+		pivot = center;
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		sf::Vector2f c = view.toScreen(getCenter());
+		float r = worldRadius() * view.zoom;
+
+		// A circle only a few pixels across is just a dot on screen
+		if (r < LOD_DOT_SIZE) {
+			pixels.plot(std::round(c.x), std::round(c.y), color);
+			return;
+		}
+
+		if (view.antialias && stroke.isHairline()) {
+			// A ring as wide as the 2x2 plots
+			AreaCoverage& coverage = AreaCoverage::local();
+			coverage.reset(view.screen);
+			coverage.addEllipse(c, r + AA_HAIRLINE / 2, r + AA_HAIRLINE / 2, 0);
+			if (r > AA_HAIRLINE / 2) coverage.addEllipse(c, r - AA_HAIRLINE / 2, r - AA_HAIRLINE / 2, 0, true);
+			coverage.fill(FillRule::NON_ZERO, color, pixels);
+			return;
+		}
+
+		if (!stroke.isHairline()) {
+			std::vector<sf::Vector2f>& path = Stroker::local().path;
+			int n = Stroker::arcSegments(r);
+			path.clear();
+			for (int i = 0; i < n; i++) {
+				float a = 2 * PI * i / n;
+				path.push_back(c + sf::Vector2f(std::cos(a), std::sin(a)) * r);
+			}
+			strokePath(pixels, path, true, view);
+			return;
+		}
+
+		// Partly visible circles only walk the arcs inside the view
+		sf::FloatRect clip = view.plotClip();
+		if (c.x - r < clip.left || c.y - r < clip.top ||
+			c.x + r > clip.left + clip.width || c.y + r > clip.top + clip.height) {
+			drawClipped(pixels, c, static_cast<int>(r), clip);
+			return;
+		}
+
+		// Midpoint Circle Algorithm
+		int x = 0;
+		int y = static_cast<int>(r);
+		int d = 1 - y;
+
+		while (x <= y) {
+			plot8Points(pixels, c, x, y);
+
+			if (d < 0) {
+				d += 2 * x + 3;
+			}
+			else {
+				d += 2 * (x - y) + 5;
+				y--;
+			}
+			x++;
+		}
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		sf::Vector2f c = getCenter();
+		float dx = point.x - c.x;
+		float dy = point.y - c.y;
+		float distance = sqrt(dx * dx + dy * dy);
+		return std::abs(distance - worldRadius()) < SELECTION_THRESHOLD;
+	}
+
+	sf::FloatRect getBounds() override {
+		sf::Vector2f c = getCenter();
+		float r = worldRadius();
+		return sf::FloatRect(c.x - r, c.y - r, 2 * r + 2, 2 * r + 2);
+	}
+
+	void rotate(float angleDegrees) override {
+		// Circle is rotationally symmetric, no visual change
+	}
+
+	void scale(float factor) override {
+		Shape::scale(factor);
+		if (worldRadius() < 1.0f) {
+			transform.sx = transform.sy = 1.0f / radius;
+		}
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		out.push_back(getCenter());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		float r = worldRadius();
+		float area = PI * r * r;
+		float circumference = 2 * PI * r;
+		ss << "Circle | Radius: " << std::fixed << std::setprecision(1) << r
+			<< " | Area: " << area << " | Circum: " << circumference;
+		return ss.str();
+	}
+
+private:
+	float worldRadius() const {
+		return radius * transform.sx;
+	}
+
+	void plot8Points(PixelBuffer& pixels, sf::Vector2f c, int x, int y) {
+		const sf::Vector2f points[8] = {
+			{c.x + x, c.y + y}, {c.x - x, c.y + y},
+			{c.x + x, c.y - y}, {c.x - x, c.y - y},
+			{c.x + y, c.y + x}, {c.x - y, c.y + x},
+			{c.x + y, c.y - x}, {c.x - y, c.y - x}
+		};
+
+		for (auto& p : points) {
+			pixels.plot(p, color);
+		}
+	}
+
+	// The y the midpoint loop holds at step x: the largest Y with
+	// x^2 + Y^2 - Y < r^2, so the loop can start at any x
+	static long long midpointY(long long radius, long long x) {
+		long long limit = radius * radius - x * x;
+		long long y = static_cast<long long>(std::floor(0.5 + std::sqrt(std::max(0.0, limit + 0.25))));
+		while (y > 0 && y * y - y >= limit) y--;
+		while ((y + 1) * y < limit) y++;
+		return y;
+	}
+
+	// Midpoint octants restricted to the steps whose points land in clip.
+	// Octant bits follow plot8Points: 1 mirrors x, 2 mirrors y, 4 swaps them.
+	void drawClipped(PixelBuffer& pixels, sf::Vector2f c, int radius, const sf::FloatRect& clip) {
+		// Visible offsets from the centre along each screen axis
+		float left = clip.left - c.x, right = clip.left + clip.width - c.x;
+		float top = clip.top - c.y, bottom = clip.top + clip.height - c.y;
+		long long rr = static_cast<long long>(radius) * radius;
+
+		for (int octant = 0; octant < 8; octant++) {
+			int sx = (octant & 1) ? -1 : 1;
+			int sy = (octant & 2) ? -1 : 1;
+			bool swap = (octant & 4) != 0;
+			float uLo = sx > 0 ? left : -right, uHi = sx > 0 ? right : -left;
+			float vLo = sy > 0 ? top : -bottom, vHi = sy > 0 ? bottom : -top;
+			float xLo = swap ? vLo : uLo, xHi = swap ? vHi : uHi;
+			float yLo = swap ? uLo : vLo, yHi = swap ? uHi : vHi;
+			if (xHi < 0 || yHi < 0 || xLo > radius || yLo > radius) continue;
+
+			// y falls as x grows, so its window maps to an x window; a
+			// step of slack covers the loop's rounding
+			double first = std::max(0.0f, xLo);
+			double last = std::min(static_cast<float>(radius), xHi);
+			if (yHi < radius) first = std::max(first, std::sqrt(rr - static_cast<double>(yHi) * yHi) - 1);
+			if (yLo > 0) last = std::min(last, std::sqrt(rr - static_cast<double>(yLo) * yLo) + 1);
+			if (first > last) continue;
+
+			long long x = static_cast<long long>(std::ceil(first));
+			long long end = static_cast<long long>(std::floor(last));
+			long long y = midpointY(radius, x);
+			long long d = (x + 1) * (x + 1) + y * y - y - rr;
+			for (; x <= y && x <= end; x++) {
+				float u = static_cast<float>(sx * (swap ? y : x));
+				float v = static_cast<float>(sy * (swap ? x : y));
+				pixels.plot(sf::Vector2f(c.x + u, c.y + v), color);
+
+				if (d < 0) {
+					d += 2 * x + 3;
+				}
+				else {
+					d += 2 * (x - y) + 5;
+					y--;
+				}
+			}
+		}
+	}
+};
+
+// ============================================================================
+// ELLIPSE CLASS (MIDPOINT ELLIPSE ALGORITHM)
+// ============================================================================
+class Ellipse final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::ELLIPSE;
+
+	sf::Vector2f center;
+	float rx, ry;
+	bool filled;
+
+	Ellipse(sf::Vector2f c, float radiusX, float radiusY, sf::Color col, bool fill = false)
+		: center(c), rx(radiusX), ry(radiusY), filled(fill) {
+		color = col;
+		if (rx < 1.0f) rx = 1.0f;
+		if (ry < 1.0f) ry = 1.0f;
+		pivot = center;
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		sf::Vector2f c = view.toScreen(getCenter());
+		float rx = this->rx * transform.sx * view.zoom;
+		float ry = this->ry * transform.sy * view.zoom;
+
+		if (std::max(rx, ry) < LOD_DOT_SIZE) {
+			pixels.plot(std::round(c.x), std::round(c.y), color);
+			return;
+		}
+
+		if (!stroke.isHairline()) {
+			if (filled && view.antialias) drawCoverage(pixels, c, rx, ry, view);
+			else if (filled) drawRows(pixels, c, rx, ry, view.plotClip());
+
+			Matrix3x3 toScreen = view.matrix().multiply(worldMatrix());
+			std::vector<sf::Vector2f>& path = Stroker::local().path;
+			int n = Stroker::arcSegments(std::max(rx, ry));
+			path.clear();
+			for (int i = 0; i < n; i++) {
+				float a = 2 * PI * i / n;
+				path.push_back(toScreen.transform(center + sf::Vector2f(this->rx * std::cos(a), this->ry * std::sin(a))));
+			}
+			strokePath(pixels, path, true, view);
+			return;
+		}
+
+		if (view.antialias) {
+			drawCoverage(pixels, c, rx, ry, view);
+			return;
+		}
+
+		// Every aliased outline goes row by row, so an ellipse looks the same
+		// whether or not the view edge cuts it
+		drawRows(pixels, c, rx, ry, view.plotClip());
+	}
+
+	// Exact: the point is taken into the ellipse's own frame and measured
+	// against the true closest point on the curve
+	bool containsPoint(sf::Vector2f point) override {
+		sf::Vector2f d = point - getCenter();
+		float cs = std::cos(transform.rotation);
+		float sn = std::sin(transform.rotation);
+		float u = d.x * cs + d.y * sn;
+		float v = -d.x * sn + d.y * cs;
+		float a = rx * transform.sx;
+		float b = ry * transform.sy;
+
+		if (filled && (u * u) / (a * a) + (v * v) / (b * b) <= 1.0f) return true;
+		return distanceToEllipse(a, b, u, v) < SELECTION_THRESHOLD;
+	}
+
+	sf::FloatRect getBounds() override {
+		sf::Vector2f c = getCenter();
+		sf::Vector2f half = halfExtent(rx * transform.sx, ry * transform.sy);
+		return sf::FloatRect(c.x - half.x, c.y - half.y, 2 * half.x + 2, 2 * half.y + 2);
+	}
+
+	void scale(float factor) override {
+		Shape::scale(factor);
+		float minScale = 1.0f / std::min(rx, ry);
+		if (transform.sx < minScale) transform.sx = transform.sy = minScale;
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		out.push_back(getCenter());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		float rx = this->rx * transform.sx;
+		float ry = this->ry * transform.sy;
+		float area = PI * rx * ry;
+		ss << "Ellipse | Rx: " << std::fixed << std::setprecision(1) << rx
+			<< " | Ry: " << ry << " | Angle: " << transform.rotation * 180.0f / PI
+			<< " | Area: " << area;
+		if (filled) ss << " | Filled";
+		return ss.str();
+	}
+
+private:
+	// Half-width and half-height of the rotated ellipse's bounding box
+	sf::Vector2f halfExtent(float a, float b) const {
+		float cs = std::cos(transform.rotation);
+		float sn = std::sin(transform.rotation);
+		return sf::Vector2f(std::sqrt(a * a * cs * cs + b * b * sn * sn),
+			std::sqrt(a * a * sn * sn + b * b * cs * cs));
+	}
+
+	// One side of a conic P u^2 + 2H u t + R t^2 = 1 in offsets from the
+	// centre, walked down the rows. Its column x is the last whose midpoint
+	// with the column inside it, u = x - 0.5 - cx, is still in the conic.
+	// The decision value and its changes one column out and one row down
+	// are fixed-point integers stepped by additions alone, as the second
+	// differences are the constants 2P, 2H and 2R. The left side is the
+	// right side of the mirrored conic.
+	struct ConicEdge {
+		double P, H, R, cx;
+		double t;                     // row offset
+		long long x;
+		long long q;                  // decision value at x's midpoint
+		long long du, dt;             // its change one column right, one row down
+		long long p2, h2, r2;         // and theirs
+		bool walk;                    // false: every row starts from the closed form
+
+		// Rounding the second differences drifts the walk by about
+		// extent^3 / 2^53 pixels, under a hundredth below WALK_EXTENT
+		static constexpr double ONE = 4503599627370496.0;   // 2^52
+		static constexpr float WALK_EXTENT = 32768;
+		static const int MAX_STEPS = 64;
+
+		ConicEdge(double p, double h, double r, double centre, float extent)
+			: P(p), H(h), R(r), cx(centre), p2(std::llround(2 * P * ONE)),
+			h2(std::llround(2 * H * ONE)), r2(std::llround(2 * R * ONE)), walk(extent < WALK_EXTENT) {}
+
+		// Closed form, used to start and when an edge jumps too far
+		void seed(double row) {
+			t = row;
+			double half = std::sqrt(std::max(0.0, P - (P * R - H * H) * t * t)) / P;
+			x = std::llround(cx - H * t / P + half);
+			double u = x - 0.5 - cx;
+			q = std::llround((P * u * u + 2 * H * u * t + R * t * t - 1) * ONE);
+			du = std::llround((P * (2 * u + 1) + 2 * H * t) * ONE);
+			dt = std::llround((2 * H * u + R * (2 * t + 1)) * ONE);
+			settle();
+		}
+
+		void next() {
+			if (!walk) {
+				seed(t + 1);
+				return;
+			}
+			q += dt;
+			dt += r2;
+			du += h2;
+			t += 1;
+			if (!settle()) seed(t);
+		}
+
+		// Steps out while the next midpoint is inside, and otherwise, while
+		// this one is outside, towards where the conic lies. Near the top and
+		// bottom an edge crosses many columns per row; down the sides it
+		// moves at most one, which are the midpoint algorithm's two regions.
+		// A row too thin to hold a midpoint ends nearest its centre.
+		bool settle() {
+			for (int steps = 0; steps < MAX_STEPS; steps++) {
+				if (q + du <= 0 || (q > 0 && du < 0)) {
+					q += du;
+					du += p2;
+					dt += h2;
+					x++;
+				}
+				else if (q > 0 && du > p2) {
+					du -= p2;
+					dt -= h2;
+					q -= du;
+					x--;
+				}
+				else {
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	// Row by row with a ConicEdge on each side. Outlines reach halfway to
+	// the neighbouring rows' edges so steep parts stay connected; filled
+	// ellipses emit the whole chord. Rows and columns outside clip are
+	// never emitted.
+	void drawRows(PixelBuffer& pixels, sf::Vector2f c, float a, float b, const sf::FloatRect& clip) {
+		double cs = std::cos(transform.rotation);
+		double sn = std::sin(transform.rotation);
+		double ia2 = 1.0 / (static_cast<double>(a) * a);
+		double ib2 = 1.0 / (static_cast<double>(b) * b);
+		double P = cs * cs * ia2 + sn * sn * ib2;
+		double H = cs * sn * (ia2 - ib2);
+		double R = sn * sn * ia2 + cs * cs * ib2;
+
+		float extent = halfExtent(a, b).y;
+		int top = static_cast<int>(std::ceil(c.y - extent));
+		int bottom = static_cast<int>(std::floor(c.y + extent));
+		int first = std::max(top, static_cast<int>(std::floor(clip.top)));
+		int last = std::min(bottom, static_cast<int>(std::ceil(clip.top + clip.height)));
+		if (first > last) return;
+
+		long long clipLeft = static_cast<long long>(std::floor(clip.left));
+		long long clipRight = static_cast<long long>(std::ceil(clip.left + clip.width));
+		auto span = [&](int y, long long x0, long long x1) {
+			x0 = std::max(x0, clipLeft);
+			x1 = std::min(x1, clipRight);
+			if (x0 <= x1) pixels.span(y, static_cast<int>(x0), static_cast<int>(x1), color);
+		};
+		auto halfway = [](long long from, long long to) {
+			return static_cast<long long>(std::floor(0.5 * (from + to) + 0.5));
+		};
+
+		float size = std::max(a, b);
+		ConicEdge right(P, H, R, c.x, size), left(P, -H, R, -c.x, size);
+		int y = std::max(top, first - 1);
+		right.seed(y - c.y);
+		left.seed(y - c.y);
+		long long prevL = -left.x, prevR = right.x;
+		if (y < first) {
+			right.next();
+			left.next();
+			y++;
+		}
+		long long curL = -left.x, curR = right.x;
+
+		for (; y <= last; y++) {
+			long long nextL = curL, nextR = curR;
+			if (y < bottom) {
+				right.next();
+				left.next();
+				nextL = -left.x;
+				nextR = right.x;
+			}
+
+			if (filled || y == top || y == bottom) {
+				span(y, curL, curR);
+			}
+			else {
+				long long l1 = halfway(curL, prevL), l2 = halfway(curL, nextL);
+				long long r1 = halfway(curR, prevR), r2 = halfway(curR, nextR);
+				span(y, std::min({ curL, l1, l2 }), std::max({ curL, l1, l2 }));
+				span(y, std::min({ curR, r1, r2 }), std::max({ curR, r1, r2 }));
+			}
+
+			prevL = curL; prevR = curR;
+			curL = nextL; curR = nextR;
+		}
+	}
+
+	// Anti-aliased: the whole ellipse when filled, else a ring as wide as
+	// the 2x2 plots
+	void drawCoverage(PixelBuffer& pixels, sf::Vector2f c, float a, float b, const RasterView& view) {
+		AreaCoverage& coverage = AreaCoverage::local();
+		coverage.reset(view.screen);
+		if (filled) {
+			coverage.addEllipse(c, a, b, transform.rotation);
+		}
+		else {
+			const float half = AA_HAIRLINE / 2;
+			coverage.addEllipse(c, a + half, b + half, transform.rotation);
+			if (std::min(a, b) > half) coverage.addEllipse(c, a - half, b - half, transform.rotation, true);
+		}
+		coverage.fill(FillRule::NON_ZERO, color, pixels);
+	}
+
+	// Distance from (u, v) to the axis-aligned ellipse with semi-axes a, b.
+	// Eberly's method: bisection on the closest point's Lagrange parameter.
+	static float distanceToEllipse(float a, float b, float u, float v) {
+		double e0 = a, e1 = b;
+		double y0 = std::abs(u), y1 = std::abs(v);
+		if (e0 < e1) {
+			std::swap(e0, e1);
+			std::swap(y0, y1);
+		}
+
+		if (y1 > 0) {
+			if (y0 > 0) {
+				double z0 = y0 / e0, z1 = y1 / e1;
+				double g = z0 * z0 + z1 * z1 - 1;
+				if (g == 0) return 0;
+
+				double r0 = (e0 / e1) * (e0 / e1);
+				double n0 = r0 * z0;
+				double s0 = z1 - 1;
+				double s1 = (g < 0) ? 0 : std::sqrt(n0 * n0 + z1 * z1) - 1;
+				double s = 0;
+				for (int i = 0; i < 64; i++) {
+					s = (s0 + s1) / 2;
+					if (s == s0 || s == s1) break;
+					double ratio0 = n0 / (s + r0), ratio1 = z1 / (s + 1);
+					g = ratio0 * ratio0 + ratio1 * ratio1 - 1;
+					if (g > 0) s0 = s;
+					else if (g < 0) s1 = s;
+					else break;
+				}
+				double x0 = r0 * y0 / (s + r0), x1 = y1 / (s + 1);
+				return static_cast<float>(std::sqrt((x0 - y0) * (x0 - y0) + (x1 - y1) * (x1 - y1)));
+			}
+			return static_cast<float>(std::abs(y1 - e1));
+		}
+
+		// On the major axis: the nearest point is off-axis only inside the
+		// evolute's reach
+		double numer = e0 * y0, denom = e0 * e0 - e1 * e1;
+		if (numer < denom) {
+			double xde = numer / denom;
+			double x0 = e0 * xde, x1 = e1 * std::sqrt(1 - xde * xde);
+			return static_cast<float>(std::sqrt((x0 - y0) * (x0 - y0) + x1 * x1));
+		}
+		return static_cast<float>(std::abs(y0 - e0));
+	}
+};
+
+// ============================================================================
+// POLYGON CLASS (SCAN-LINE FILL ALGORITHM)
+// ============================================================================
+class Polygon final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::POLYGON;
+
+	std::vector<sf::Vector2f> vertices;   // the outline, then each hole's ring
+	std::vector<unsigned int> holes;      // where each hole starts in 'vertices'
+	bool filled;
+	FillRule fillRule;
+
+	Polygon(std::vector<sf::Vector2f> verts, sf::Color col, bool fill = false,
+		FillRule rule = FillRule::EVEN_ODD, std::vector<unsigned int> holeStarts = {})
+		: vertices(std::move(verts)), holes(std::move(holeStarts)), filled(fill), fillRule(rule) {
+		color = col;
+		pivot = centroid(vertices);
+		// Starts must rise and leave every ring at least one point
+		unsigned int last = 0;
+		holes.erase(std::remove_if(holes.begin(), holes.end(), [&](unsigned int start) {
+			if (start <= last || start >= vertices.size()) return true;
+			last = start;
+			return false;
+		}), holes.end());
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		if (vertices.size() < 2) return;
+
+		// Local -> screen in one batched pass
+		view.matrix().multiply(worldMatrix()).transformAll(vertices, screenCache);
+
+		sf::FloatRect box = boundsOf(screenCache);
+		if (std::max(box.width, box.height) < LOD_DOT_SIZE + 2) {
+			pixels.plot(std::round(box.left), std::round(box.top), color);
+			return;
+		}
+
+		// Fill if needed (scan-line algorithm, or coverage when anti-aliased)
+		if (filled && vertices.size() >= 3) {
+			if (view.antialias) {
+				AreaCoverage& coverage = AreaCoverage::local();
+				coverage.reset(view.screen);
+				forEachEdge(screenCache, [&](sf::Vector2f a, sf::Vector2f b) { coverage.addEdge(a, b); });
+				coverage.fill(fillRule, color, pixels);
+			}
+			else {
+				scanLineFill(pixels, screenCache, view.plotClip());
+			}
+		}
+
+		if (!stroke.isHairline()) {
+			if (holes.empty()) {
+				strokePath(pixels, screenCache, true, view);
+				return;
+			}
+			forEachRing(screenCache.size(), [&](size_t begin, size_t end) {
+				ring.assign(screenCache.begin() + begin, screenCache.begin() + end);
+				strokePath(pixels, ring, true, view);
+			});
+			return;
+		}
+
+		if (view.antialias) {
+			AreaCoverage& coverage = AreaCoverage::local();
+			coverage.reset(view.screen);
+			forEachEdge(screenCache, [&](sf::Vector2f a, sf::Vector2f b) {
+				coverage.addSegment(a, b, AA_HAIRLINE / 2);
+			});
+			coverage.fill(FillRule::NON_ZERO, color, pixels);
+			return;
+		}
+
+		// Draw the visible part of each edge using Bresenham
+		sf::FloatRect clip = view.plotClip();
+		forEachEdge(screenCache, [&](sf::Vector2f a, sf::Vector2f b) {
+			plotBresenham(pixels, a, b, clip, color);
+		});
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		// Check if point is on any edge
+		bool hit = false;
+		forEachEdge(worldVertices(), [&](sf::Vector2f a, sf::Vector2f b) {
+			if (!hit && distanceToSegment(point, a, b) < SELECTION_THRESHOLD) hit = true;
+		});
+		return hit;
+	}
+
+	sf::FloatRect getBounds() override {
+		return boundsOf(worldVertices());
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		const std::vector<sf::Vector2f>& world = worldVertices();
+		out.insert(out.end(), world.begin(), world.end());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		ss << "Polygon | Vertices: " << vertices.size();
+		if (!holes.empty()) ss << " | Holes: " << holes.size();
+		ss << " | " << (filled ? "Filled" : "Outline");
+		if (filled) ss << " (" << (fillRule == FillRule::EVEN_ODD ? "Even-Odd" : "Non-Zero") << ")";
+		return ss.str();
+	}
+
+	// Local vertices mapped through the retained transform; rebuilt in one
+	// batched pass only after the transform changed
+	const std::vector<sf::Vector2f>& worldVertices() {
+		if (worldDirty) {
+			worldMatrix().transformAll(vertices, worldCache);
+			worldDirty = false;
+		}
+		return worldCache;
+	}
+
+	// Calls f(begin, end) with the index range of the outline, then of each hole
+	template <typename F>
+	void forEachRing(size_t count, F&& f) const {
+		size_t begin = 0;
+		for (unsigned int start : holes) {
+			f(begin, static_cast<size_t>(start));
+			begin = start;
+		}
+		f(begin, count);
+	}
+
+	// Every edge of every ring, each ring closed on itself
+	template <typename F>
+	void forEachEdge(const std::vector<sf::Vector2f>& points, F&& f) const {
+		forEachRing(points.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				f(points[i], points[(i + 1 < end) ? i + 1 : begin]);
+			}
+		});
+	}
+
+private:
+	std::vector<sf::Vector2f> worldCache;
+	std::vector<sf::Vector2f> screenCache;
+	std::vector<sf::Vector2f> ring;   // one ring at a time, for the stroker
+
+	// Scratch buffers reused across frames so filling does not allocate per row
+	ScanlineFiller filler;
+	std::vector<Span> spans;
+
+	void scanLineFill(PixelBuffer& pixels, const std::vector<sf::Vector2f>& screen,
+		const sf::FloatRect& clip) {
+		if (screen.empty()) return;
+
+		spans.clear();
+		filler.reset(clip);
+		forEachEdge(screen, [&](sf::Vector2f a, sf::Vector2f b) { filler.addEdge(a, b); });
+		filler.fill(fillRule, spans);
+
+		// One rectangle per span instead of one per pixel
+		for (auto& s : spans) {
+			pixels.span(s.y, s.x0, s.x1, color);
+		}
+	}
+
+	float distanceToSegment(sf::Vector2f p, sf::Vector2f a, sf::Vector2f b) {
+		float dx = b.x - a.x;
+		float dy = b.y - a.y;
+		float lengthSquared = dx * dx + dy * dy;
+
+		if (lengthSquared == 0) {
+			dx = p.x - a.x;
+			dy = p.y - a.y;
+			return sqrt(dx * dx + dy * dy);
+		}
+
+		float t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared;
+		t = std::max(0.0f, std::min(1.0f, t));
+
+		float projX = a.x + t * dx;
+		float projY = a.y + t * dy;
+
+		dx = p.x - projX;
+		dy = p.y - projY;
+		return sqrt(dx * dx + dy * dy);
+	}
+};
+
+// ============================================================================
+// POLYGON BOOLEANS (SWEEP-LINE CLIPPER)
+// ============================================================================
+// Union, intersection and difference of any number of operands, each any
+// set of rings filled by its own rule, after Martinez-Rueda. Edges are
+// swept left to right and the ones crossing the sweep line are kept in a
+// balanced tree, bottom to top, so only tree neighbours can meet next.
+//
+// The first sweep cuts edges wherever they cross or overlap, until pieces
+// only touch at their ends. Pieces that coincide are merged, each keeping
+// how far crossing it upward moves the winding number of every operand it
+// came from. The second sweep reads each piece's windings below off its
+// lower neighbour, which says whether the piece bounds the result and on
+// which side, with no point-in-polygon tests. Result pieces are then
+// chained into rings with the inside on their left, and each hole is hung
+// on the outline below it.
+//
+// O((n + k)(log n + m)) for n edges, k crossings and m operands, the m
+// being a copy of the windings per piece. Points level on x are taken
+// bottom to top, as if the sweep line leaned slightly, so vertical edges
+// need no special case.
+class PolygonBoolean {
+public:
+	enum Operation { UNION, INTERSECTION, DIFFERENCE };
+
+	void reset() {
+		events.clear();
+		rules.clear();
+	}
+
+	// Each polygon is the next operand; difference is the first minus the
+	// rest. Returns the operand's index.
+	int addPolygon(Polygon& polygon) {
+		const std::vector<sf::Vector2f>& world = polygon.worldVertices();
+		int operand = static_cast<int>(rules.size());
+		rules.push_back(polygon.fillRule);
+		polygon.forEachRing(world.size(), [&](size_t begin, size_t end) {
+			addRing(operand, world.data() + begin, end - begin);
+		});
+		return operand;
+	}
+
+	void addRing(int operand, const sf::Vector2f* points, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			Point a = { points[i].x, points[i].y };
+			Point b = { points[(i + 1) % count].x, points[(i + 1) % count].y };
+			if (same(a, b)) continue;
+			// Crossing an edge that runs left to right raises the winding
+			int wind = before(a, b) ? 1 : -1;
+			if (wind < 0) std::swap(a, b);
+			addSegment(a, b, operand, wind);
+		}
+	}
+
+	// Appends one polygon per outline of the result, holding its holes and
+	// styled like 'like'; world coordinates, so the transform is identity
+	void run(Operation op, const Polygon& like, std::vector<Polygon>& out) {
+		operation = op;
+		subdivide();
+		merge();
+		classify();
+		connect(like, out);
+	}
+
+private:
+	struct Point {
+		double x, y;
+	};
+
+	struct Edge {
+		Point a, b;
+	};
+
+	struct SegmentOrder {
+		const PolygonBoolean* owner;
+		bool operator()(int a, int b) const { return owner->lower(a, b); }
+	};
+
+	struct EventOrder {
+		const PolygonBoolean* owner;
+		bool operator()(int a, int b) const { return owner->later(a, b); }
+	};
+
+	typedef std::set<int, SegmentOrder> Status;
+	typedef std::priority_queue<int, std::vector<int>, EventOrder> Queue;
+
+	// One end of a segment; the left end carries the segment's state
+	struct Event {
+		Point point;
+		int other;              // the event at the segment's other end
+		bool left;
+		bool inStatus;
+		int operand;            // first sweep: the operand the piece is from
+		int wind;               // and its winding change crossing upward
+		int firstChange;        // second sweep: the piece's changes, per operand
+		int changeCount;
+		int above;              // windings just above, while in the status
+		bool inResult;
+		bool insideAbove;       // the result lies above the segment
+		int prevInResult;       // nearest result segment below, or -1
+		int ring;
+		Edge edge;              // the input edge this piece was cut from
+		Status::iterator position;
+	};
+
+	// Finished piece from the first sweep, left end first
+	struct Piece {
+		Point a, b;
+		int operand, wind;
+	};
+
+	// Winding change of one operand across a merged piece
+	struct Change {
+		int operand, wind;
+	};
+
+	// Result segment, directed with the inside on its left
+	struct Directed {
+		Point from, to;
+		int segment;
+		bool used;
+	};
+
+	struct Ring {
+		std::vector<Point> points;
+		bool outer;
+		int parent;
+		std::vector<int> holes;
+	};
+
+	// Squared sine of the angle below which two edges count as parallel
+	static constexpr double PARALLEL = 1e-20;
+	// Relative distance at which a computed crossing is an existing point
+	static constexpr double SNAP = 1e-10;
+	// Slack along a piece, so an end touching an edge whose piece starts at
+	// a rounded cut still counts as a touch
+	static constexpr double REACH = 1e-9;
+
+	std::vector<Event> events;
+	std::vector<Piece> pieces;
+	std::vector<Change> changes;
+	// Windings of every operand, then how many operands are filled there,
+	// in rows kept only while their segment is in the status
+	std::vector<int> windings;
+	std::vector<int> freeRows;
+	std::vector<int> order;
+	std::vector<int> sweep;   // left events of the second sweep, in order
+	std::vector<Directed> edges;
+	std::vector<int> byStart;
+	std::vector<Ring> rings;
+	std::vector<FillRule> rules;   // per operand
+	Operation operation;
+
+	static bool same(const Point& a, const Point& b) {
+		return a.x == b.x && a.y == b.y;
+	}
+
+	static bool near(const Point& a, const Point& b) {
+		double tolerance = SNAP * (1 + std::fabs(b.x) + std::fabs(b.y));
+		return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance;
+	}
+
+	static bool before(const Point& a, const Point& b) {
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	}
+
+	// Positive when c is above the line a -> b taken left to right
+	static double cross(const Point& a, const Point& b, const Point& c) {
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	}
+
+	int addEvent(Point p, bool left, int operand, int wind) {
+		Event e = {};
+		e.point = p;
+		e.left = left;
+		e.operand = operand;
+		e.wind = wind;
+		e.above = -1;
+		e.prevInResult = -1;
+		e.ring = -1;
+		events.push_back(e);
+		return static_cast<int>(events.size()) - 1;
+	}
+
+	// Returns the left event
+	int addSegment(Point a, Point b, int operand, int wind) {
+		int l = addEvent(a, true, operand, wind);
+		int r = addEvent(b, false, operand, wind);
+		events[l].other = r;
+		events[r].other = l;
+		events[l].edge = events[r].edge = Edge{ a, b };
+		return l;
+	}
+
+	// The segment of event e lies below point p
+	bool below(int e, const Point& p) const {
+		const Event& ev = events[e];
+		return ev.left ? cross(ev.point, events[ev.other].point, p) > 0
+			: cross(events[ev.other].point, ev.point, p) > 0;
+	}
+
+	// Sweep order: by x, then y; at one point right ends go first, then
+	// lower segments before higher ones
+	bool later(int a, int b) const {
+		const Event& e1 = events[a];
+		const Event& e2 = events[b];
+		if (e1.point.x != e2.point.x) return e1.point.x > e2.point.x;
+		if (e1.point.y != e2.point.y) return e1.point.y > e2.point.y;
+		if (e1.left != e2.left) return e1.left;
+		// Swapping the events negates 'side' exactly, keeping the order strict
+		double side = cross(e1.point, events[e1.other].point, events[e2.other].point);
+		if (side != 0) return e1.left ? side < 0 : side > 0;
+		return a > b;
+	}
+
+	// Tree order of two left events: which segment is lower where the later
+	// of them was inserted. Always judged against the earlier segment, since
+	// nearly collinear pieces can disagree about each other's side
+	bool lower(int a, int b) const {
+		if (a == b) return false;
+		if (later(a, b)) return !lower(b, a);
+		const Point& pa = events[a].point;
+		const Point& qa = events[events[a].other].point;
+		const Point& pb = events[b].point;
+		const Point& qb = events[events[b].other].point;
+		double start = cross(pa, qa, pb);
+		if (start != 0 || cross(pa, qa, qb) != 0) {
+			if (pa.x == pb.x && !same(pa, pb)) return pa.y < pb.y;
+			return start != 0 ? start > 0 : below(a, qb);
+		}
+		// Collinear: overlaps are cut apart, so the earlier one goes first
+		return true;
+	}
+
+	static double clampTo(double v, double a0, double a1, double b0, double b1) {
+		double lo = std::max(std::min(a0, a1), std::min(b0, b1));
+		double hi = std::min(std::max(a0, a1), std::max(b0, b1));
+		return std::min(std::max(v, lo), hi);
+	}
+
+	// Where the lines through two input edges cross, if they do. Cuts come
+	// from the input edges rather than their pieces, and in one order, so
+	// every cut of one pair lands on the same point whichever pieces meet
+	static bool crossing(Edge e, Edge f, Point& hit) {
+		if (before(f.a, e.a) || (same(e.a, f.a) && before(f.b, e.b))) std::swap(e, f);
+		double vx = e.b.x - e.a.x, vy = e.b.y - e.a.y;
+		double wx = f.b.x - f.a.x, wy = f.b.y - f.a.y;
+		double kross = vx * wy - vy * wx;
+		if (kross == 0) return false;
+		double s = ((f.a.x - e.a.x) * wy - (f.a.y - e.a.y) * wx) / kross;
+		hit = Point{ e.a.x + s * vx, e.a.y + s * vy };
+		return true;
+	}
+
+	// Where the pieces of left events a and b meet: 0, 1 for a crossing or
+	// touch (at 'hit'), or 2 for a collinear overlap
+	int intersect(int a, int b, Point& hit) const {
+		Point a0 = events[a].point, a1 = events[events[a].other].point;
+		Point b0 = events[b].point, b1 = events[events[b].other].point;
+		double vax = a1.x - a0.x, vay = a1.y - a0.y;
+		double vbx = b1.x - b0.x, vby = b1.y - b0.y;
+		double ex = b0.x - a0.x, ey = b0.y - a0.y;
+		double kross = vax * vby - vay * vbx;
+		double lengthA = vax * vax + vay * vay;
+		double lengthB = vbx * vbx + vby * vby;
+		if (kross * kross > PARALLEL * lengthA * lengthB) {
+			double s = (ex * vby - ey * vbx) / kross;   // along a
+			double t = (ex * vay - ey * vax) / kross;   // along b
+			if (s < -REACH || s > 1 + REACH || t < -REACH || t > 1 + REACH) return 0;
+			hit = Point{ a0.x + s * vax, a0.y + s * vay };
+			crossing(events[a].edge, events[b].edge, hit);
+			// Kept inside both boxes, so cuts on an axis-aligned edge stay on
+			// it; touches, and crossings that round next to an earlier cut,
+			// land exactly on the endpoint
+			hit.x = clampTo(hit.x, a0.x, a1.x, b0.x, b1.x);
+			hit.y = clampTo(hit.y, a0.y, a1.y, b0.y, b1.y);
+			for (const Point& end : { a0, a1, b0, b1 }) {
+				if (near(hit, end)) {
+					hit = end;
+					break;
+				}
+			}
+			return 1;
+		}
+
+		// Parallel; collinear only if b0 is on a's line
+		double side = ex * vay - ey * vax;
+		if (side * side > PARALLEL * lengthA * (ex * ex + ey * ey)) return 0;
+		double s0 = (ex * vax + ey * vay) / lengthA;
+		double s1 = s0 + (vax * vbx + vay * vby) / lengthA;
+		double lo = std::min(s0, s1), hi = std::max(s0, s1);
+		if (lo > 1 || hi < 0) return 0;
+		if (lo == 1) { hit = a1; return 1; }
+		if (hi == 0) { hit = a0; return 1; }
+		return 2;
+	}
+
+	// Cuts the segment of left event e at p; the far piece joins the queue
+	void split(int e, Point p, Queue& queue) {
+		int far = events[e].other;
+		if (same(p, events[e].point) || same(p, events[far].point)) return;
+		int r = addEvent(p, false, events[e].operand, events[e].wind);
+		int l = addEvent(p, true, events[e].operand, events[e].wind);
+		events[r].edge = events[l].edge = events[e].edge;
+		events[r].other = e;
+		events[l].other = far;
+		events[far].other = l;
+		events[e].other = r;
+		// Rounding can put p past the far end; the piece then runs backwards
+		if (later(l, far)) {
+			events[far].left = true;
+			events[l].left = false;
+			events[far].wind = -events[far].wind;
+			events[l].wind = -events[l].wind;
+		}
+		queue.push(l);
+		queue.push(r);
+	}
+
+	// Neighbours in the tree: cut both where they cross, or where each
+	// ends inside the other if they overlap
+	void meet(int a, int b, Queue& queue) {
+		Point a0 = events[a].point, a1 = events[events[a].other].point;
+		Point b0 = events[b].point, b1 = events[events[b].other].point;
+		Point hit;
+		int count = intersect(a, b, hit);
+		if (count == 0) return;
+		if (count == 1) {
+			split(a, hit, queue);
+			split(b, hit, queue);
+			return;
+		}
+
+		bool leftSame = same(a0, b0), rightSame = same(a1, b1);
+		if (leftSame && rightSame) return;   // identical; merged after the sweep
+		if (leftSame) {
+			// The longer one is cut where the shorter ends
+			if (before(a1, b1)) split(b, a1, queue);
+			else split(a, b1, queue);
+			return;
+		}
+		int first = before(a0, b0) ? a : b;
+		int second = (first == a) ? b : a;
+		Point secondLeft = events[second].point;
+		Point firstRight = events[events[first].other].point;
+		Point secondRight = events[events[second].other].point;
+		if (rightSame) {
+			split(first, secondLeft, queue);
+		}
+		else if (before(firstRight, secondRight)) {
+			// Staggered: each is cut where the other begins or ends
+			split(first, secondLeft, queue);
+			split(second, firstRight, queue);
+		}
+		else {
+			// First contains second: cut it at both of second's ends
+			int farEnd = events[first].other;
+			split(first, secondLeft, queue);
+			split(events[farEnd].other, secondRight, queue);
+		}
+	}
+
+	// First sweep: cut until no two pieces cross, collecting the pieces as
+	// their right ends go by. Input ends are sorted once, latest first; only
+	// the ends that cuts make go through the heap
+	void subdivide() {
+		order.resize(events.size());
+		for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<int>(i);
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return later(a, b); });
+		Queue queue{ EventOrder{ this } };
+		Status status{ SegmentOrder{ this } };
+		pieces.clear();
+
+		while (!order.empty() || !queue.empty()) {
+			int e;
+			if (queue.empty() || (!order.empty() && later(queue.top(), order.back()))) {
+				e = order.back();
+				order.pop_back();
+			}
+			else {
+				e = queue.top();
+				queue.pop();
+			}
+			if (events[e].left) {
+				Status::iterator it = status.insert(e).first;
+				events[e].position = it;
+				events[e].inStatus = true;
+				Status::iterator next = std::next(it);
+				if (next != status.end()) meet(e, *next, queue);
+				if (it != status.begin()) meet(*std::prev(it), e, queue);
+				continue;
+			}
+
+			int l = events[e].other;
+			if (!events[l].inStatus) continue;
+			Status::iterator it = events[l].position;
+			Status::iterator next = std::next(it);
+			int prev = (it != status.begin()) ? *std::prev(it) : -1;
+			status.erase(it);
+			events[l].inStatus = false;
+			if (prev >= 0 && next != status.end()) meet(prev, *next, queue);
+			pieces.push_back(Piece{ events[l].point, events[e].point, events[l].operand, events[l].wind });
+		}
+	}
+
+	// Coinciding pieces become one whose winding changes add up per
+	// operand; pieces that change nothing cannot bound the result and are
+	// dropped
+	void merge() {
+		std::sort(pieces.begin(), pieces.end(), [](const Piece& p, const Piece& q) {
+			if (!same(p.a, q.a)) return before(p.a, q.a);
+			return before(p.b, q.b);
+		});
+		events.clear();
+		changes.clear();
+		for (size_t i = 0; i < pieces.size();) {
+			const Piece& piece = pieces[i];
+			const size_t first = changes.size();
+			size_t j = i;
+			for (; j < pieces.size() && same(pieces[j].a, piece.a) && same(pieces[j].b, piece.b); j++) {
+				auto found = std::find_if(changes.begin() + first, changes.end(),
+					[&](const Change& c) { return c.operand == pieces[j].operand; });
+				if (found != changes.end()) found->wind += pieces[j].wind;
+				else changes.push_back(Change{ pieces[j].operand, pieces[j].wind });
+			}
+			changes.erase(std::remove_if(changes.begin() + first, changes.end(),
+				[](const Change& c) { return c.wind == 0; }), changes.end());
+			if (!same(piece.a, piece.b) && changes.size() > first) {
+				int l = addSegment(piece.a, piece.b, 0, 0);
+				events[l].firstChange = static_cast<int>(first);
+				events[l].changeCount = static_cast<int>(changes.size() - first);
+			}
+			else {
+				changes.resize(first);
+			}
+			i = j;
+		}
+	}
+
+	bool filled(int operand, int winding) const {
+		return (rules[operand] == FillRule::EVEN_ODD) ? (winding & 1) != 0 : winding != 0;
+	}
+
+	// Whether the windings in 'row' are inside the result
+	bool inside(int row) const {
+		const int operands = static_cast<int>(rules.size());
+		const int count = windings[row + operands];
+		switch (operation) {
+		case UNION: return count > 0;
+		case INTERSECTION: return count == operands;
+		default: return count == 1 && filled(0, windings[row]);
+		}
+	}
+
+	// Windings above left event e: those below it, from the row 'under'
+	// or outside everything, moved by its changes
+	int windingsAbove(int e, int under) {
+		const int width = static_cast<int>(rules.size()) + 1;
+		int row;
+		if (!freeRows.empty()) {
+			row = freeRows.back();
+			freeRows.pop_back();
+		}
+		else {
+			row = static_cast<int>(windings.size());
+			windings.resize(windings.size() + width);
+		}
+		if (under >= 0) std::copy(windings.begin() + under, windings.begin() + under + width, windings.begin() + row);
+		else std::fill(windings.begin() + row, windings.begin() + row + width, 0);
+
+		int& count = windings[row + width - 1];
+		const Event& ev = events[e];
+		for (int c = ev.firstChange; c < ev.firstChange + ev.changeCount; c++) {
+			int& winding = windings[row + changes[c].operand];
+			bool was = filled(changes[c].operand, winding);
+			winding += changes[c].wind;
+			count += filled(changes[c].operand, winding) - was;
+		}
+		return row;
+	}
+
+	// Second sweep over pieces that no longer cross: windings pass up from
+	// each lower neighbour
+	void classify() {
+		// Nothing is cut any more, so one sort replaces the queue
+		order.resize(events.size());
+		for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<int>(i);
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return later(b, a); });
+		Status status{ SegmentOrder{ this } };
+		sweep.clear();
+		windings.clear();
+		freeRows.clear();
+
+		for (int e : order) {
+			if (!events[e].left) {
+				int l = events[e].other;
+				if (events[l].inStatus) {
+					status.erase(events[l].position);
+					freeRows.push_back(events[l].above);
+				}
+				events[l].inStatus = false;
+				continue;
+			}
+
+			Status::iterator it = status.insert(e).first;
+			int prev = (it != status.begin()) ? *std::prev(it) : -1;
+			int row = windingsAbove(e, (prev >= 0) ? events[prev].above : -1);
+			Event& ev = events[e];
+			ev.position = it;
+			ev.inStatus = true;
+			ev.above = row;
+			ev.insideAbove = inside(row);
+			ev.inResult = (prev >= 0 && events[prev].insideAbove) != ev.insideAbove;
+			if (prev >= 0) ev.prevInResult = events[prev].inResult ? prev : events[prev].prevInResult;
+			sweep.push_back(e);
+		}
+	}
+
+	// Unused result edge leaving where 'current' ends, turning as far left
+	// as possible so rings that touch at a point come apart there; 'start'
+	// counts as unused so the ring can close
+	int nextEdge(int current, int start) {
+		const Directed& in = edges[current];
+		auto range = std::equal_range(byStart.begin(), byStart.end(), in.to, Before{ this });
+		int best = -1;
+		double bestTurn = 0;
+		for (auto it = range.first; it != range.second; ++it) {
+			const Directed& out = edges[*it];
+			if (out.used && *it != start) continue;
+			double ix = in.to.x - in.from.x, iy = in.to.y - in.from.y;
+			double ox = out.to.x - out.from.x, oy = out.to.y - out.from.y;
+			double turn = std::atan2(ix * oy - iy * ox, ix * ox + iy * oy);
+			if (best < 0 || turn > bestTurn) {
+				best = *it;
+				bestTurn = turn;
+			}
+		}
+		return best;
+	}
+
+	// Orders edge indices by start point, and looks points up among them
+	struct Before {
+		const PolygonBoolean* owner;
+		bool operator()(int a, int b) const { return before(owner->edges[a].from, owner->edges[b].from); }
+		bool operator()(int a, const Point& p) const { return before(owner->edges[a].from, p); }
+		bool operator()(const Point& p, int b) const { return before(p, owner->edges[b].from); }
+	};
+
+	void connect(const Polygon& like, std::vector<Polygon>& out) {
+		edges.clear();
+		for (int e : sweep) {
+			const Event& ev = events[e];
+			if (!ev.inResult) continue;
+			const Point& right = events[ev.other].point;
+			events[e].ring = static_cast<int>(edges.size());   // edge index until traced
+			edges.push_back(ev.insideAbove ? Directed{ ev.point, right, e, false } : Directed{ right, ev.point, e, false });
+		}
+		byStart.resize(edges.size());
+		for (size_t i = 0; i < byStart.size(); i++) byStart[i] = static_cast<int>(i);
+		std::sort(byStart.begin(), byStart.end(), Before{ this });
+
+		// Sweep order makes each ring start at its leftmost point, along its
+		// lowest edge, and reach any ring below it before itself
+		rings.clear();
+		for (int e : sweep) {
+			if (!events[e].inResult || edges[events[e].ring].used) continue;
+			int index = static_cast<int>(rings.size());
+			rings.push_back(Ring());
+			Ring& ring = rings.back();
+			ring.outer = events[e].insideAbove;
+			ring.parent = -1;
+
+			int start = events[e].ring;
+			for (int current = start; current >= 0;) {
+				Directed& edge = edges[current];
+				edge.used = true;
+				ring.points.push_back(edge.from);
+				int next = nextEdge(current, start);
+				events[edge.segment].ring = index;
+				if (next == start) break;
+				current = next;
+			}
+
+			// Below a hole's leftmost point is the result: either an outline
+			// holding it, or another hole of the same outline
+			int under = events[e].prevInResult;
+			if (!ring.outer && under >= 0) {
+				const Ring& lower = rings[events[under].ring];
+				ring.parent = lower.outer ? events[under].ring : lower.parent;
+			}
+			if (ring.parent >= 0) rings[ring.parent].holes.push_back(index);
+		}
+
+		for (auto& ring : rings) {
+			if (!ring.outer) continue;
+			std::vector<sf::Vector2f> vertices;
+			std::vector<unsigned int> holes;
+			if (!appendRing(ring, vertices)) continue;
+			for (int h : ring.holes) {
+				size_t start = vertices.size();
+				if (appendRing(rings[h], vertices)) holes.push_back(static_cast<unsigned int>(start));
+			}
+			Polygon polygon(std::move(vertices), like.color, like.filled, like.fillRule, std::move(holes));
+			polygon.stroke = like.stroke;
+			out.push_back(std::move(polygon));
+		}
+	}
+
+	// Ring as float vertices, without points that round onto their
+	// neighbour; false if fewer than three are left
+	static bool appendRing(const Ring& ring, std::vector<sf::Vector2f>& vertices) {
+		size_t start = vertices.size();
+		for (const Point& p : ring.points) {
+			sf::Vector2f v(static_cast<float>(p.x), static_cast<float>(p.y));
+			if (vertices.size() == start || vertices.back() != v) vertices.push_back(v);
+		}
+		while (vertices.size() > start + 1 && vertices.back() == vertices[start]) vertices.pop_back();
+		if (vertices.size() - start >= 3) return true;
+		vertices.resize(start);
+		return false;
+	}
+};
+
+// ============================================================================
+// BEZIER CURVE CLASS (PARAMETRIC CURVES)
+// ============================================================================
+class BezierCurve final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::BEZIER;
+
+	std::vector<sf::Vector2f> controlPoints;
+	int segments;
+	bool showControlPoints;
+
+	BezierCurve(std::vector<sf::Vector2f> points, sf::Color col, int segs = 100)
+		: controlPoints(std::move(points)), segments(segs), showControlPoints(true) {
+		color = col;
+		pivot = centroid(controlPoints);
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		if (controlPoints.size() < 2) return;
+
+		// Bezier curves are affine invariant, so project the control points
+		view.matrix().multiply(worldMatrix()).transformAll(controlPoints, screenCache);
+
+		sf::FloatRect box = boundsOf(screenCache);
+		if (std::max(box.width, box.height) < LOD_DOT_SIZE + 2) {
+			pixels.plot(std::round(box.left), std::round(box.top), color);
+			return;
+		}
+
+		// Draw control points
+		if (showControlPoints) {
+			for (auto& cp : screenCache) {
+				pixels.rect(cp.x - 3, cp.y - 3, 6, 6, sf::Color(100, 100, 100));
+			}
+		}
+
+		// Segment count follows the on-screen length of the control polygon
+		float length = 0;
+		for (size_t i = 1; i < screenCache.size(); i++) {
+			sf::Vector2f d = screenCache[i] - screenCache[i - 1];
+			length += sqrt(d.x * d.x + d.y * d.y);
+		}
+		int steps = static_cast<int>(std::ceil(length / BEZIER_SEGMENT_PIXELS));
+		steps = std::max(1, std::min(segments, steps));
+
+		if (!stroke.isHairline()) {
+			std::vector<sf::Vector2f>& path = Stroker::local().path;
+			path.clear();
+			for (int i = 0; i <= steps; i++) {
+				path.push_back(evaluateBezier(screenCache, static_cast<float>(i) / steps));
+			}
+			strokePath(pixels, path, false, view);
+			return;
+		}
+
+		// Draw curve using De Casteljau's algorithm, stepping only the
+		// visible part of each chord
+		sf::FloatRect clip = view.plotClip();
+		sf::Vector2f prevPoint = evaluateBezier(screenCache, 0.0f);
+		for (int i = 1; i <= steps; i++) {
+			float t = static_cast<float>(i) / steps;
+			sf::Vector2f currentPoint = evaluateBezier(screenCache, t);
+
+			plotBresenham(pixels, prevPoint, currentPoint, clip, color);
+			prevPoint = currentPoint;
+		}
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		return nearestDistance(point, 0.25f, SELECTION_THRESHOLD) < SELECTION_THRESHOLD;
+	}
+
+	// Distance from the point to the curve itself, accurate to 'tolerance'
+	// and capped at 'limit'. The curve lies inside the hull of its control
+	// points, so a piece whose control box is no closer than the best
+	// distance found so far is dropped; otherwise it is halved (de Casteljau)
+	// until its control polygon is flat enough to measure as a chord.
+	float nearestDistance(sf::Vector2f point, float tolerance, float limit) {
+		const std::vector<sf::Vector2f>& control = worldControlPoints();
+		const size_t n = control.size();
+		float best = limit;
+		if (n == 0 || boxDistance(control.data(), n, point) >= best) return best;
+		if (n == 1) return std::min(best, length(point - control[0]));
+
+		pieces.assign(control.begin(), control.end());
+		depths.assign(1, 0);
+		halves.resize(2 * n);
+
+		while (!depths.empty()) {
+			int depth = depths.back();
+			depths.pop_back();
+			size_t base = pieces.size() - n;
+			const sf::Vector2f* piece = pieces.data() + base;
+
+			if (boxDistance(piece, n, point) >= best) {
+				pieces.resize(base);
+				continue;
+			}
+			if (depth >= 24 || flatness(piece, n) <= tolerance) {
+				best = std::min(best, distanceToSegment(point, piece[0], piece[n - 1]));
+				pieces.resize(base);
+				continue;
+			}
+
+			// Split at t = 0.5: left half in halves[0..n), right in [n..2n)
+			work.assign(piece, piece + n);
+			halves[0] = work[0];
+			halves[2 * n - 1] = work[n - 1];
+			for (size_t k = 1; k < n; k++) {
+				for (size_t i = 0; i < n - k; i++) {
+					work[i] = (work[i] + work[i + 1]) * 0.5f;
+				}
+				halves[k] = work[0];
+				halves[2 * n - 1 - k] = work[n - 1 - k];
+			}
+			pieces.resize(base);
+
+			// Push the farther half first so the nearer one tightens 'best'
+			const sf::Vector2f* left = halves.data();
+			const sf::Vector2f* right = halves.data() + n;
+			bool leftFirst = boxDistance(left, n, point) <= boxDistance(right, n, point);
+			const sf::Vector2f* later = leftFirst ? right : left;
+			const sf::Vector2f* sooner = leftFirst ? left : right;
+			pieces.insert(pieces.end(), later, later + n);
+			pieces.insert(pieces.end(), sooner, sooner + n);
+			depths.push_back(depth + 1);
+			depths.push_back(depth + 1);
+		}
+		return best;
+	}
+
+	sf::FloatRect getBounds() override {
+		// The curve stays inside its control polygon; pad for the markers
+		sf::FloatRect box = boundsOf(worldControlPoints());
+		return sf::FloatRect(box.left - 3, box.top - 3, box.width + 6, box.height + 6);
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		const std::vector<sf::Vector2f>& world = worldControlPoints();
+		out.insert(out.end(), world.begin(), world.end());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		ss << "Bezier Curve | Control Points: " << controlPoints.size();
+		return ss.str();
+	}
+
+	const std::vector<sf::Vector2f>& worldControlPoints() {
+		if (worldDirty) {
+			worldMatrix().transformAll(controlPoints, worldCache);
+			worldDirty = false;
+		}
+		return worldCache;
+	}
+
+private:
+	std::vector<sf::Vector2f> worldCache;
+	std::vector<sf::Vector2f> screenCache;
+	std::vector<sf::Vector2f> scratch;
+
+	// Subdivision stack for picking, reused between calls
+	std::vector<sf::Vector2f> pieces;
+	std::vector<sf::Vector2f> halves;
+	std::vector<sf::Vector2f> work;
+	std::vector<int> depths;
+
+	static float length(sf::Vector2f v) {
+		return std::sqrt(v.x * v.x + v.y * v.y);
+	}
+
+	// Distance from the point to the axis-aligned box of n points
+	static float boxDistance(const sf::Vector2f* points, size_t n, sf::Vector2f p) {
+		float minX = points[0].x, maxX = points[0].x;
+		float minY = points[0].y, maxY = points[0].y;
+		for (size_t i = 1; i < n; i++) {
+			minX = std::min(minX, points[i].x);
+			maxX = std::max(maxX, points[i].x);
+			minY = std::min(minY, points[i].y);
+			maxY = std::max(maxY, points[i].y);
+		}
+		float dx = std::max(0.0f, std::max(minX - p.x, p.x - maxX));
+		float dy = std::max(0.0f, std::max(minY - p.y, p.y - maxY));
+		return std::sqrt(dx * dx + dy * dy);
+	}
+
+	// Largest distance of an inner control point from the end-to-end chord;
+	// the curve piece is within this of the chord
+	static float flatness(const sf::Vector2f* points, size_t n) {
+		float worst = 0;
+		for (size_t i = 1; i + 1 < n; i++) {
+			worst = std::max(worst, distanceToSegment(points[i], points[0], points[n - 1]));
+		}
+		return worst;
+	}
+
+	static float distanceToSegment(sf::Vector2f p, sf::Vector2f a, sf::Vector2f b) {
+		sf::Vector2f ab = b - a;
+		float lengthSq = ab.x * ab.x + ab.y * ab.y;
+		float t = (lengthSq > 0) ? ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y) / lengthSq : 0.0f;
+		t = std::max(0.0f, std::min(1.0f, t));
+		return length(p - (a + ab * t));
+	}
+
+	sf::Vector2f evaluateBezier(const std::vector<sf::Vector2f>& control, float t) {
+		// De Casteljau's algorithm, reduced in place in a reused buffer
+		scratch.assign(control.begin(), control.end());
+
+		for (size_t n = scratch.size() - 1; n > 0; n--) {
+			for (size_t i = 0; i < n; i++) {
+				scratch[i].x = (1 - t) * scratch[i].x + t * scratch[i + 1].x;
+				scratch[i].y = (1 - t) * scratch[i].y + t * scratch[i + 1].y;
+			}
+		}
+
+		return scratch[0];
+	}
+};
+
+// ============================================================================
+// B-SPLINE AND NURBS CURVE CLASS (CACHED BASIS TABLES)
+// ============================================================================
+// Clamped uniform B-splines: the knots are 0..0, 1, 2, .., m..m with each end
+// repeated degree+1 times, so the curve starts and ends on its end control
+// points and span s (parameter s to s+1) depends only on control points
+// s..s+degree. Moving a point reshapes at most degree+1 spans.
+//
+// Every span away from the ends has the same knot spacing, so its basis
+// weights at a given sampling rate are the same numbers; only the spans
+// within 'degree' of an end differ. Each case is worked out once and a curve
+// point is then a (degree+1)-term dot product.
+class BasisTables {
+public:
+	static BasisTables& local() {
+		thread_local BasisTables tables;
+		return tables;
+	}
+
+	BasisTables() : tables(SPLINE_DEGREE * SPLINE_MAX_SAMPLES * SPLINE_DEGREE * SPLINE_DEGREE) {}
+
+	// Weights of span s's control points at samples+1 even steps from its
+	// start to its end, degree+1 floats per step. m is the span count.
+	const float* span(int degree, int s, int m, int samples) {
+		int fromStart = std::min(s, degree - 1);
+		int toEnd = std::min(m - s, degree);
+		size_t key = ((static_cast<size_t>(degree - 1) * SPLINE_MAX_SAMPLES + (samples - 1)) * SPLINE_DEGREE +
+			fromStart) * SPLINE_DEGREE + (toEnd - 1);
+		std::vector<float>& table = tables[key];
+		if (table.empty()) build(degree, fromStart, toEnd, samples, table);
+		return table.data();
+	}
+
+private:
+	std::vector<std::vector<float>> tables;
+
+	// Cox-de Boor on the knots around one span, shifted so the span is [0, 1].
+	// Knots past the curve's ends are clamped to them, which is all that
+	// tells the end spans apart.
+	static void build(int p, int fromStart, int toEnd, int samples, std::vector<float>& table) {
+		float knots[2 * SPLINE_DEGREE];   // knots[k + p - 1] is the span start plus k
+		for (int k = 1 - p; k <= p; k++) {
+			knots[k + p - 1] = static_cast<float>(std::max(-fromStart, std::min(k, toEnd)));
+		}
+
+		table.resize(static_cast<size_t>(samples + 1) * (p + 1));
+		float left[SPLINE_DEGREE + 1], right[SPLINE_DEGREE + 1];
+		for (int i = 0; i <= samples; i++) {
+			float u = static_cast<float>(i) / samples;
+			float* n = &table[static_cast<size_t>(i) * (p + 1)];
+			n[0] = 1;
+			for (int r = 1; r <= p; r++) {
+				left[r] = u - knots[p - r];
+				right[r] = knots[p - 1 + r] - u;
+				float saved = 0;
+				for (int q = 0; q < r; q++) {
+					float term = n[q] / (right[q + 1] + left[r - q]);
+					n[q] = saved + right[q + 1] * term;
+					saved = left[r - q] * term;
+				}
+				n[r] = saved;
+			}
+		}
+	}
+};
+
+// A curve with no weights is a plain cubic B-spline; with one weight per
+// control point it is a NURBS, pulled toward the heavier points
+class SplineCurve final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::SPLINE;
+
+	std::vector<sf::Vector2f> controlPoints;
+	std::vector<float> weights;
+	bool showControlPoints;
+
+	SplineCurve(std::vector<sf::Vector2f> points, sf::Color col, std::vector<float> pointWeights = {})
+		: controlPoints(std::move(points)), weights(std::move(pointWeights)), showControlPoints(true) {
+		color = col;
+		pivot = centroid(controlPoints);
+		// The curve stays in its control hull only while weights are positive
+		if (!weights.empty()) {
+			weights.resize(controlPoints.size(), 1.0f);
+			for (auto& w : weights) {
+				w = (w >= NURBS_MIN_WEIGHT) ? std::min(w, NURBS_MAX_WEIGHT) : NURBS_MIN_WEIGHT;
+			}
+		}
+	}
+
+	bool isRational() const {
+		return !weights.empty();
+	}
+
+	// Fewer points than a cubic needs give a single lower-degree span
+	int degree() const {
+		return std::min(SPLINE_DEGREE, static_cast<int>(controlPoints.size()) - 1);
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		if (controlPoints.size() < 2) return;
+
+		// Affine maps move the control points and leave the weights alone
+		view.matrix().multiply(worldMatrix()).transformAll(controlPoints, screenCache);
+
+		sf::FloatRect box = boundsOf(screenCache);
+		if (std::max(box.width, box.height) < LOD_DOT_SIZE + 2) {
+			pixels.plot(std::round(box.left), std::round(box.top), color);
+			return;
+		}
+
+		// Spans whose control hull is off screen are skipped. A dashed stroke
+		// is walked whole so its dashes keep their phase.
+		float margin = strokeReach() * view.zoom + 3;
+		sf::FloatRect area(view.screen.left - margin, view.screen.top - margin,
+			view.screen.width + 2 * margin, view.screen.height + 2 * margin);
+		bool cull = stroke.dashCount == 0;
+
+		if (showControlPoints) {
+			for (auto& cp : screenCache) {
+				if (area.contains(cp)) pixels.rect(cp.x - 3, cp.y - 3, 6, 6, sf::Color(100, 100, 100));
+			}
+		}
+
+		const int p = degree();
+		const int m = static_cast<int>(screenCache.size()) - p;
+		BasisTables& tables = BasisTables::local();
+		samples.clear();
+		for (int s = 0; s < m; s++) {
+			const sf::Vector2f* control = &screenCache[s];
+			if (cull && !hullTouches(control, p + 1, area)) {
+				drawSamples(pixels, view);
+				continue;
+			}
+
+			int rate = samplesFor(control, s, m, SPLINE_FLATNESS);
+			const float* basis = tables.span(p, s, m, rate);
+
+			// Consecutive spans share their joining point
+			for (int i = samples.empty() ? 0 : 1; i <= rate; i++) {
+				samples.push_back(evaluate(control, s, basis + i * (p + 1), p));
+			}
+		}
+		drawSamples(pixels, view);
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		return nearestDistance(point, SELECTION_THRESHOLD) < SELECTION_THRESHOLD;
+	}
+
+	// Distance from the point to the curve, capped at 'limit'. Each span lies
+	// inside the hull of its own control points, so only spans whose control
+	// box is nearer than the best distance so far are sampled.
+	float nearestDistance(sf::Vector2f point, float limit) {
+		const std::vector<sf::Vector2f>& world = worldControlPoints();
+		float best = limit;
+		if (world.size() < 2) return world.empty() ? best : std::min(best, length(point - world[0]));
+
+		const int p = degree();
+		const int m = static_cast<int>(world.size()) - p;
+		BasisTables& tables = BasisTables::local();
+		for (int s = 0; s < m; s++) {
+			const sf::Vector2f* control = &world[s];
+			if (boxDistance(control, p + 1, point) >= best) continue;
+
+			int rate = samplesFor(control, s, m, SPLINE_FLATNESS);
+			const float* basis = tables.span(p, s, m, rate);
+			sf::Vector2f previous = evaluate(control, s, basis, p);
+			for (int i = 1; i <= rate; i++) {
+				sf::Vector2f current = evaluate(control, s, basis + i * (p + 1), p);
+				best = std::min(best, distanceToSegment(point, previous, current));
+				previous = current;
+			}
+		}
+		return best;
+	}
+
+	sf::FloatRect getBounds() override {
+		// The curve stays inside its control polygon; pad for the markers
+		sf::FloatRect box = boundsOf(worldControlPoints());
+		return sf::FloatRect(box.left - 3, box.top - 3, box.width + 6, box.height + 6);
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		const std::vector<sf::Vector2f>& world = worldControlPoints();
+		out.insert(out.end(), world.begin(), world.end());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		ss << (isRational() ? "NURBS Curve" : "B-Spline Curve") << " | Control Points: " << controlPoints.size()
+			<< " | Degree: " << degree();
+		return ss.str();
+	}
+
+	const std::vector<sf::Vector2f>& worldControlPoints() {
+		if (worldDirty) {
+			worldMatrix().transformAll(controlPoints, worldCache);
+			worldDirty = false;
+		}
+		return worldCache;
+	}
+
+private:
+	std::vector<sf::Vector2f> worldCache;
+	std::vector<sf::Vector2f> screenCache;
+	std::vector<sf::Vector2f> samples;   // visible run of curve points, in screen space
+
+	// Point on span s from one row of its basis table; a NURBS divides by
+	// the weighted sum, which the basis alone makes 1
+	sf::Vector2f evaluate(const sf::Vector2f* control, int s, const float* basis, int p) const {
+		sf::Vector2f point(0, 0);
+		if (!isRational()) {
+			for (int j = 0; j <= p; j++) point += control[j] * basis[j];
+			return point;
+		}
+		float total = 0;
+		for (int j = 0; j <= p; j++) {
+			float b = basis[j] * weights[s + j];
+			point += control[j] * b;
+			total += b;
+		}
+		return point / total;
+	}
+
+	// Steps that keep span s within 'tolerance' of its chords. A step of h
+	// strays at most h^2/8 times the second derivative, which on a uniform
+	// span is bounded by the control points' second differences; the end
+	// spans' closer knots scale it by up to degree * (degree - 1). Weights
+	// can bunch a NURBS up, so it goes by control polygon length instead.
+	int samplesFor(const sf::Vector2f* control, int s, int m, float tolerance) const {
+		const int p = degree();
+		float rate;
+		if (isRational()) {
+			rate = polygonLength(control, p + 1) / (16 * tolerance);
+		}
+		else {
+			float bend = 0;
+			for (int j = 0; j + 2 <= p; j++) {
+				bend = std::max(bend, length(control[j] - 2.0f * control[j + 1] + control[j + 2]));
+			}
+			if (s < p - 1 || m - s < p) bend *= static_cast<float>(p * (p - 1));
+			rate = std::sqrt(bend / (8 * tolerance));
+		}
+		return std::max(1, std::min(SPLINE_MAX_SAMPLES, static_cast<int>(std::ceil(rate))));
+	}
+
+	void drawSamples(PixelBuffer& pixels, const RasterView& view) {
+		if (samples.size() >= 2) {
+			if (!stroke.isHairline()) {
+				strokePath(pixels, samples, false, view);
+			}
+			else {
+				sf::FloatRect clip = view.plotClip();
+				for (size_t i = 1; i < samples.size(); i++) {
+					plotBresenham(pixels, samples[i - 1], samples[i], clip, color);
+				}
+			}
+		}
+		samples.clear();
+	}
+
+	static float length(sf::Vector2f v) {
+		return std::sqrt(v.x * v.x + v.y * v.y);
+	}
+
+	static float polygonLength(const sf::Vector2f* points, int n) {
+		float total = 0;
+		for (int i = 1; i < n; i++) total += length(points[i] - points[i - 1]);
+		return total;
+	}
+
+	static bool hullTouches(const sf::Vector2f* points, int n, const sf::FloatRect& area) {
+		float minX = points[0].x, maxX = points[0].x;
+		float minY = points[0].y, maxY = points[0].y;
+		for (int i = 1; i < n; i++) {
+			minX = std::min(minX, points[i].x);
+			maxX = std::max(maxX, points[i].x);
+			minY = std::min(minY, points[i].y);
+			maxY = std::max(maxY, points[i].y);
+		}
+		return maxX >= area.left && minX <= area.left + area.width &&
+			maxY >= area.top && minY <= area.top + area.height;
+	}
+
+	// Distance from the point to the axis-aligned box of n points
+	static float boxDistance(const sf::Vector2f* points, int n, sf::Vector2f p) {
+		float minX = points[0].x, maxX = points[0].x;
+		float minY = points[0].y, maxY = points[0].y;
+		for (int i = 1; i < n; i++) {
+			minX = std::min(minX, points[i].x);
+			maxX = std::max(maxX, points[i].x);
+			minY = std::min(minY, points[i].y);
+			maxY = std::max(maxY, points[i].y);
+		}
+		float dx = std::max(0.0f, std::max(minX - p.x, p.x - maxX));
+		float dy = std::max(0.0f, std::max(minY - p.y, p.y - maxY));
+		return std::sqrt(dx * dx + dy * dy);
+	}
+
+	static float distanceToSegment(sf::Vector2f p, sf::Vector2f a, sf::Vector2f b) {
+		sf::Vector2f ab = b - a;
+		float lengthSq = ab.x * ab.x + ab.y * ab.y;
+		float t = (lengthSq > 0) ? ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y) / lengthSq : 0.0f;
+		t = std::max(0.0f, std::min(1.0f, t));
+		return length(p - (a + ab * t));
+	}
+};
+
+// ============================================================================
+// FILL REGION CLASS (PAINT BUCKET RESULT)
+// ============================================================================
+// The pixels a flood fill reached, kept as row spans on a grid of 'cell'
+// world units whose top-left corner is 'origin'. Unrotated, each span is
+// one rectangle; rotated, the region's outline goes through the scan-line
+// filler, so it stays solid at any angle.
+class FillRegion final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::FILL;
+
+	sf::Vector2f origin;
+	float cell;
+	std::vector<Span> spans;   // cell rows and inclusive column ranges, sorted
+
+	FillRegion(sf::Vector2f topLeft, float cellSize, std::vector<Span> cells, sf::Color col)
+		: origin(topLeft), cell(cellSize), spans(std::move(cells)), columns(0), rows(0) {
+		color = col;
+		std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+			return a.y != b.y ? a.y < b.y : a.x0 < b.x0;
+		});
+
+		// Touching spans on a row become one, so rows never overlap
+		size_t kept = 0;
+		for (auto& s : spans) {
+			if (kept > 0 && spans[kept - 1].y == s.y && s.x0 <= spans[kept - 1].x1 + 1) {
+				spans[kept - 1].x1 = std::max(spans[kept - 1].x1, s.x1);
+				continue;
+			}
+			spans[kept++] = s;
+		}
+		spans.resize(kept);
+
+		for (auto& s : spans) {
+			columns = std::max(columns, s.x1 + 1);
+			rows = std::max(rows, s.y + 1);
+		}
+		pivot = origin + sf::Vector2f(columns * cell, rows * cell) / 2.0f;
+	}
+
+	// Screen spans from a fill made under 'view', moved to start at (0, 0)
+	static FillRegion fromScreen(std::vector<Span> screenSpans, const RasterView& view, sf::Color col) {
+		int left = std::numeric_limits<int>::max(), top = std::numeric_limits<int>::max();
+		for (auto& s : screenSpans) {
+			left = std::min(left, s.x0);
+			top = std::min(top, s.y);
+		}
+		for (auto& s : screenSpans) {
+			s.y -= top;
+			s.x0 -= left;
+			s.x1 -= left;
+		}
+		sf::Vector2f topLeft((left - view.offset.x) / view.zoom, (top - view.offset.y) / view.zoom);
+		return FillRegion(topLeft, 1.0f / view.zoom, std::move(screenSpans), col);
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		if (spans.empty()) return;
+		sf::FloatRect box = screenBox(view);
+		if (std::max(box.width, box.height) < LOD_DOT_SIZE + 2) {
+			pixels.plot(std::round(box.left), std::round(box.top), color);
+			return;
+		}
+
+		if (transform.rotation != 0) {
+			drawRotated(pixels, view);
+			return;
+		}
+
+		// Edges are rounded once per row and column boundary, so
+		// neighbouring spans meet without gaps or overlaps
+		sf::Vector2f at = view.toScreen(worldMatrix().transform(origin));
+		float dx = cell * transform.sx * view.zoom;
+		float dy = cell * transform.sy * view.zoom;
+		if (dy <= 0) return;
+
+		// Spans are sorted by row, so only the visible rows are visited
+		float firstRow = std::floor((view.screen.top - at.y) / dy) - 1;
+		float lastRow = std::ceil((view.screen.top + view.screen.height - at.y) / dy) + 1;
+		auto first = std::lower_bound(spans.begin(), spans.end(), firstRow,
+			[](const Span& s, float value) { return s.y < value; });
+		for (auto it = first; it != spans.end() && it->y <= lastRow; ++it) {
+			const Span& s = *it;
+			float top = std::round(at.y + s.y * dy);
+			float bottom = std::round(at.y + (s.y + 1) * dy);
+			if (bottom <= top || bottom < view.screen.top || top > view.screen.top + view.screen.height) continue;
+			float left = std::round(at.x + s.x0 * dx);
+			float right = std::round(at.x + (s.x1 + 1) * dx);
+			if (right > left) pixels.rect(left, top, right - left, bottom - top, color);
+		}
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		// Back into local coordinates, then into the cell grid
+		sf::Vector2f d = point - getCenter();
+		float cs = std::cos(transform.rotation), sn = std::sin(transform.rotation);
+		sf::Vector2f local(pivot.x + (cs * d.x + sn * d.y) / transform.sx,
+			pivot.y + (cs * d.y - sn * d.x) / transform.sy);
+		float fx = std::floor((local.x - origin.x) / cell);
+		float fy = std::floor((local.y - origin.y) / cell);
+		if (fx < 0 || fy < 0 || fx >= columns || fy >= rows) return false;
+		int x = static_cast<int>(fx), y = static_cast<int>(fy);
+
+		auto row = std::lower_bound(spans.begin(), spans.end(), y,
+			[](const Span& s, int value) { return s.y < value; });
+		for (; row != spans.end() && row->y == y; ++row) {
+			if (x >= row->x0 && x <= row->x1) return true;
+		}
+		return false;
+	}
+
+	sf::FloatRect getBounds() override {
+		corners(worldMatrix(), cornerCache);
+		return boundsOf(cornerCache);
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>&) {
+	}
+
+	std::string getInfo() override {
+		size_t cells = 0;
+		for (auto& s : spans) cells += s.x1 - s.x0 + 1;
+		std::stringstream ss;
+		ss << "Fill Region | Spans: " << spans.size() << " | Cells: " << cells
+			<< " | Cell: " << std::fixed << std::setprecision(2) << cell * transform.sx;
+		return ss.str();
+	}
+
+private:
+	int columns, rows;
+	std::vector<sf::Vector2f> cornerCache;
+	std::vector<std::pair<int, int>> events;
+	ScanlineFiller filler;
+	std::vector<Span> screenSpans;
+
+	void corners(const Matrix3x3& m, std::vector<sf::Vector2f>& out) const {
+		sf::Vector2f size(columns * cell, rows * cell);
+		out.resize(4);
+		out[0] = m.transform(origin);
+		out[1] = m.transform(origin + sf::Vector2f(size.x, 0));
+		out[2] = m.transform(origin + size);
+		out[3] = m.transform(origin + sf::Vector2f(0, size.y));
+	}
+
+	sf::FloatRect screenBox(const RasterView& view) {
+		corners(view.matrix().multiply(worldMatrix()), cornerCache);
+		return boundsOf(cornerCache);
+	}
+
+	// Edges shared by neighbouring spans would cancel, so only the outline
+	// is added: each span's two ends, and along each row boundary the
+	// stretches covered on one side only
+	void drawRotated(PixelBuffer& pixels, const RasterView& view) {
+		Matrix3x3 m = view.matrix().multiply(worldMatrix());
+		auto corner = [&](int x, int y) {
+			return m.transform(origin + sf::Vector2f(x * cell, y * cell));
+		};
+
+		filler.reset(view.plotClip());
+		const Span* end = spans.data() + spans.size();
+		const Span* above = nullptr;
+		const Span* aboveEnd = nullptr;
+		for (const Span* row = spans.data(); row != end;) {
+			const Span* rowEnd = row;
+			while (rowEnd != end && rowEnd->y == row->y) rowEnd++;
+			int y = row->y;
+
+			if (above && aboveEnd[-1].y == y - 1) {
+				addBoundary(above, aboveEnd, row, rowEnd, y, corner);
+			}
+			else {
+				if (above) addBoundary(above, aboveEnd, nullptr, nullptr, aboveEnd[-1].y + 1, corner);
+				addBoundary(nullptr, nullptr, row, rowEnd, y, corner);
+			}
+			for (const Span* s = row; s != rowEnd; s++) {
+				filler.addEdge(corner(s->x0, y + 1), corner(s->x0, y));
+				filler.addEdge(corner(s->x1 + 1, y), corner(s->x1 + 1, y + 1));
+			}
+			above = row;
+			aboveEnd = rowEnd;
+			row = rowEnd;
+		}
+		if (above) addBoundary(above, aboveEnd, nullptr, nullptr, aboveEnd[-1].y + 1, corner);
+
+		screenSpans.clear();
+		filler.fill(FillRule::NON_ZERO, screenSpans);
+		for (auto& s : screenSpans) pixels.span(s.y, s.x0, s.x1, color);
+	}
+
+	// Row y's top edge: covered below only runs right, covered above only
+	// runs left, matching the winding of the spans' own rectangles
+	template <typename C>
+	void addBoundary(const Span* above, const Span* aboveEnd, const Span* below, const Span* belowEnd,
+		int y, C& corner) {
+		events.clear();
+		for (; above != aboveEnd; above++) {
+			events.emplace_back(above->x0, 1);
+			events.emplace_back(above->x1 + 1, -1);
+		}
+		for (; below != belowEnd; below++) {
+			events.emplace_back(below->x0, 2);
+			events.emplace_back(below->x1 + 1, -2);
+		}
+		std::sort(events.begin(), events.end());
+
+		int inAbove = 0, inBelow = 0, from = 0;
+		for (auto& e : events) {
+			if (e.first != from) {
+				if (inBelow && !inAbove) filler.addEdge(corner(from, y), corner(e.first, y));
+				else if (inAbove && !inBelow) filler.addEdge(corner(e.first, y), corner(from, y));
+				from = e.first;
+			}
+			if (e.second == 1 || e.second == -1) inAbove += e.second;
+			else inBelow += e.second / 2;
+		}
+	}
+};
+
+// ============================================================================
+// SYMBOLS AND INSTANCES (SHARED GEOMETRY, CACHED SPRITES)
+// ============================================================================
+// A symbol owns its part shapes once, laid out about its origin; an
+// instance is only a transform and a colour. The symbol rasterizes itself
+// once per (scale, rotation) bucket into a sprite of runs around the
+// origin, and every instance in that bucket blits the sprite. Buckets are
+// fine enough that the symbol's rim is off by at most about half a pixel.
+class Instance;
+
+class Symbol {
+public:
+	std::string name;
+	sf::Color color;   // colour new instances start with
+
+	Symbol(std::string symbolName, sf::Color defaultColor)
+		: name(std::move(symbolName)), color(defaultColor), radius(0), id(nextId()), generation(0) {}
+
+	Symbol(const Symbol&) = delete;
+	Symbol& operator=(const Symbol&) = delete;
+
+	// Part in symbol-local coordinates, origin at (0, 0)
+	template <typename T>
+	void addPart(T part) {
+		hideMarkers(part);
+		sf::FloatRect box = part.getBounds();
+		float x = std::max(std::abs(box.left), std::abs(box.left + box.width));
+		float y = std::max(std::abs(box.top), std::abs(box.top + box.height));
+		radius = std::max(radius, std::sqrt(x * x + y * y) + part.strokeReach());
+		std::get<std::vector<T>>(parts).push_back(std::move(part));
+	}
+
+	// Symbols do not nest: an instance adds copies of its symbol's parts
+	void addPart(Instance instance);
+
+	// Distance from the origin to the farthest part pixel
+	float extent() const {
+		return radius;
+	}
+
+	template <typename F>
+	void forEachPart(F&& f) {
+		for (auto& part : std::get<std::vector<Line>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<Circle>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<Ellipse>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<Polygon>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<BezierCurve>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<FillRegion>>(parts)) f(part);
+		for (auto& part : std::get<std::vector<SplineCurve>>(parts)) f(part);
+	}
+
+	bool containsPoint(sf::Vector2f local) {
+		bool hit = false;
+		forEachPart([&](auto& part) {
+			if (!hit && part.containsPoint(local)) hit = true;
+		});
+		return hit;
+	}
+
+	// Sprite for the bucket nearest the given rotation (radians) and
+	// pixels-per-unit scale, anti-aliased or not. Safe to call from
+	// rasterization workers.
+	const PixelBuffer& sprite(float rotation, float pixelScale, bool antialias) {
+		// Scale in whole pixels of radius; rotation in steps of about one
+		// pixel of travel at the rim
+		std::uint32_t rim = static_cast<std::uint32_t>(std::max(1.0f, std::round(radius * pixelScale)));
+		std::uint32_t turns = static_cast<std::uint32_t>(std::ceil(2 * PI * rim));
+		if (turns < 16) turns = 16;
+		if (turns > MAX_TURNS) turns = MAX_TURNS;
+		float turn = rotation / (2 * PI);
+		turn -= std::floor(turn);
+		std::uint32_t step = static_cast<std::uint32_t>(std::lround(turn * turns)) % turns;
+		std::uint64_t key = (static_cast<std::uint64_t>(rim) << 33) | (static_cast<std::uint64_t>(antialias) << 32) | step;
+
+		// Neighbouring instances nearly always share a sprite, so each
+		// thread remembers its last one and skips the lock
+		struct Lookup {
+			unsigned int id, generation;
+			std::uint64_t key;
+			const PixelBuffer* sprite;
+		};
+		thread_local Lookup last = { 0, 0, 0, nullptr };
+		if (last.sprite && last.id == id && last.generation == generation && last.key == key) {
+			return *last.sprite;
+		}
+
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto found = sprites.find(key);
+		if (found == sprites.end()) {
+			float scale = (radius > 0) ? rim / radius : pixelScale;
+			found = sprites.emplace(key, render(step * 2 * PI / turns, scale, antialias)).first;
+		}
+		last = Lookup{ id, generation, key, &found->second };
+		return found->second;
+	}
+
+	// Drops the cached sprites once too many scales have piled up (zooming
+	// makes new ones). Only call while no rasterization is running.
+	void trimCache() {
+		if (sprites.size() <= MAX_SPRITES) return;
+		sprites.clear();
+		generation++;
+	}
+
+private:
+	static const size_t MAX_SPRITES = 64;
+	static const std::uint32_t MAX_TURNS = 4096;
+
+	std::tuple<std::vector<Line>, std::vector<Circle>, std::vector<Ellipse>,
+		std::vector<Polygon>, std::vector<BezierCurve>, std::vector<FillRegion>,
+		std::vector<SplineCurve>> parts;
+	float radius;
+	unsigned int id;
+	unsigned int generation;   // bumped when cached sprites are dropped
+	std::mutex cacheMutex;
+	std::unordered_map<std::uint64_t, PixelBuffer> sprites;
+
+	static unsigned int nextId() {
+		static std::atomic<unsigned int> counter(1);
+		return counter++;
+	}
+
+	// Control-point markers are an editing aid, not part of the symbol
+	static void hideMarkers(Shape&) {}
+	static void hideMarkers(BezierCurve& curve) { curve.showControlPoints = false; }
+	static void hideMarkers(SplineCurve& curve) { curve.showControlPoints = false; }
+
+	// Turns the part by 'angle' radians and scales it about the origin,
+	// then moves the origin to 'at'
+	template <typename T>
+	static void place(T& part, float angle, float scale, sf::Vector2f at) {
+		float cs = std::cos(angle), sn = std::sin(angle);
+		sf::Vector2f c = part.getCenter();
+		sf::Vector2f moved(at.x + scale * (c.x * cs - c.y * sn), at.y + scale * (c.x * sn + c.y * cs));
+		part.rotate(angle * 180.0f / PI);
+		part.scale(scale);
+		part.translate(moved.x - c.x, moved.y - c.y);
+	}
+
+	// Draws placed copies of the parts with the usual shape algorithms. The
+	// sprite is centred on (0, 0), so the view's clip is the symbol's extent.
+	// Parts go in opaque: an instance draws every run in its own colour, at
+	// the alpha coverage gave the run.
+	PixelBuffer render(float angle, float scale, bool antialias) {
+		PixelBuffer buffer;
+		RasterView view;
+		view.antialias = antialias;
+		float reach = radius * scale + 2;
+		view.screen = sf::FloatRect(-reach, -reach, 2 * reach, 2 * reach);
+		forEachPart([&](const auto& part) {
+			auto placed = part;
+			placed.color.a = 255;
+			place(placed, angle, scale, sf::Vector2f(0, 0));
+			placed.draw(buffer, view);
+		});
+		return buffer;
+	}
+};
+
+class Instance final : public Shape {
+public:
+	static const ShapeKind KIND = ShapeKind::INSTANCE;
+
+	std::shared_ptr<Symbol> symbol;
+
+	// The pivot stays at the symbol origin, so the translation is the
+	// instance's position
+	Instance(std::shared_ptr<Symbol> sym, sf::Vector2f position, sf::Color col)
+		: symbol(std::move(sym)) {
+		color = col;
+		transform.tx = position.x;
+		transform.ty = position.y;
+	}
+
+	void draw(PixelBuffer& pixels, const RasterView& view) override {
+		sf::Vector2f origin = view.toScreen(getCenter());
+		float pixelScale = view.zoom * transform.sx;
+		if (symbol->extent() * pixelScale < LOD_DOT_SIZE) {
+			pixels.plot(std::round(origin.x), std::round(origin.y), color);
+			return;
+		}
+		const PixelBuffer& sprite = symbol->sprite(transform.rotation, pixelScale, view.antialias);
+		float dx = std::round(origin.x), dy = std::round(origin.y);
+
+		// Sprites cut by the view edge copy only the runs inside it
+		float reach = symbol->extent() * pixelScale + 2;
+		const sf::FloatRect& screen = view.screen;
+		if (dx - reach < screen.left || dy - reach < screen.top ||
+			dx + reach > screen.left + screen.width || dy + reach > screen.top + screen.height) {
+			pixels.blit(sprite, dx, dy, color, screen);
+			return;
+		}
+		pixels.blit(sprite, dx, dy, color);
+	}
+
+	bool containsPoint(sf::Vector2f point) override {
+		// Back into symbol-local coordinates
+		sf::Vector2f d = point - getCenter();
+		float cs = std::cos(transform.rotation), sn = std::sin(transform.rotation);
+		sf::Vector2f local((cs * d.x + sn * d.y) / transform.sx, (cs * d.y - sn * d.x) / transform.sy);
+		return symbol->containsPoint(local);
+	}
+
+	// Rotation-independent square around the symbol's extent
+	sf::FloatRect getBounds() override {
+		sf::Vector2f c = getCenter();
+		float r = symbol->extent() * std::max(transform.sx, transform.sy);
+		return sf::FloatRect(c.x - r, c.y - r, 2 * r, 2 * r);
+	}
+
+	void snapPoints(std::vector<sf::Vector2f>& out) {
+		out.push_back(getCenter());
+	}
+
+	std::string getInfo() override {
+		std::stringstream ss;
+		sf::Vector2f c = getCenter();
+		ss << "Instance of " << symbol->name << " | Pos: (" << std::fixed << std::setprecision(1)
+			<< c.x << ", " << c.y << ") | Angle: " << transform.rotation * 180.0f / PI
+			<< " | Scale: " << std::setprecision(2) << transform.sx;
+		return ss.str();
+	}
+};
+
+void Symbol::addPart(Instance instance) {
+	instance.symbol->forEachPart([&](const auto& source) {
+		auto part = source;
+		place(part, instance.transform.rotation, instance.transform.sx, instance.getCenter());
+		part.color = instance.color;
+		addPart(std::move(part));
+	});
+}
+
+// ============================================================================
+// WORKER POOL (PARALLEL RASTERIZATION)
+// ============================================================================
+// Persistent threads that split an indexed job; the calling thread works too.
+class WorkerPool {
+public:
+	explicit WorkerPool(unsigned int threadCount = std::thread::hardware_concurrency())
+		: job(nullptr), jobCount(0), nextTask(0), busy(0), generation(0), stopping(false) {
+		for (unsigned int i = 1; i < threadCount; i++) {
+			workers.emplace_back(&WorkerPool::workerLoop, this);
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : workers) t.join();
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	unsigned int size() const {
+		return static_cast<unsigned int>(workers.size()) + 1;
+	}
+
+	// Runs task(i) for every i in [0, count) and returns when all are done
+	void run(int count, const std::function<void(int)>& task) {
+		if (count <= 0) return;
+		if (workers.empty() || count == 1) {
+			for (int i = 0; i < count; i++) task(i);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &task;
+			jobCount = count;
+			nextTask = 0;
+			busy = static_cast<int>(workers.size());
+			generation++;
+		}
+		wake.notify_all();
+		drain();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busy == 0; });
+		job = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const std::function<void(int)>* job;
+	int jobCount;
+	std::atomic<int> nextTask;
+	int busy;
+	unsigned long long generation;
+	bool stopping;
+
+	void drain() {
+		for (;;) {
+			int i = nextTask++;
+			if (i >= jobCount) break;
+			(*job)(i);
+		}
+	}
+
+	void workerLoop() {
+		unsigned long long seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+			}
+			drain();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busy == 0) done.notify_one();
+			}
+		}
+	}
+};
+
+// ============================================================================
+// SCENE STORE (PER-KIND POOLS WITH STABLE HANDLES)
+// ============================================================================
+// Shapes are stored by value in one contiguous pool per kind instead of one
+// heap allocation each. A handle names a slot in the slot table; the slot's
+// generation is bumped on delete so stale handles are detected, not reused.
+struct ShapeHandle {
+	static const unsigned int NONE = 0xFFFFFFFFu;
+
+	unsigned int slot;
+	unsigned int generation;
+
+	ShapeHandle() : slot(NONE), generation(0) {}
+	ShapeHandle(unsigned int s, unsigned int g) : slot(s), generation(g) {}
+
+	bool isNull() const { return slot == NONE; }
+	bool operator==(const ShapeHandle& other) const {
+		return slot == other.slot && generation == other.generation;
+	}
+	bool operator!=(const ShapeHandle& other) const { return !(*this == other); }
+};
+
+// ============================================================================
+// SNAP INDEX (UNIFORM HASH GRID)
+// ============================================================================
+// Snap candidates (endpoints, vertices, centres, control points) bucketed by
+// world cell. Updates are O(points of the shape): a shape's old entries are
+// retired by bumping its slot's version and skipped by queries, and the
+// grid is rebuilt once retired entries outnumber live ones.
+class SnapIndex {
+public:
+	SnapIndex() : live(0), stale(0) {}
+
+	void insert(unsigned int slot, const std::vector<sf::Vector2f>& points) {
+		if (slot >= versions.size()) {
+			versions.resize(slot + 1, 0);
+			counts.resize(slot + 1, 0);
+		}
+		for (auto& p : points) {
+			cells[keyOf(cellOf(p.x), cellOf(p.y))].push_back(Entry{ p, slot, versions[slot] });
+		}
+		counts[slot] += static_cast<unsigned int>(points.size());
+		live += points.size();
+	}
+
+	// Retires every point currently filed for the slot
+	void retire(unsigned int slot) {
+		if (slot >= versions.size()) return;
+		versions[slot]++;
+		stale += counts[slot];
+		live -= counts[slot];
+		counts[slot] = 0;
+	}
+
+	void clear() {
+		cells.clear();
+		std::fill(counts.begin(), counts.end(), 0u);
+		for (auto& version : versions) version++;
+		live = 0;
+		stale = 0;
+	}
+
+	bool needsRebuild() const {
+		return stale > live + 1024;
+	}
+
+	// Nearest candidate within 'radius'. Cells are visited in growing rings
+	// and the search stops once a ring cannot hold anything closer. The reach
+	// is capped at MAX_RING cells so zooming far out cannot turn a query into
+	// a walk over thousands of empty cells.
+	bool nearest(sf::Vector2f point, float radius, sf::Vector2f& result) const {
+		radius = std::min(radius, MAX_RING * SNAP_CELL);
+		int cx = cellOf(point.x), cy = cellOf(point.y);
+		int maxRing = static_cast<int>(std::ceil(radius / SNAP_CELL));
+		float bestSq = radius * radius;
+		bool found = false;
+
+		for (int ring = 0; ring <= maxRing; ring++) {
+			float reach = (ring - 1) * SNAP_CELL;
+			if (ring > 1 && reach * reach > bestSq) break;
+
+			for (int y = cy - ring; y <= cy + ring; y++) {
+				// Interior rows only need the two ends of the ring
+				bool edgeRow = (y == cy - ring || y == cy + ring);
+				int step = edgeRow ? 1 : std::max(1, 2 * ring);
+				for (int x = cx - ring; x <= cx + ring; x += step) {
+					auto cell = cells.find(keyOf(x, y));
+					if (cell == cells.end()) continue;
+					for (const Entry& e : cell->second) {
+						if (e.version != versions[e.slot]) continue;
+						float dx = e.point.x - point.x, dy = e.point.y - point.y;
+						float d = dx * dx + dy * dy;
+						if (d <= bestSq) {
+							bestSq = d;
+							result = e.point;
+							found = true;
+						}
+					}
+				}
+			}
+		}
+		return found;
+	}
+
+private:
+	static const int MAX_RING = 16;
+
+	struct Entry {
+		sf::Vector2f point;
+		unsigned int slot;
+		unsigned int version;
+	};
+
+	std::unordered_map<std::uint64_t, std::vector<Entry>> cells;
+	std::vector<unsigned int> versions;   // per scene slot
+	std::vector<unsigned int> counts;     // live points per scene slot
+	size_t live;
+	size_t stale;
+
+	static int cellOf(float v) {
+		return static_cast<int>(std::floor(v / SNAP_CELL));
+	}
+
+	static std::uint64_t keyOf(int x, int y) {
+		return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) |
+			static_cast<std::uint32_t>(y);
+	}
+};
+
+template <typename T>
+struct ShapePool {
+	std::vector<T> items;
+	std::vector<unsigned int> slotOf;   // back-reference into the slot table
+
+	// Pick bounds as structure-of-arrays so rejection touches only floats
+	std::vector<float> minX, minY, maxX, maxY;
+
+	unsigned int push(T&& shape, unsigned int slot) {
+		items.push_back(std::move(shape));
+		slotOf.push_back(slot);
+		minX.push_back(0); minY.push_back(0);
+		maxX.push_back(0); maxY.push_back(0);
+		unsigned int index = static_cast<unsigned int>(items.size() - 1);
+		updateBounds(index);
+		return index;
+	}
+
+	// Swap-and-pop; returns the slot whose item moved into 'index', or NONE
+	unsigned int erase(unsigned int index) {
+		unsigned int last = static_cast<unsigned int>(items.size() - 1);
+		unsigned int moved = ShapeHandle::NONE;
+		if (index != last) {
+			items[index] = std::move(items[last]);
+			slotOf[index] = slotOf[last];
+			minX[index] = minX[last]; minY[index] = minY[last];
+			maxX[index] = maxX[last]; maxY[index] = maxY[last];
+			moved = slotOf[index];
+		}
+		items.pop_back();
+		slotOf.pop_back();
+		minX.pop_back(); minY.pop_back();
+		maxX.pop_back(); maxY.pop_back();
+		return moved;
+	}
+
+	void updateBounds(unsigned int index) {
+		sf::FloatRect box = items[index].getBounds();
+
+		// Pad by the hit tolerance and by whatever the stroke paints past
+		// the path, so culling and damage cover wide strokes too
+		float pad = SELECTION_THRESHOLD + items[index].strokeReach();
+		minX[index] = box.left - pad;
+		minY[index] = box.top - pad;
+		maxX[index] = box.left + box.width + pad;
+		maxY[index] = box.top + box.height + pad;
+	}
+
+	void reserve(size_t count) {
+		items.reserve(count);
+		slotOf.reserve(count);
+		minX.reserve(count); minY.reserve(count);
+		maxX.reserve(count); maxY.reserve(count);
+	}
+
+	void clear() {
+		items.clear();
+		slotOf.clear();
+		minX.clear(); minY.clear();
+		maxX.clear(); maxY.clear();
+	}
+};
+
+// Shapes taken out of a scene by value, with what is needed to put each
+// back exactly: the same handle, layer and creation serial
+struct ShapeBin {
+	struct Entry {
+		ShapeHandle handle;
+		ShapeKind kind;
+		unsigned char layer;
+		unsigned long long serial;
+		unsigned int index;   // into the kind's vector
+	};
+
+	std::vector<Entry> entries;
+	std::tuple<std::vector<Line>, std::vector<Circle>, std::vector<Ellipse>,
+		std::vector<Polygon>, std::vector<BezierCurve>, std::vector<Instance>,
+		std::vector<FillRegion>, std::vector<SplineCurve>> shapes;
+
+	template <typename T>
+	void add(ShapeHandle handle, unsigned char layer, unsigned long long serial, T shape) {
+		std::vector<T>& kept = std::get<std::vector<T>>(shapes);
+		entries.push_back(Entry{ handle, T::KIND, layer, serial, static_cast<unsigned int>(kept.size()) });
+		kept.push_back(std::move(shape));
+	}
+
+	Shape& shapeAt(const Entry& e) {
+		switch (e.kind) {
+		case ShapeKind::LINE: return std::get<std::vector<Line>>(shapes)[e.index];
+		case ShapeKind::CIRCLE: return std::get<std::vector<Circle>>(shapes)[e.index];
+		case ShapeKind::ELLIPSE: return std::get<std::vector<Ellipse>>(shapes)[e.index];
+		case ShapeKind::POLYGON: return std::get<std::vector<Polygon>>(shapes)[e.index];
+		case ShapeKind::BEZIER: return std::get<std::vector<BezierCurve>>(shapes)[e.index];
+		case ShapeKind::FILL: return std::get<std::vector<FillRegion>>(shapes)[e.index];
+		case ShapeKind::SPLINE: return std::get<std::vector<SplineCurve>>(shapes)[e.index];
+		default: return std::get<std::vector<Instance>>(shapes)[e.index];
+		}
+	}
+
+	// Rough heap footprint, for the undo memory budget
+	size_t bytes() const {
+		size_t total = entries.capacity() * sizeof(Entry);
+		total += std::get<std::vector<Line>>(shapes).capacity() * sizeof(Line);
+		total += std::get<std::vector<Circle>>(shapes).capacity() * sizeof(Circle);
+		total += std::get<std::vector<Ellipse>>(shapes).capacity() * sizeof(Ellipse);
+		total += std::get<std::vector<Instance>>(shapes).capacity() * sizeof(Instance);
+		for (auto& polygon : std::get<std::vector<Polygon>>(shapes)) {
+			total += sizeof(Polygon) + polygon.vertices.capacity() * sizeof(sf::Vector2f) +
+				polygon.holes.capacity() * sizeof(unsigned int);
+		}
+		for (auto& curve : std::get<std::vector<BezierCurve>>(shapes)) {
+			total += sizeof(BezierCurve) + curve.controlPoints.capacity() * sizeof(sf::Vector2f);
+		}
+		for (auto& fill : std::get<std::vector<FillRegion>>(shapes)) {
+			total += sizeof(FillRegion) + fill.spans.capacity() * sizeof(Span);
+		}
+		for (auto& curve : std::get<std::vector<SplineCurve>>(shapes)) {
+			total += sizeof(SplineCurve) + curve.controlPoints.capacity() * sizeof(sf::Vector2f) +
+				curve.weights.capacity() * sizeof(float);
+		}
+		return total;
+	}
+
+	void clear() {
+		entries.clear();
+		std::get<std::vector<Line>>(shapes).clear();
+		std::get<std::vector<Circle>>(shapes).clear();
+		std::get<std::vector<Ellipse>>(shapes).clear();
+		std::get<std::vector<Polygon>>(shapes).clear();
+		std::get<std::vector<BezierCurve>>(shapes).clear();
+		std::get<std::vector<Instance>>(shapes).clear();
+		std::get<std::vector<FillRegion>>(shapes).clear();
+		std::get<std::vector<SplineCurve>>(shapes).clear();
+	}
+};
+
+// Shapes live on named layers, drawn bottom to top; within a layer the
+// painter's order is creation order. Hidden and locked layers cannot be
+// picked or selected.
+class Scene {
+public:
+	static const int ALL_LAYERS = -1;   // every visible layer, for rasterizing
+
+	struct Layer {
+		std::string name;
+		bool visible;
+		bool locked;
+	};
+
+	Scene() : active(0), liveCount(0), nextSerial(0) {
+		resetLayers();
+	}
+
+	template <typename T>
+	ShapeHandle add(T shape) {
+		ShapePool<T>& pool = poolFor<T>();
+		unsigned int slot = allocateSlot();
+		Slot& s = slots[slot];
+		s.kind = T::KIND;
+		s.layer = static_cast<unsigned char>(active);
+		s.serial = nextSerial++;
+		s.dense = pool.push(std::move(shape), slot);
+
+		ShapeHandle handle(slot, s.generation);
+		orders[active].handles.push_back(handle);
+		liveCount++;
+		fileSnapPoints(slot);
+		return handle;
+	}
+
+	bool isValid(ShapeHandle handle) const {
+		return handle.slot < slots.size() && slots[handle.slot].alive &&
+			slots[handle.slot].generation == handle.generation;
+	}
+
+	// Pointer is only valid until the next add/remove
+	Shape* get(ShapeHandle handle) {
+		if (!isValid(handle)) return nullptr;
+		Shape* result = nullptr;
+		const Slot& s = slots[handle.slot];
+		visit(s.kind, [&](auto& pool) { result = &pool.items[s.dense]; });
+		return result;
+	}
+
+	// Call after transforming a shape so its pick bounds and snap points
+	// follow it
+	void touch(ShapeHandle handle) {
+		if (!isValid(handle)) return;
+		const Slot& s = slots[handle.slot];
+		visit(s.kind, [&](auto& pool) { pool.updateBounds(s.dense); });
+		snapIndex.retire(handle.slot);
+		fileSnapPoints(handle.slot);
+		if (snapIndex.needsRebuild()) rebuildSnapIndex();
+	}
+
+	// Nearest snap candidate within 'radius' world units of the point.
+	// Shapes moved by group transforms are re-filed here, once, rather
+	// than on every frame of a drag.
+	bool snap(sf::Vector2f point, float radius, sf::Vector2f& result) {
+		if (!snapPending.empty()) flushSnapPoints();
+		return snapIndex.nearest(point, radius, result);
+	}
+
+	// ---- Multi-selection ----
+
+	// Shapes inside a world box. A window selection wants the whole shape
+	// inside; a crossing selection takes anything the box touches.
+	void queryBox(sf::FloatRect box, bool crossing, std::vector<ShapeHandle>& out) {
+		const float x0 = box.left, y0 = box.top;
+		const float x1 = box.left + box.width, y1 = box.top + box.height;
+		const float pad = SELECTION_THRESHOLD;   // pick bounds carry the hit padding
+
+		forEachPool([&](auto& pool) {
+			for (size_t i = 0; i < pool.items.size(); i++) {
+				bool hit = crossing ?
+					(pool.maxX[i] - pad >= x0 && pool.minX[i] + pad <= x1 &&
+						pool.maxY[i] - pad >= y0 && pool.minY[i] + pad <= y1) :
+					(pool.minX[i] + pad >= x0 && pool.maxX[i] - pad <= x1 &&
+						pool.minY[i] + pad >= y0 && pool.maxY[i] - pad <= y1);
+				if (hit && selectable(slots[pool.slotOf[i]])) out.push_back(handleAt(pool, i));
+			}
+		});
+	}
+
+	// Shapes whose centre lies inside the closed lasso polygon. The lasso's
+	// box rejects most shapes on bounds alone.
+	void queryLasso(const std::vector<sf::Vector2f>& lasso, std::vector<ShapeHandle>& out) {
+		if (lasso.size() < 3) return;
+		float x0 = lasso[0].x, y0 = lasso[0].y, x1 = x0, y1 = y0;
+		for (auto& p : lasso) {
+			x0 = std::min(x0, p.x); y0 = std::min(y0, p.y);
+			x1 = std::max(x1, p.x); y1 = std::max(y1, p.y);
+		}
+
+		forEachPool([&](auto& pool) {
+			for (size_t i = 0; i < pool.items.size(); i++) {
+				if (pool.maxX[i] < x0 || pool.minX[i] > x1 ||
+					pool.maxY[i] < y0 || pool.minY[i] > y1) continue;
+				if (!selectable(slots[pool.slotOf[i]])) continue;
+				if (insideLasso(lasso, pool.items[i].getCenter())) {
+					out.push_back(handleAt(pool, i));
+				}
+			}
+		});
+	}
+
+	// World box around the group's pick bounds
+	sf::FloatRect groupBounds(const std::vector<ShapeHandle>& group) {
+		float minX = 0, minY = 0, maxX = 0, maxY = 0;
+		bool any = false;
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			if (!any) {
+				minX = pool.minX[d]; minY = pool.minY[d];
+				maxX = pool.maxX[d]; maxY = pool.maxY[d];
+				any = true;
+				return;
+			}
+			minX = std::min(minX, pool.minX[d]); minY = std::min(minY, pool.minY[d]);
+			maxX = std::max(maxX, pool.maxX[d]); maxY = std::max(maxY, pool.maxY[d]);
+		});
+		return sf::FloatRect(minX, minY, maxX - minX, maxY - minY);
+	}
+
+	// Group transforms work one pool at a time on the concrete type. Only
+	// each shape's retained transform changes, never its vertices, so the
+	// cost is O(shapes) however large the shapes are. A translation also
+	// shifts the pick bounds in place instead of recomputing them.
+	void translateGroup(const std::vector<ShapeHandle>& group, sf::Vector2f delta) {
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			pool.items[d].translate(delta.x, delta.y);
+			pool.minX[d] += delta.x; pool.maxX[d] += delta.x;
+			pool.minY[d] += delta.y; pool.maxY[d] += delta.y;
+		});
+		deferSnapPoints(group);
+	}
+
+	// Each shape turns in place and its centre swings about the pivot
+	void rotateGroup(const std::vector<ShapeHandle>& group, float angleDegrees, sf::Vector2f pivot) {
+		float angleRad = angleDegrees * PI / 180.0f;
+		float cs = std::cos(angleRad), sn = std::sin(angleRad);
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			auto& shape = pool.items[d];
+			sf::Vector2f c = shape.getCenter();
+			sf::Vector2f r = c - pivot;
+			shape.rotate(angleDegrees);
+			shape.translate(pivot.x + r.x * cs - r.y * sn - c.x, pivot.y + r.x * sn + r.y * cs - c.y);
+			pool.updateBounds(d);
+		});
+		deferSnapPoints(group);
+	}
+
+	// Copies the group into a new symbol whose origin is 'origin'
+	std::shared_ptr<Symbol> makeSymbol(const std::vector<ShapeHandle>& group, sf::Vector2f origin,
+		const std::string& name) {
+		std::shared_ptr<Symbol> symbol;
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			auto part = pool.items[d];
+			if (!symbol) symbol = std::make_shared<Symbol>(name, part.color);
+			part.translate(-origin.x, -origin.y);
+			symbol->addPart(std::move(part));
+		});
+		return symbol;
+	}
+
+	// Every distinct symbol placed in the scene
+	void symbolsInUse(std::vector<std::shared_ptr<Symbol>>& out) {
+		const Symbol* previous = nullptr;
+		for (auto& instance : poolFor<Instance>().items) {
+			if (instance.symbol.get() == previous) continue;
+			previous = instance.symbol.get();
+			if (std::find(out.begin(), out.end(), instance.symbol) == out.end()) out.push_back(instance.symbol);
+		}
+	}
+
+	void scaleGroup(const std::vector<ShapeHandle>& group, float factor, sf::Vector2f pivot) {
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			auto& shape = pool.items[d];
+			sf::Vector2f c = shape.getCenter();
+			shape.scale(factor);
+			shape.translate((c.x - pivot.x) * (factor - 1), (c.y - pivot.y) * (factor - 1));
+			pool.updateBounds(d);
+		});
+		deferSnapPoints(group);
+	}
+
+	// A wider stroke reaches further, so the pick bounds follow it.
+	// Instances draw their symbol's own strokes and fills have no outline,
+	// so both are left alone.
+	void setStroke(const std::vector<ShapeHandle>& group, const StrokeStyle& style) {
+		forEachMember(group, [&](auto& pool, unsigned int d) {
+			ShapeKind kind = std::decay_t<decltype(pool.items[d])>::KIND;
+			if (kind == ShapeKind::INSTANCE || kind == ShapeKind::FILL) return;
+			pool.items[d].stroke = style;
+			pool.updateBounds(d);
+		});
+	}
+
+	// Screen area a shape covers under the given view, for damage tracking.
+	// Padded for the 2x2 plot size and the fixed-size control-point markers.
+	sf::FloatRect screenBounds(ShapeHandle handle, const RasterView& view) {
+		if (!isValid(handle)) return sf::FloatRect();
+		sf::FloatRect result;
+		const Slot& s = slots[handle.slot];
+		visit(s.kind, [&](auto& pool) {
+			unsigned int d = s.dense;
+			sf::Vector2f a = view.toScreen(sf::Vector2f(pool.minX[d], pool.minY[d]));
+			sf::Vector2f b = view.toScreen(sf::Vector2f(pool.maxX[d], pool.maxY[d]));
+			result = sf::FloatRect(a.x - 4, a.y - 4, b.x - a.x + 8, b.y - a.y + 8);
+		});
+		return result;
+	}
+
+	void remove(ShapeHandle handle) {
+		if (!isValid(handle)) return;
+		Slot& s = slots[handle.slot];
+		LayerOrder& layerOrder = orders[s.layer];
+		visit(s.kind, [&](auto& pool) {
+			unsigned int moved = pool.erase(s.dense);
+			if (moved != ShapeHandle::NONE) slots[moved].dense = s.dense;
+		});
+
+		s.alive = false;
+		s.generation++;
+		freeSlots.push_back(handle.slot);
+		liveCount--;
+		snapIndex.retire(handle.slot);
+		if (snapIndex.needsRebuild()) rebuildSnapIndex();
+
+		// Draw order is compacted lazily so deletion stays O(1) amortized
+		if (++layerOrder.stale > layerOrder.handles.size() / 2) compactOrder(s.layer);
+	}
+
+	void clear() {
+		for (unsigned int i = 0; i < slots.size(); i++) {
+			if (!slots[i].alive) continue;
+			slots[i].alive = false;
+			slots[i].generation++;
+			freeSlots.push_back(i);
+		}
+		forEachPool([](auto& pool) { pool.clear(); });
+		snapIndex.clear();
+		for (auto& layerOrder : orders) {
+			layerOrder.handles.clear();
+			layerOrder.stale = 0;
+		}
+		liveCount = 0;
+	}
+
+	// ---- Layers ----
+
+	// Back to a single empty layer; only for an empty scene
+	void resetLayers() {
+		layers.assign(1, Layer{ "Layer 1", true, false });
+		orders.assign(1, LayerOrder());
+		active = 0;
+	}
+
+	// Appends a layer on top; returns its index, or -1 when full
+	int addLayer(const std::string& name) {
+		if (layers.size() >= MAX_LAYERS) return -1;
+		layers.push_back(Layer{ name, true, false });
+		orders.push_back(LayerOrder());
+		return static_cast<int>(layers.size() - 1);
+	}
+
+	int layerCount() const {
+		return static_cast<int>(layers.size());
+	}
+
+	Layer& layer(int index) {
+		return layers[index];
+	}
+
+	// New shapes go on the active layer
+	int activeLayer() const {
+		return active;
+	}
+
+	void setActiveLayer(int index) {
+		if (index >= 0 && index < layerCount()) active = index;
+	}
+
+	int layerOf(ShapeHandle handle) const {
+		return isValid(handle) ? slots[handle.slot].layer : 0;
+	}
+
+	// Bit i is set when a member sits on layer i
+	std::uint32_t layersOf(const std::vector<ShapeHandle>& group) const {
+		std::uint32_t mask = 0;
+		for (const ShapeHandle& handle : group) {
+			if (isValid(handle)) mask |= 1u << slots[handle.slot].layer;
+		}
+		return mask;
+	}
+
+	// Moves the group to the top of 'index', keeping its relative order
+	void moveToLayer(const std::vector<ShapeHandle>& group, int index) {
+		if (index < 0 || index >= layerCount()) return;
+		std::vector<ShapeHandle> moved;
+		std::uint32_t sources = 0;
+		for (const ShapeHandle& handle : group) {
+			if (!isValid(handle) || slots[handle.slot].layer == index) continue;
+			sources |= 1u << slots[handle.slot].layer;
+			slots[handle.slot].layer = static_cast<unsigned char>(index);
+			moved.push_back(handle);
+		}
+		for (int l = 0; l < layerCount(); l++) {
+			if (sources & (1u << l)) compactOrder(l);
+		}
+
+		std::sort(moved.begin(), moved.end(), [this](const ShapeHandle& a, const ShapeHandle& b) {
+			return slots[a.slot].serial < slots[b.slot].serial;
+		});
+		auto& handles = orders[index].handles;
+		handles.insert(handles.end(), moved.begin(), moved.end());
+	}
+
+	// ---- Undo support ----
+	// Edits are undone by handing back exactly what they changed, so each
+	// of these costs O(group), not O(scene).
+
+	// Every live shape in painter's order
+	void handles(std::vector<ShapeHandle>& out) {
+		for (int l = 0; l < layerCount(); l++) {
+			for (const ShapeHandle& handle : orders[l].handles) {
+				if (isValid(handle)) out.push_back(handle);
+			}
+		}
+	}
+
+	// Moves the group's shapes out of the scene into the bin
+	void takeOut(const std::vector<ShapeHandle>& group, ShapeBin& bin) {
+		for (const ShapeHandle& handle : group) {
+			if (!isValid(handle)) continue;
+			const Slot& s = slots[handle.slot];
+			visit(s.kind, [&](auto& pool) {
+				pool.items[s.dense].isSelected = false;
+				bin.add(handle, s.layer, s.serial, std::move(pool.items[s.dense]));
+			});
+			remove(handle);
+		}
+	}
+
+	// Puts the bin's shapes back under their old handles and serials, each
+	// into its old layer at its place in creation order, and empties it.
+	// Slots and layers the scene lacks are created, for journal replay.
+	void putBack(ShapeBin& bin) {
+		for (auto& e : bin.entries) {
+			if (e.handle.slot >= slots.size()) growSlots(e.handle.slot + 1);
+			while (e.layer >= layerCount() && addLayer("Layer " + std::to_string(layerCount() + 1)) >= 0) {}
+			nextSerial = std::max(nextSerial, e.serial + 1);
+		}
+
+		// Stale copies of these handles in the draw order must not revive
+		std::uint32_t touched = 0;
+		for (auto& e : bin.entries) touched |= 1u << e.layer;
+		for (int l = 0; l < layerCount(); l++) {
+			if (touched & (1u << l)) compactOrder(l);
+		}
+
+		std::vector<ShapeHandle> revived[MAX_LAYERS];
+		for (auto& e : bin.entries) {
+			Slot& s = slots[e.handle.slot];
+			if (s.alive || e.layer >= layerCount()) continue;   // a linear history never does this
+			visit(e.kind, [&](auto& pool) {
+				using T = typename std::decay<decltype(pool.items[0])>::type;
+				std::vector<T>& kept = std::get<std::vector<T>>(bin.shapes);
+				s.dense = pool.push(std::move(kept[e.index]), e.handle.slot);
+			});
+			s.kind = e.kind;
+			s.layer = e.layer;
+			s.alive = true;
+			s.generation = e.handle.generation;
+			s.serial = e.serial;
+			revived[e.layer].push_back(e.handle);
+			liveCount++;
+			fileSnapPoints(e.handle.slot);
+		}
+		if (snapIndex.needsRebuild()) rebuildSnapIndex();
+
+		freeSlots.erase(std::remove_if(freeSlots.begin(), freeSlots.end(),
+			[this](unsigned int slot) { return slots[slot].alive; }), freeSlots.end());
+		for (int l = 0; l < layerCount(); l++) {
+			if (!revived[l].empty()) mergeIntoOrder(l, revived[l]);
+		}
+		bin.clear();
+	}
+
+	void transformsOf(const std::vector<ShapeHandle>& group, std::vector<Transform2D>& out) {
+		for (const ShapeHandle& handle : group) {
+			Shape* shape = get(handle);
+			out.push_back(shape ? shape->transform : Transform2D());
+		}
+	}
+
+	// Exchanges each member's transform with its entry, so calling it
+	// again swaps them back
+	void swapTransforms(const std::vector<ShapeHandle>& group, std::vector<Transform2D>& transforms) {
+		for (size_t i = 0; i < group.size(); i++) {
+			if (!isValid(group[i])) continue;
+			const Slot& s = slots[group[i].slot];
+			visit(s.kind, [&](auto& pool) {
+				auto& shape = pool.items[s.dense];
+				Transform2D previous = shape.transform;
+				shape.setTransform(transforms[i]);
+				transforms[i] = previous;
+				pool.updateBounds(s.dense);
+			});
+		}
+		deferSnapPoints(group);
+	}
+
+	void strokesOf(const std::vector<ShapeHandle>& group, std::vector<StrokeStyle>& out) {
+		for (const ShapeHandle& handle : group) {
+			Shape* shape = get(handle);
+			out.push_back(shape ? shape->stroke : StrokeStyle());
+		}
+	}
+
+	void swapStrokes(const std::vector<ShapeHandle>& group, std::vector<StrokeStyle>& styles) {
+		for (size_t i = 0; i < group.size(); i++) {
+			if (!isValid(group[i])) continue;
+			const Slot& s = slots[group[i].slot];
+			visit(s.kind, [&](auto& pool) {
+				std::swap(pool.items[s.dense].stroke, styles[i]);
+				pool.updateBounds(s.dense);
+			});
+		}
+	}
+
+	void layerNumbers(const std::vector<ShapeHandle>& group, std::vector<unsigned char>& out) const {
+		for (const ShapeHandle& handle : group) {
+			out.push_back(isValid(handle) ? slots[handle.slot].layer : 0);
+		}
+	}
+
+	// Sends each member back to its given layer, at its place in creation
+	// order there
+	void restoreLayers(const std::vector<ShapeHandle>& group, const std::vector<unsigned char>& layerList) {
+		std::vector<ShapeHandle> arriving[MAX_LAYERS];
+		std::uint32_t sources = 0;
+		for (size_t i = 0; i < group.size(); i++) {
+			const ShapeHandle& handle = group[i];
+			if (!isValid(handle) || layerList[i] >= layerCount() || slots[handle.slot].layer == layerList[i]) continue;
+			sources |= 1u << slots[handle.slot].layer;
+			slots[handle.slot].layer = layerList[i];
+			arriving[layerList[i]].push_back(handle);
+		}
+		for (int l = 0; l < layerCount(); l++) {
+			if (sources & (1u << l)) compactOrder(l);
+			if (!arriving[l].empty()) mergeIntoOrder(l, arriving[l]);
+		}
+	}
+
+	// ---- Autosave support ----
+
+	// Calls f(shape, layer, creation serial) with the concrete shape;
+	// false for a stale handle
+	template <typename F>
+	bool visitShape(ShapeHandle handle, F&& f) {
+		if (!isValid(handle)) return false;
+		const Slot& s = slots[handle.slot];
+		visit(s.kind, [&](auto& pool) { f(pool.items[s.dense], static_cast<int>(s.layer), s.serial); });
+		return true;
+	}
+
+	// Whatever shape holds the slot now, or a null handle
+	ShapeHandle liveHandle(unsigned int slot) const {
+		if (slot >= slots.size() || !slots[slot].alive) return ShapeHandle();
+		return ShapeHandle(slot, slots[slot].generation);
+	}
+
+	size_t size() const {
+		return liveCount;
+	}
+
+	// Pre-size for a bulk load of 'count' shapes of kind T
+	template <typename T>
+	void reserve(size_t count) {
+		poolFor<T>().reserve(poolFor<T>().items.size() + count);
+	}
+
+	void reserve(size_t total) {
+		slots.reserve(slots.size() + total);
+		orders[active].handles.reserve(orders[active].handles.size() + total);
+	}
+
+	// Visits live shapes on every layer in painter's order, passing the
+	// concrete type and the layer
+	template <typename F>
+	void forEachShape(F&& f) {
+		for (int l = 0; l < layerCount(); l++) {
+			for (const ShapeHandle& handle : orders[l].handles) {
+				if (!isValid(handle)) continue;
+				const Slot& s = slots[handle.slot];
+				visit(s.kind, [&](auto& pool) { f(pool.items[s.dense], l); });
+			}
+		}
+	}
+
+	// Topmost shape under the point: each pool is scanned in its own tight
+	// loop, bounds first, and the highest layer then the newest hit wins
+	ShapeHandle pick(sf::Vector2f point) {
+		ShapeHandle best;
+		unsigned long long bestRank = 0;
+
+		forEachPool([&](auto& pool) {
+			for (size_t i = 0; i < pool.items.size(); i++) {
+				if (point.x < pool.minX[i] || point.x > pool.maxX[i] ||
+					point.y < pool.minY[i] || point.y > pool.maxY[i]) continue;
+
+				const Slot& s = slots[pool.slotOf[i]];
+				if (!selectable(s)) continue;
+				unsigned long long rank = (static_cast<unsigned long long>(s.layer) << 56) | s.serial;
+				if (!best.isNull() && rank < bestRank) continue;
+
+				if (pool.items[i].containsPoint(point)) {
+					best = ShapeHandle(pool.slotOf[i], s.generation);
+					bestRank = rank;
+				}
+			}
+		});
+		return best;
+	}
+
+	// Painter's order: bottom layer first, oldest first
+	void draw(PixelBuffer& pixels, const RasterView& view, int layer = ALL_LAYERS) {
+		drawRange(pixels, view, layer, 0, orderSize(layer));
+	}
+
+	// Rasterizes one layer, or every visible one, into the per-chunk
+	// buffers only; chunk(0..n-1) in order is the painter's order.
+	// Returns the chunk count.
+	int rasterizeChunks(WorkerPool& workers, const RasterView& view, int layer = ALL_LAYERS) {
+		trimSymbolCaches();
+		const size_t count = orderSize(layer);
+		int chunks = (count < PARALLEL_DRAW_MIN) ? 1 : static_cast<int>(workers.size() * 4);
+		if (chunkBuffers.size() < static_cast<size_t>(chunks)) chunkBuffers.resize(chunks);
+
+		workers.run(chunks, [&](int c) {
+			PixelBuffer& buffer = chunkBuffers[c];
+			buffer.clear();
+			drawRange(buffer, view, layer, count * c / chunks, count * (c + 1) / chunks);
+		});
+		return chunks;
+	}
+
+	const PixelBuffer& chunk(int index) const {
+		return chunkBuffers[index];
+	}
+
+	// World-space box around every shape's pick bounds
+	sf::FloatRect bounds() {
+		float minX = 0, minY = 0, maxX = 0, maxY = 0;
+		bool any = false;
+		forEachPool([&](auto& pool) {
+			for (size_t i = 0; i < pool.items.size(); i++) {
+				if (!any) {
+					minX = pool.minX[i]; minY = pool.minY[i];
+					maxX = pool.maxX[i]; maxY = pool.maxY[i];
+					any = true;
+					continue;
+				}
+				minX = std::min(minX, pool.minX[i]); minY = std::min(minY, pool.minY[i]);
+				maxX = std::max(maxX, pool.maxX[i]); maxY = std::max(maxY, pool.maxY[i]);
+			}
+		});
+		return sf::FloatRect(minX, minY, maxX - minX, maxY - minY);
+	}
+
+	// Splits the draw order into contiguous chunks, rasterizes each into its
+	// own buffer on the worker pool, then writes the chunks out in order so
+	// the result is identical to the serial painter's loop
+	void rasterize(std::vector<sf::Vertex>& quads, WorkerPool& workers, const RasterView& view,
+		int layer = ALL_LAYERS) {
+		int chunks = rasterizeChunks(workers, view, layer);
+
+		chunkOffsets.resize(chunks + 1);
+		chunkOffsets[0] = 0;
+		for (int c = 0; c < chunks; c++) {
+			chunkOffsets[c + 1] = chunkOffsets[c] + chunkBuffers[c].quadCount() * 4;
+		}
+		quads.resize(chunkOffsets[chunks]);
+
+		workers.run(chunks, [&](int c) {
+			chunkBuffers[c].toQuads(quads.data() + chunkOffsets[c]);
+		});
+	}
+
+private:
+	struct Slot {
+		ShapeKind kind;
+		unsigned char layer;
+		bool alive;
+		unsigned int generation;
+		unsigned int dense;             // index inside the kind's pool
+		unsigned long long serial;      // creation order, for top-most picking
+	};
+
+	std::tuple<ShapePool<Line>, ShapePool<Circle>, ShapePool<Ellipse>,
+		ShapePool<Polygon>, ShapePool<BezierCurve>, ShapePool<Instance>, ShapePool<FillRegion>,
+		ShapePool<SplineCurve>> pools;
+
+	struct LayerOrder {
+		std::vector<ShapeHandle> handles;   // painter's order within the layer
+		size_t stale;                       // removed handles not yet compacted
+
+		LayerOrder() : stale(0) {}
+	};
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+	std::vector<Layer> layers;
+	std::vector<LayerOrder> orders;   // one per layer
+	int active;
+	std::vector<PixelBuffer> chunkBuffers;   // one per rasterization chunk, reused
+	SnapIndex snapIndex;
+	std::vector<sf::Vector2f> snapScratch;
+	std::vector<unsigned int> snapPending;   // slots moved since the last snap query
+	std::vector<char> snapQueued;
+	std::vector<unsigned int> memberScratch[SHAPE_KINDS];   // group members per kind
+	std::vector<size_t> chunkOffsets;
+	size_t liveCount;
+	unsigned long long nextSerial;
+
+	template <typename T>
+	ShapePool<T>& poolFor() {
+		return std::get<ShapePool<T>>(pools);
+	}
+
+	// Static dispatch on kind: the callback sees the concrete pool type, so
+	// calls on final shape classes are not virtual
+	template <typename F>
+	void visit(ShapeKind kind, F&& f) {
+		switch (kind) {
+		case ShapeKind::LINE: f(poolFor<Line>()); break;
+		case ShapeKind::CIRCLE: f(poolFor<Circle>()); break;
+		case ShapeKind::ELLIPSE: f(poolFor<Ellipse>()); break;
+		case ShapeKind::POLYGON: f(poolFor<Polygon>()); break;
+		case ShapeKind::BEZIER: f(poolFor<BezierCurve>()); break;
+		case ShapeKind::INSTANCE: f(poolFor<Instance>()); break;
+		case ShapeKind::FILL: f(poolFor<FillRegion>()); break;
+		case ShapeKind::SPLINE: f(poolFor<SplineCurve>()); break;
+		}
+	}
+
+	template <typename F>
+	void forEachPool(F&& f) {
+		f(poolFor<Line>());
+		f(poolFor<Circle>());
+		f(poolFor<Ellipse>());
+		f(poolFor<Polygon>());
+		f(poolFor<BezierCurve>());
+		f(poolFor<Instance>());
+		f(poolFor<FillRegion>());
+		f(poolFor<SplineCurve>());
+	}
+
+	bool selectable(const Slot& s) const {
+		const Layer& l = layers[s.layer];
+		return l.visible && !l.locked;
+	}
+
+	bool drawsLayer(int layer, int l) const {
+		return (layer == ALL_LAYERS) ? layers[l].visible : layer == l;
+	}
+
+	// Length of the painter's order over the drawn layers
+	size_t orderSize(int layer) const {
+		size_t count = 0;
+		for (int l = 0; l < layerCount(); l++) {
+			if (drawsLayer(layer, l)) count += orders[l].handles.size();
+		}
+		return count;
+	}
+
+	// Draws entries [begin, end) of the painter's order over the drawn
+	// layers, as if their orders were laid end to end
+	void drawRange(PixelBuffer& pixels, const RasterView& view, int layer, size_t begin, size_t end) {
+		size_t base = 0;
+		for (int l = 0; l < layerCount() && base < end; l++) {
+			if (!drawsLayer(layer, l)) continue;
+			const std::vector<ShapeHandle>& handles = orders[l].handles;
+			size_t first = std::max(begin, base) - base;
+			size_t last = std::min(end, base + handles.size()) - base;
+			base += handles.size();
+
+			for (size_t i = first; i < last; i++) {
+				const ShapeHandle& handle = handles[i];
+				if (!isValid(handle)) continue;
+				const Slot& s = slots[handle.slot];
+				visit(s.kind, [&](auto& pool) {
+					// Skip shapes whose bounds are entirely off screen
+					unsigned int d = s.dense;
+					if (!view.isVisible(pool.minX[d], pool.minY[d], pool.maxX[d], pool.maxY[d])) return;
+					pool.items[d].draw(pixels, view);
+				});
+			}
+		}
+	}
+
+	template <typename Pool>
+	ShapeHandle handleAt(const Pool& pool, size_t index) const {
+		unsigned int slot = pool.slotOf[index];
+		return ShapeHandle(slot, slots[slot].generation);
+	}
+
+	// Even-odd crossing test
+	static bool insideLasso(const std::vector<sf::Vector2f>& lasso, sf::Vector2f p) {
+		bool inside = false;
+		for (size_t i = 0, j = lasso.size() - 1; i < lasso.size(); j = i++) {
+			const sf::Vector2f& a = lasso[i];
+			const sf::Vector2f& b = lasso[j];
+			if ((a.y > p.y) != (b.y > p.y) &&
+				p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+				inside = !inside;
+			}
+		}
+		return inside;
+	}
+
+	// Calls f(pool, dense) for every live member of the group. Members are
+	// sorted into per-kind lists first so each pool is walked in one loop.
+	template <typename F>
+	void forEachMember(const std::vector<ShapeHandle>& group, F&& f) {
+		for (auto& members : memberScratch) members.clear();
+		for (const ShapeHandle& handle : group) {
+			if (!isValid(handle)) continue;
+			const Slot& s = slots[handle.slot];
+			memberScratch[static_cast<int>(s.kind)].push_back(s.dense);
+		}
+		forEachPool([&](auto& pool) {
+			using T = typename std::decay<decltype(pool.items[0])>::type;
+			for (unsigned int d : memberScratch[static_cast<int>(T::KIND)]) f(pool, d);
+		});
+	}
+
+	// Sprites are built during rasterization and dropped between frames
+	void trimSymbolCaches() {
+		const Symbol* previous = nullptr;
+		for (auto& instance : poolFor<Instance>().items) {
+			if (instance.symbol.get() == previous) continue;
+			previous = instance.symbol.get();
+			instance.symbol->trimCache();
+		}
+	}
+
+	void deferSnapPoints(const std::vector<ShapeHandle>& group) {
+		if (snapQueued.size() < slots.size()) snapQueued.resize(slots.size(), 0);
+		for (const ShapeHandle& handle : group) {
+			if (!isValid(handle) || snapQueued[handle.slot]) continue;
+			snapQueued[handle.slot] = 1;
+			snapPending.push_back(handle.slot);
+		}
+	}
+
+	void flushSnapPoints() {
+		for (unsigned int slot : snapPending) {
+			snapQueued[slot] = 0;
+			if (!slots[slot].alive) continue;
+			snapIndex.retire(slot);
+			fileSnapPoints(slot);
+		}
+		snapPending.clear();
+		if (snapIndex.needsRebuild()) rebuildSnapIndex();
+	}
+
+	void fileSnapPoints(unsigned int slot) {
+		const Slot& s = slots[slot];
+		snapScratch.clear();
+		visit(s.kind, [&](auto& pool) { pool.items[s.dense].snapPoints(snapScratch); });
+		snapIndex.insert(slot, snapScratch);
+	}
+
+	void rebuildSnapIndex() {
+		snapIndex.clear();
+		for (unsigned int i = 0; i < slots.size(); i++) {
+			if (slots[i].alive) fileSnapPoints(i);
+		}
+	}
+
+	unsigned int allocateSlot() {
+		if (!freeSlots.empty()) {
+			unsigned int slot = freeSlots.back();
+			freeSlots.pop_back();
+			slots[slot].alive = true;
+			return slot;
+		}
+		Slot s;
+		s.kind = ShapeKind::LINE;
+		s.layer = 0;
+		s.alive = true;
+		s.generation = 0;
+		s.dense = 0;
+		s.serial = 0;
+		slots.push_back(s);
+		return static_cast<unsigned int>(slots.size() - 1);
+	}
+
+	// Dead slots up to 'count', free for new shapes
+	void growSlots(size_t count) {
+		while (slots.size() < count) {
+			Slot s;
+			s.kind = ShapeKind::LINE;
+			s.layer = 0;
+			s.alive = false;
+			s.generation = 0;
+			s.dense = 0;
+			s.serial = 0;
+			freeSlots.push_back(static_cast<unsigned int>(slots.size()));
+			slots.push_back(s);
+		}
+	}
+
+	// Merges handles into a layer's draw order by creation serial
+	void mergeIntoOrder(int layer, std::vector<ShapeHandle>& arriving) {
+		auto serialOf = [this](const ShapeHandle& h) { return slots[h.slot].serial; };
+		std::sort(arriving.begin(), arriving.end(), [&](const ShapeHandle& a, const ShapeHandle& b) {
+			return serialOf(a) < serialOf(b);
+		});
+
+		std::vector<ShapeHandle>& handles = orders[layer].handles;
+		std::vector<ShapeHandle> merged;
+		merged.reserve(handles.size() + arriving.size());
+		size_t i = 0, j = 0;
+		while (i < handles.size() || j < arriving.size()) {
+			bool takeArriving = i == handles.size() ||
+				(j < arriving.size() && serialOf(arriving[j]) < serialOf(handles[i]));
+			merged.push_back(takeArriving ? arriving[j++] : handles[i++]);
+		}
+		handles.swap(merged);
+	}
+
+	// Drops removed handles and those that moved to another layer
+	void compactOrder(int layer) {
+		std::vector<ShapeHandle>& handles = orders[layer].handles;
+		handles.erase(std::remove_if(handles.begin(), handles.end(), [this, layer](const ShapeHandle& h) {
+			return !isValid(h) || slots[h.slot].layer != layer;
+		}), handles.end());
+		orders[layer].stale = 0;
+	}
+};
+
+// ============================================================================
+// UNDO HISTORY (REVERSIBLE DELTAS)
+// ============================================================================
+// A journal of edits, each keeping only what it changed: the members' old
+// transforms, strokes or layers, or the removed shapes themselves. Undo
+// and redo swap that state with the scene's, so both cost O(changed
+// shapes) and the scene is never copied. Removed shapes go back into
+// their own slots, so handles held by older entries stay good.
+class History {
+public:
+	// Told which shapes changed once a step is final (a transform step when
+	// it closes) and after each undo or redo; the flag is set when only
+	// their transforms did
+	std::function<void(const std::vector<ShapeHandle>&, bool)> onChange;
+
+	History() : grouping(false), transforming(false), memory(0) {}
+
+	// Records made until end() undo as one step
+	void begin() {
+		startEntry();
+		grouping = true;
+	}
+
+	void end() {
+		grouping = false;
+		if (!done.empty() && done.back().steps.empty()) done.pop_back();
+		trim();
+	}
+
+	// Shapes the caller has just added. An empty group records nothing, so
+	// it cannot cost the redo stack or leave an empty undo step.
+	void added(const std::vector<ShapeHandle>& group) {
+		if (group.empty()) return;
+		record(Step::ADDED, group);
+		settle();
+		notify(group);
+	}
+
+	void remove(Scene& scene, const std::vector<ShapeHandle>& group) {
+		if (group.empty()) return;
+		Step& step = record(Step::REMOVED, group);
+		scene.takeOut(group, step.bin);
+		settle();
+		notify(group);
+	}
+
+	// Call before changing the group's transforms. A drag or held key calls
+	// this every frame; the calls share one step until closeTransform().
+	void beginTransform(Scene& scene, const std::vector<ShapeHandle>& group) {
+		if (group.empty()) return;
+		if (transforming && !done.empty() && done.back().steps.back().group == group) return;
+		Step& step = record(Step::TRANSFORMED, group);
+		scene.transformsOf(group, step.transforms);
+		transforming = true;
+		settle();
+	}
+
+	void closeTransform() {
+		if (!transforming) return;
+		transforming = false;
+		notify(done.back().steps.back().group, true);
+	}
+
+	void setStroke(Scene& scene, const std::vector<ShapeHandle>& group, const StrokeStyle& style) {
+		if (group.empty()) return;
+		Step& step = record(Step::RESTYLED, group);
+		scene.strokesOf(group, step.strokes);
+		scene.setStroke(group, style);
+		settle();
+		notify(group);
+	}
+
+	void moveToLayer(Scene& scene, const std::vector<ShapeHandle>& group, int layer) {
+		if (group.empty()) return;
+		Step& step = record(Step::RELAYERED, group);
+		scene.layerNumbers(group, step.layers);
+		step.target = layer;
+		scene.moveToLayer(group, layer);
+		settle();
+		notify(group);
+	}
+
+	// Shapes the next undo or redo touches, for damage tracking
+	void undoGroup(std::vector<ShapeHandle>& out) const {
+		if (!done.empty()) collect(done.back(), out);
+	}
+
+	void redoGroup(std::vector<ShapeHandle>& out) const {
+		if (!undone.empty()) collect(undone.back(), out);
+	}
+
+	bool undo(Scene& scene) {
+		closeTransform();
+		if (done.empty()) return false;
+		Entry& entry = done.back();
+		for (auto step = entry.steps.rbegin(); step != entry.steps.rend(); ++step) {
+			revert(scene, *step);
+		}
+		remeasure(entry);
+		undone.push_back(std::move(entry));
+		done.pop_back();
+		notifyEntry(undone.back());
+		return true;
+	}
+
+	bool redo(Scene& scene) {
+		closeTransform();
+		if (undone.empty()) return false;
+		Entry& entry = undone.back();
+		for (auto& step : entry.steps) {
+			apply(scene, step);
+		}
+		remeasure(entry);
+		done.push_back(std::move(entry));
+		undone.pop_back();
+		notifyEntry(done.back());
+		return true;
+	}
+
+	// After loading a scene the old handles mean nothing
+	void clear() {
+		done.clear();
+		undone.clear();
+		grouping = false;
+		transforming = false;
+		memory = 0;
+	}
+
+	size_t levels() const {
+		return done.size();
+	}
+
+	size_t bytes() const {
+		return memory;
+	}
+
+private:
+	struct Step {
+		enum Type { ADDED, REMOVED, TRANSFORMED, RESTYLED, RELAYERED } type;
+		std::vector<ShapeHandle> group;
+		ShapeBin bin;                          // shapes currently out of the scene
+		std::vector<Transform2D> transforms;   // the other side of each swap
+		std::vector<StrokeStyle> strokes;
+		std::vector<unsigned char> layers;     // where RELAYERED members came from
+		int target;
+
+		size_t bytes() const {
+			return sizeof(Step) + group.capacity() * sizeof(ShapeHandle) + bin.bytes() +
+				transforms.capacity() * sizeof(Transform2D) + strokes.capacity() * sizeof(StrokeStyle) +
+				layers.capacity();
+		}
+	};
+
+	struct Entry {
+		std::vector<Step> steps;
+		size_t bytes;
+
+		Entry() : bytes(0) {}
+	};
+
+	std::deque<Entry> done;
+	std::vector<Entry> undone;
+	bool grouping;        // between begin() and end()
+	bool transforming;    // the last step is still taking transform frames
+	size_t memory;
+
+	void startEntry() {
+		done.push_back(Entry());
+	}
+
+	// A new edit forgets what was undone
+	Step& record(Step::Type type, const std::vector<ShapeHandle>& group) {
+		closeTransform();
+		for (auto& entry : undone) memory -= entry.bytes;
+		undone.clear();
+		if (!grouping || done.empty()) startEntry();
+
+		Entry& entry = done.back();
+		entry.steps.emplace_back();
+		Step& step = entry.steps.back();
+		step.type = type;
+		step.group = group;
+		step.target = 0;
+		return step;
+	}
+
+	void settle() {
+		remeasure(done.back());
+		if (!grouping) trim();
+	}
+
+	void remeasure(Entry& entry) {
+		memory -= entry.bytes;
+		entry.bytes = sizeof(Entry);
+		for (auto& step : entry.steps) entry.bytes += step.bytes();
+		memory += entry.bytes;
+	}
+
+	// Oldest entries go first; the newest always stays undoable
+	void trim() {
+		while (done.size() > 1 && (memory > UNDO_MEMORY || done.size() > UNDO_LEVELS)) {
+			memory -= done.front().bytes;
+			done.pop_front();
+		}
+	}
+
+	static void collect(const Entry& entry, std::vector<ShapeHandle>& out) {
+		for (auto& step : entry.steps) {
+			out.insert(out.end(), step.group.begin(), step.group.end());
+		}
+	}
+
+	void notify(const std::vector<ShapeHandle>& group, bool transformsOnly = false) {
+		if (onChange) onChange(group, transformsOnly);
+	}
+
+	void notifyEntry(const Entry& entry) {
+		if (!onChange) return;
+		for (auto& step : entry.steps) onChange(step.group, step.type == Step::TRANSFORMED);
+	}
+
+	static void revert(Scene& scene, Step& step) {
+		switch (step.type) {
+		case Step::ADDED: scene.takeOut(step.group, step.bin); break;
+		case Step::REMOVED: scene.putBack(step.bin); break;
+		case Step::TRANSFORMED: scene.swapTransforms(step.group, step.transforms); break;
+		case Step::RESTYLED: scene.swapStrokes(step.group, step.strokes); break;
+		case Step::RELAYERED: scene.restoreLayers(step.group, step.layers); break;
+		}
+	}
+
+	static void apply(Scene& scene, Step& step) {
+		switch (step.type) {
+		case Step::ADDED: scene.putBack(step.bin); break;
+		case Step::REMOVED: scene.takeOut(step.group, step.bin); break;
+		case Step::TRANSFORMED: scene.swapTransforms(step.group, step.transforms); break;
+		case Step::RESTYLED: scene.swapStrokes(step.group, step.strokes); break;
+		case Step::RELAYERED: scene.moveToLayer(step.group, step.target); break;
+		}
+	}
+};
+
+// ============================================================================
+// SCENE FILE (BINARY, MEMORY-MAPPED)
+// ============================================================================
+// Layout: header, then one fixed-size record per shape in painter's order,
+// then a packed pool of (x, y) floats that polygons and Bezier curves index
+// into. Everything is little-endian and 8-byte aligned, so a mapped file is
+// read in place with no parsing step.
+//
+// Version 2 adds symbols. Their parts come first, as ordinary records
+// flagged SYMBOL_PART whose colour field holds the symbol number (parts
+// take the instance's colour). An instance record keeps its symbol number
+// in 'segments'. Version 1 files still load.
+//
+// A shape's layer number sits in the high four bits of its flags; files
+// written before layers leave them zero, which is the first layer. Layer
+// names, visibility and locks are not stored.
+//
+// Version 3 appends each shape's stroke style, growing records from 56 to
+// 80 bytes; the header's record size says which kind a file holds, and
+// older shapes load as hairlines.
+//
+// Version 4 adds fill regions: origin and cell size in the geometry, and
+// each span as two pool points, (x0, y) then (x1, y), in cells.
+//
+// Version 5 adds B-spline and NURBS curves. Control points are pooled as for
+// Bezier curves; a NURBS sets geometry[0] to 1 and follows them with one
+// (weight, 0) point per control point.
+//
+// Version 6 adds polygon holes: geometry[0] holds the hole count, and each
+// hole's start in the polygon's vertices follows them as a (start, 0) point.
+const char SCENE_MAGIC[4] = { 'M', 'C', 'A', 'D' };
+const std::uint32_t SCENE_VERSION = 6;
+const std::uint32_t RECORD_SIZE_V2 = 56;   // records before stroke styles
+
+struct SceneFileHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t shapeCount;       // records, symbol parts included
+	std::uint32_t recordSize;       // sizeof(ShapeRecord) when written
+	std::uint64_t vertexCount;
+	std::uint64_t recordsOffset;
+	std::uint64_t verticesOffset;
+};
+
+struct ShapeRecord {
+	enum Flags : std::uint8_t { FILLED = 1, NON_ZERO = 2, BRESENHAM = 4, SYMBOL_PART = 8 };
+	static const int LAYER_SHIFT = 4;
+
+	std::uint8_t kind;              // ShapeKind
+	std::uint8_t flags;
+	std::uint16_t segments;         // Bezier evaluation steps; instance symbol number
+	std::uint32_t color;            // RGBA
+	float geometry[4];              // line p1/p2, circle c/r, ellipse c/rx/ry, fill origin/cell,
+	                                // polygon hole count, NURBS 1
+	float tx, ty, rotation, sx, sy; // Transform2D
+	std::uint32_t vertexCount;
+	std::uint64_t firstVertex;      // index into the vertex pool
+	float strokeWidth;              // StrokeStyle, from version 3
+	std::uint8_t join, cap, dashCount, reserved;
+	float dashes[StrokeStyle::MAX_DASHES];
+};
+
+static_assert(sizeof(SceneFileHeader) == 40, "scene header layout changed");
+static_assert(sizeof(ShapeRecord) == 80, "scene record layout changed");
+static_assert(RECORD_SIZE_V2 <= sizeof(ShapeRecord), "old records must fit a current one");
+static_assert(sizeof(sf::Vector2f) == 2 * sizeof(float), "vertex pool assumes packed Vector2f");
+
+// Read-only view of a whole file, mapped rather than copied
+class MappedFile {
+public:
+	MappedFile() : data(nullptr), length(0) {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+#ifdef _WIN32
+	bool open(const std::string& path) {
+		close();
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		}
+		if (mapping) {
+			data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			length = data ? static_cast<size_t>(fileSize.QuadPart) : 0;
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return data != nullptr;
+	}
+
+	void close() {
+		if (data) UnmapViewOfFile(data);
+		data = nullptr;
+		length = 0;
+	}
+#else
+	bool open(const std::string& path) {
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				data = static_cast<const unsigned char*>(mapped);
+				length = static_cast<size_t>(info.st_size);
+			}
+		}
+		::close(fd);
+		return data != nullptr;
+	}
+
+	void close() {
+		if (data) munmap(const_cast<unsigned char*>(data), length);
+		data = nullptr;
+		length = 0;
+	}
+#endif
+
+	const unsigned char* bytes() const { return data; }
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* data;
+	size_t length;
+};
+
+// Lock on a marker file, held while this process owns what it guards. A
+// crash releases it along with the process.
+class FileLock {
+public:
+	~FileLock() { release(); }
+
+	FileLock(const FileLock&) = delete;
+	FileLock& operator=(const FileLock&) = delete;
+
+#ifdef _WIN32
+	FileLock() : handle(INVALID_HANDLE_VALUE) {}
+
+	bool held() const { return handle != INVALID_HANDLE_VALUE; }
+
+	bool acquire(const std::string& markerPath) {
+		if (held() && markerPath == path) return true;
+		release();
+		// Unshared, so a second instance cannot open it until this one closes
+		handle = CreateFileA(markerPath.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) return false;
+		path = markerPath;
+		return true;
+	}
+
+	void release() {
+		if (held()) CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+	}
+
+private:
+	HANDLE handle;
+#else
+	FileLock() : handle(-1) {}
+
+	bool held() const { return handle >= 0; }
+
+	bool acquire(const std::string& markerPath) {
+		if (held() && markerPath == path) return true;
+		release();
+		for (;;) {
+			int fd = ::open(markerPath.c_str(), O_RDWR | O_CREAT, 0644);
+			if (fd < 0) return false;
+			struct flock range;
+			std::memset(&range, 0, sizeof(range));
+			range.l_type = F_WRLCK;
+			range.l_whence = SEEK_SET;
+			if (fcntl(fd, F_SETLK, &range) != 0) {
+				::close(fd);
+				return false;
+			}
+			// The last owner removes the marker on release; if that happened
+			// after we opened it, our lock is on a file no one else will see
+			struct stat locked, named;
+			if (fstat(fd, &locked) == 0 && stat(markerPath.c_str(), &named) == 0 &&
+				locked.st_dev == named.st_dev && locked.st_ino == named.st_ino) {
+				handle = fd;
+				path = markerPath;
+				return true;
+			}
+			::close(fd);
+		}
+	}
+
+	void release() {
+		if (!held()) return;
+		std::remove(path.c_str());   // still locked, so no one else is using it
+		::close(handle);
+		handle = -1;
+	}
+
+private:
+	int handle;
+#endif
+
+	std::string path;
+};
+
+// Writes the parts to a new file at 'path' and returns once they are on disk
+#ifdef _WIN32
+bool writeSynced(const std::string& path, std::initializer_list<std::pair<const void*, size_t>> parts) {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	bool written = true;
+	for (auto& part : parts) {
+		const char* at = static_cast<const char*>(part.first);
+		size_t left = part.second;
+		while (written && left > 0) {
+			DWORD chunk = static_cast<DWORD>(std::min<size_t>(left, 1u << 30)), done = 0;
+			written = WriteFile(file, at, chunk, &done, nullptr) && done > 0;
+			at += done;
+			left -= done;
+		}
+	}
+	written = written && FlushFileBuffers(file);
+	return CloseHandle(file) && written;
+}
+
+// Moves 'from' over 'to' in one step
+bool replaceFile(const std::string& from, const std::string& to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+#else
+bool writeSynced(const std::string& path, std::initializer_list<std::pair<const void*, size_t>> parts) {
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+	bool written = true;
+	for (auto& part : parts) {
+		const char* at = static_cast<const char*>(part.first);
+		size_t left = part.second;
+		while (written && left > 0) {
+			ssize_t done = ::write(fd, at, left);
+			if (done < 0 && errno == EINTR) continue;
+			written = done > 0;
+			if (written) {
+				at += done;
+				left -= static_cast<size_t>(done);
+			}
+		}
+	}
+	written = written && fsync(fd) == 0;
+	return ::close(fd) == 0 && written;
+}
+
+// Moves 'from' over 'to' in one step, then syncs the directory so the
+// rename itself survives a power cut
+bool replaceFile(const std::string& from, const std::string& to) {
+	if (std::rename(from.c_str(), to.c_str()) != 0) return false;
+	size_t slash = to.find_last_of('/');
+	std::string folder = slash == std::string::npos ? "." : slash == 0 ? "/" : to.substr(0, slash);
+	int fd = ::open(folder.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		::close(fd);
+	}
+	return true;
+}
+#endif
+
+// Shape -> record; polygons, curves and fills append their points to the pool
+ShapeRecord recordFor(const Shape& shape, ShapeKind kind) {
+	ShapeRecord record = {};
+	record.kind = static_cast<std::uint8_t>(kind);
+	record.color = shape.color.toInteger();
+	record.tx = shape.transform.tx;
+	record.ty = shape.transform.ty;
+	record.rotation = shape.transform.rotation;
+	record.sx = shape.transform.sx;
+	record.sy = shape.transform.sy;
+	record.strokeWidth = shape.stroke.width;
+	record.join = static_cast<std::uint8_t>(shape.stroke.join);
+	record.cap = static_cast<std::uint8_t>(shape.stroke.cap);
+	record.dashCount = shape.stroke.dashCount;
+	std::copy(shape.stroke.dashes, shape.stroke.dashes + StrokeStyle::MAX_DASHES, record.dashes);
+	return record;
+}
+
+// False for a style no version of the editor writes
+bool strokeFor(const ShapeRecord& record, StrokeStyle& style) {
+	if (!(record.strokeWidth >= 0 && record.strokeWidth <= MAX_STROKE_WIDTH) ||
+		record.join > static_cast<int>(LineJoin::BEVEL) || record.cap > static_cast<int>(LineCap::SQUARE) ||
+		record.dashCount > StrokeStyle::MAX_DASHES) return false;
+	for (float dash : record.dashes) {
+		if (!(dash >= 0 && dash <= 1e6f)) return false;
+	}
+	style.width = record.strokeWidth;
+	style.join = static_cast<LineJoin>(record.join);
+	style.cap = static_cast<LineCap>(record.cap);
+	style.dashCount = record.dashCount;
+	std::copy(record.dashes, record.dashes + StrokeStyle::MAX_DASHES, style.dashes);
+	return true;
+}
+
+void packShape(const Line& line, ShapeRecord& record, std::vector<sf::Vector2f>&) {
+	if (line.algorithm == Line::BRESENHAM) record.flags |= ShapeRecord::BRESENHAM;
+	record.geometry[0] = line.p1.x;
+	record.geometry[1] = line.p1.y;
+	record.geometry[2] = line.p2.x;
+	record.geometry[3] = line.p2.y;
+}
+
+void packShape(const Circle& circle, ShapeRecord& record, std::vector<sf::Vector2f>&) {
+	record.geometry[0] = circle.center.x;
+	record.geometry[1] = circle.center.y;
+	record.geometry[2] = circle.radius;
+}
+
+void packShape(const Ellipse& ellipse, ShapeRecord& record, std::vector<sf::Vector2f>&) {
+	if (ellipse.filled) record.flags |= ShapeRecord::FILLED;
+	record.geometry[0] = ellipse.center.x;
+	record.geometry[1] = ellipse.center.y;
+	record.geometry[2] = ellipse.rx;
+	record.geometry[3] = ellipse.ry;
+}
+
+void packShape(const Polygon& polygon, ShapeRecord& record, std::vector<sf::Vector2f>& pool) {
+	if (polygon.filled) record.flags |= ShapeRecord::FILLED;
+	if (polygon.fillRule == FillRule::NON_ZERO) record.flags |= ShapeRecord::NON_ZERO;
+	record.geometry[0] = static_cast<float>(polygon.holes.size());
+	record.firstVertex = pool.size();
+	record.vertexCount = static_cast<std::uint32_t>(polygon.vertices.size() + polygon.holes.size());
+	pool.insert(pool.end(), polygon.vertices.begin(), polygon.vertices.end());
+	for (unsigned int start : polygon.holes) pool.push_back(sf::Vector2f(static_cast<float>(start), 0));
+}
+
+void packShape(const BezierCurve& curve, ShapeRecord& record, std::vector<sf::Vector2f>& pool) {
+	record.segments = static_cast<std::uint16_t>(curve.segments);
+	record.firstVertex = pool.size();
+	record.vertexCount = static_cast<std::uint32_t>(curve.controlPoints.size());
+	pool.insert(pool.end(), curve.controlPoints.begin(), curve.controlPoints.end());
+}
+
+void packShape(const Instance&, ShapeRecord&, std::vector<sf::Vector2f>&) {
+}
+
+void packShape(const FillRegion& fill, ShapeRecord& record, std::vector<sf::Vector2f>& pool) {
+	record.geometry[0] = fill.origin.x;
+	record.geometry[1] = fill.origin.y;
+	record.geometry[2] = fill.cell;
+	record.firstVertex = pool.size();
+	record.vertexCount = static_cast<std::uint32_t>(fill.spans.size() * 2);
+	for (auto& span : fill.spans) {
+		pool.push_back(sf::Vector2f(static_cast<float>(span.x0), static_cast<float>(span.y)));
+		pool.push_back(sf::Vector2f(static_cast<float>(span.x1), static_cast<float>(span.y)));
+	}
+}
+
+void packShape(const SplineCurve& curve, ShapeRecord& record, std::vector<sf::Vector2f>& pool) {
+	record.firstVertex = pool.size();
+	record.vertexCount = static_cast<std::uint32_t>(curve.controlPoints.size() + curve.weights.size());
+	pool.insert(pool.end(), curve.controlPoints.begin(), curve.controlPoints.end());
+	if (!curve.isRational()) return;
+	record.geometry[0] = 1;
+	for (float w : curve.weights) pool.push_back(sf::Vector2f(w, 0));
+}
+
+// Symbol numbers are only known while saving
+void numberSymbol(const Shape&, ShapeRecord&, const std::vector<std::shared_ptr<Symbol>>&) {
+}
+
+void numberSymbol(const Instance& instance, ShapeRecord& record,
+	const std::vector<std::shared_ptr<Symbol>>& symbols) {
+	auto found = std::find(symbols.begin(), symbols.end(), instance.symbol);
+	record.segments = static_cast<std::uint16_t>(found - symbols.begin());
+}
+
+// False for a record unpackShape would make a broken shape from. 'points'
+// are its vertexCount vertices, which the caller has already bounded by
+// the file. A fill takes two vertices per span, each a whole cell index.
+bool validShape(const ShapeRecord& r, const sf::Vector2f* points) {
+	if (static_cast<ShapeKind>(r.kind) != ShapeKind::FILL) return true;
+	const float* g = r.geometry;
+	if (!(std::isfinite(g[0]) && std::isfinite(g[1]) && g[2] > 0 && g[2] <= 1e6f) || r.vertexCount % 2) return false;
+	auto cellIndex = [](float v) { return v >= 0 && v < 16777216.0f && v == std::floor(v); };
+	for (std::uint32_t i = 0; i < r.vertexCount; i += 2) {
+		sf::Vector2f from, to;   // journal frames leave vertices unaligned
+		std::memcpy(&from, points + i, sizeof(from));
+		std::memcpy(&to, points + i + 1, sizeof(to));
+		if (!cellIndex(from.x) || !cellIndex(from.y) || !cellIndex(to.x) || to.y != from.y || to.x < from.x) return false;
+	}
+	return true;
+}
+
+// Record -> shape, passed to f with its transform and stroke set. 'points'
+// are the record's vertices; 'symbol' is what an instance stamps.
+template <typename F>
+void unpackShape(const ShapeRecord& r, const sf::Vector2f* points, const std::shared_ptr<Symbol>& symbol, F&& f) {
+	auto finish = [&](auto shape) {
+		shape.transform.tx = r.tx;
+		shape.transform.ty = r.ty;
+		shape.transform.rotation = r.rotation;
+		shape.transform.sx = r.sx;
+		shape.transform.sy = r.sy;
+		strokeFor(r, shape.stroke);
+		f(std::move(shape));
+	};
+
+	const float* g = r.geometry;
+	sf::Color color(r.color);
+	switch (static_cast<ShapeKind>(r.kind)) {
+	case ShapeKind::LINE:
+		finish(Line(sf::Vector2f(g[0], g[1]), sf::Vector2f(g[2], g[3]),
+			(r.flags & ShapeRecord::BRESENHAM) ? Line::BRESENHAM : Line::DDA, color));
+		break;
+	case ShapeKind::CIRCLE:
+		finish(Circle(sf::Vector2f(g[0], g[1]), g[2], color));
+		break;
+	case ShapeKind::ELLIPSE:
+		finish(Ellipse(sf::Vector2f(g[0], g[1]), g[2], g[3], color, (r.flags & ShapeRecord::FILLED) != 0));
+		break;
+	case ShapeKind::POLYGON: {
+		// Bad hole starts are dropped by the constructor
+		size_t holeCount = (g[0] >= 1 && g[0] <= r.vertexCount) ? static_cast<size_t>(g[0]) : 0;
+		size_t count = r.vertexCount - holeCount;
+		std::vector<unsigned int> holes(holeCount);
+		for (size_t i = 0; i < holeCount; i++) {
+			float start = points[count + i].x;
+			holes[i] = (start >= 0 && start < 4e9f) ? static_cast<unsigned int>(start) : 0;
+		}
+		finish(Polygon(std::vector<sf::Vector2f>(points, points + count), color,
+			(r.flags & ShapeRecord::FILLED) != 0,
+			(r.flags & ShapeRecord::NON_ZERO) ? FillRule::NON_ZERO : FillRule::EVEN_ODD, std::move(holes)));
+		break;
+	}
+	case ShapeKind::BEZIER:
+		finish(BezierCurve(std::vector<sf::Vector2f>(points, points + r.vertexCount), color,
+			std::max<int>(1, r.segments)));
+		break;
+	case ShapeKind::INSTANCE:
+		finish(Instance(symbol, sf::Vector2f(0, 0), color));
+		break;
+	case ShapeKind::FILL: {
+		std::vector<Span> spans(r.vertexCount / 2);
+		for (size_t i = 0; i < spans.size(); i++) {
+			spans[i].y = static_cast<int>(points[2 * i].y);
+			spans[i].x0 = static_cast<int>(points[2 * i].x);
+			spans[i].x1 = static_cast<int>(points[2 * i + 1].x);
+		}
+		finish(FillRegion(sf::Vector2f(g[0], g[1]), g[2], std::move(spans), color));
+		break;
+	}
+	case ShapeKind::SPLINE: {
+		bool rational = g[0] == 1;
+		size_t count = rational ? r.vertexCount / 2 : r.vertexCount;
+		std::vector<float> weights;
+		if (rational) {
+			weights.resize(count);
+			for (size_t i = 0; i < count; i++) weights[i] = points[count + i].x;
+		}
+		finish(SplineCurve(std::vector<sf::Vector2f>(points, points + count), color, std::move(weights)));
+		break;
+	}
+	}
+}
+
+bool saveScene(Scene& scene, const std::string& path) {
+	std::vector<ShapeRecord> records;
+	std::vector<sf::Vector2f> pool;
+	records.reserve(scene.size());
+
+	std::vector<std::shared_ptr<Symbol>> symbols;
+	scene.symbolsInUse(symbols);
+	if (symbols.size() > 0xFFFF) return false;
+	for (size_t i = 0; i < symbols.size(); i++) {
+		symbols[i]->forEachPart([&](const auto& part) {
+			ShapeRecord record = recordFor(part, std::decay<decltype(part)>::type::KIND);
+			packShape(part, record, pool);
+			record.flags |= ShapeRecord::SYMBOL_PART;
+			record.color = static_cast<std::uint32_t>(i);
+			records.push_back(record);
+		});
+	}
+
+	scene.forEachShape([&](const auto& shape, int layer) {
+		ShapeRecord record = recordFor(shape, std::decay<decltype(shape)>::type::KIND);
+		packShape(shape, record, pool);
+		numberSymbol(shape, record, symbols);
+		record.flags |= static_cast<std::uint8_t>(layer << ShapeRecord::LAYER_SHIFT);
+		records.push_back(record);
+	});
+
+	SceneFileHeader header = {};
+	std::copy(SCENE_MAGIC, SCENE_MAGIC + 4, header.magic);
+	header.version = SCENE_VERSION;
+	header.shapeCount = static_cast<std::uint32_t>(records.size());
+	header.recordSize = sizeof(ShapeRecord);
+	header.vertexCount = pool.size();
+	header.recordsOffset = sizeof(SceneFileHeader);
+	header.verticesOffset = header.recordsOffset + records.size() * sizeof(ShapeRecord);
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out) return false;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ShapeRecord));
+	out.write(reinterpret_cast<const char*>(pool.data()), pool.size() * sizeof(sf::Vector2f));
+	return static_cast<bool>(out);
+}
+
+// True when the header describes records and a vertex pool that both lie
+// inside a file of 'size' bytes. Offsets are checked against the size
+// before anything is subtracted from it, and counts are compared with
+// what fits rather than multiplied, so no field can wrap the arithmetic.
+bool validSceneHeader(const SceneFileHeader& header, std::uint64_t size) {
+	if (!std::equal(SCENE_MAGIC, SCENE_MAGIC + 4, header.magic) ||
+		header.version < 1 || header.version > SCENE_VERSION) return false;
+
+	// Records are copied into a zeroed ShapeRecord, so each must be the
+	// exact size its version wrote: never empty and never larger
+	std::uint32_t recordSize = header.version < 3 ? RECORD_SIZE_V2 : sizeof(ShapeRecord);
+	if (header.recordSize == 0 || header.recordSize != recordSize) return false;
+
+	if (header.recordsOffset > size || header.verticesOffset > size ||
+		header.recordsOffset % 8 != 0 || header.verticesOffset % 8 != 0) return false;
+	return header.shapeCount <= (size - header.recordsOffset) / header.recordSize &&
+		header.vertexCount <= (size - header.verticesOffset) / sizeof(sf::Vector2f);
+}
+
+// Replaces the scene with the file's contents. The file is validated up
+// front so a truncated or foreign file leaves the scene untouched.
+bool loadScene(Scene& scene, const std::string& path) {
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(SceneFileHeader)) return false;
+
+	const SceneFileHeader& header = *reinterpret_cast<const SceneFileHeader*>(file.bytes());
+	if (!validSceneHeader(header, file.size())) return false;
+
+	// Older, shorter records are read into a zeroed record, which leaves
+	// their shapes with the hairline stroke
+	const unsigned char* records = file.bytes() + header.recordsOffset;
+	auto recordAt = [&](std::uint32_t i) {
+		ShapeRecord record = {};
+		std::memcpy(&record, records + std::uint64_t(i) * header.recordSize, header.recordSize);
+		return record;
+	};
+	const sf::Vector2f* pool = reinterpret_cast<const sf::Vector2f*>(file.bytes() + header.verticesOffset);
+
+	// Symbols are numbered in order of their first part and must be
+	// defined before an instance uses them
+	size_t counts[SHAPE_KINDS] = {};
+	std::uint32_t symbolCount = 0;
+	StrokeStyle style;
+	for (std::uint32_t i = 0; i < header.shapeCount; i++) {
+		const ShapeRecord r = recordAt(i);
+		bool part = (r.flags & ShapeRecord::SYMBOL_PART) != 0;
+		if (r.kind >= SHAPE_KINDS || !strokeFor(r, style) ||
+			r.firstVertex > header.vertexCount ||
+			r.vertexCount > header.vertexCount - r.firstVertex ||
+			!validShape(r, pool + r.firstVertex)) return false;
+		if (part) {
+			if (r.kind == static_cast<std::uint8_t>(ShapeKind::INSTANCE) || r.color > symbolCount) return false;
+			if (r.color == symbolCount) symbolCount++;
+			continue;
+		}
+		if (r.kind == static_cast<std::uint8_t>(ShapeKind::INSTANCE) && r.segments >= symbolCount) return false;
+		counts[r.kind]++;
+	}
+
+	scene.clear();
+	scene.resetLayers();
+	scene.reserve(header.shapeCount);
+	scene.reserve<Line>(counts[static_cast<int>(ShapeKind::LINE)]);
+	scene.reserve<Circle>(counts[static_cast<int>(ShapeKind::CIRCLE)]);
+	scene.reserve<Ellipse>(counts[static_cast<int>(ShapeKind::ELLIPSE)]);
+	scene.reserve<Polygon>(counts[static_cast<int>(ShapeKind::POLYGON)]);
+	scene.reserve<BezierCurve>(counts[static_cast<int>(ShapeKind::BEZIER)]);
+	scene.reserve<Instance>(counts[static_cast<int>(ShapeKind::INSTANCE)]);
+	scene.reserve<FillRegion>(counts[static_cast<int>(ShapeKind::FILL)]);
+	scene.reserve<SplineCurve>(counts[static_cast<int>(ShapeKind::SPLINE)]);
+
+	std::vector<std::shared_ptr<Symbol>> symbols;
+	auto place = [&](auto shape, const ShapeRecord& r) {
+		if (!(r.flags & ShapeRecord::SYMBOL_PART)) {
+			int layer = r.flags >> ShapeRecord::LAYER_SHIFT;
+			while (scene.layerCount() <= layer) {
+				scene.addLayer("Layer " + std::to_string(scene.layerCount() + 1));
+			}
+			scene.setActiveLayer(layer);
+			scene.add(std::move(shape));
+			return;
+		}
+		if (r.color == symbols.size()) {
+			symbols.push_back(std::make_shared<Symbol>("Symbol " + std::to_string(r.color + 1), sf::Color::White));
+		}
+		symbols[r.color]->addPart(std::move(shape));
+	};
+
+	std::shared_ptr<Symbol> none;
+	for (std::uint32_t i = 0; i < header.shapeCount; i++) {
+		const ShapeRecord r = recordAt(i);
+		bool instance = r.kind == static_cast<std::uint8_t>(ShapeKind::INSTANCE);
+		unpackShape(r, pool + r.firstVertex, instance ? symbols[r.segments] : none,
+			[&](auto shape) { place(std::move(shape), r); });
+	}
+	scene.setActiveLayer(0);
+	return true;
+}
+
+// ============================================================================
+// AUTOSAVE (BACKGROUND JOURNAL)
+// ============================================================================
+// Each finished edit appends the new state of the shapes it touched to a
+// journal beside the scene file: an UPSERT frame (handle, layer, creation
+// serial and a scene-file record) for a shape that exists, a REMOVE frame
+// for one that is gone, and just a TRANSFORM frame when only its transform
+// changed. The event loop packs frames a bounded batch of shapes per
+// frame, so a big edit spreads over several frames, into a lock-free
+// ring; a writer thread drains the ring to disk, so the UI never waits on
+// a write. The writer also keeps the newest frame of every live shape, and
+// once most of the journal is superseded it rewrites it as a snapshot of
+// just those. After a crash, replaying the journal restores the scene as
+// of the last frame that reached the disk.
+
+const char JOURNAL_MAGIC[4] = { 'M', 'C', 'J', 'L' };
+const std::uint32_t JOURNAL_VERSION = 1;
+const size_t JOURNAL_RING_BYTES = 8u << 20;
+const size_t JOURNAL_COMPACT_MIN = 4u << 20;   // journals smaller than this are left alone
+const int JOURNAL_POLL_MS = 10;                // writer's nap when the ring is empty
+const size_t JOURNAL_PACK_BATCH = 16384;       // shapes packed per pump
+
+// Frames are [u32 payload length][u8 JournalOp][payload].
+//   UPSERT: JournalShape, the shape's ShapeRecord, then its vertices
+//   REMOVE: u32 slot, u32 generation
+//   TRANSFORM: u32 slot, u32 generation, Transform2D
+//   SYMBOL: u32 number, u32 RGBA, u32 name length, the name, u32 part
+//           count, then each part's record and vertices
+//   RESET:  empty; everything before it is void
+enum class JournalOp : std::uint8_t { RESET, SYMBOL, UPSERT, REMOVE, TRANSFORM };
+
+struct JournalShape {
+	std::uint32_t slot, generation;
+	std::uint64_t serial;
+	std::uint32_t symbol;           // instances: the journal's number for their symbol
+	std::uint8_t layer;
+	std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(JournalShape) == 24, "journal shape layout changed");
+static_assert(sizeof(Transform2D) == 5 * sizeof(float), "journal transforms are five floats");
+
+const size_t JOURNAL_FRAME_HEADER = 5;
+// Where an UPSERT frame keeps the transform a TRANSFORM frame replaces
+const size_t JOURNAL_TRANSFORM_AT = JOURNAL_FRAME_HEADER + sizeof(JournalShape) + offsetof(ShapeRecord, tx);
+
+// Single-producer single-consumer byte queue. Each side writes only its own
+// index and reads the other's, so neither ever takes a lock.
+class ByteRing {
+public:
+	explicit ByteRing(size_t capacity) : buffer(capacity), head(0), tail(0) {}
+
+	// Producer: copies as much as fits and returns how much that was
+	size_t push(const unsigned char* data, size_t size) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_acquire);
+		size = std::min(size, buffer.size() - (h - t));
+		for (size_t done = 0; done < size;) {
+			size_t at = (h + done) % buffer.size();
+			size_t run = std::min(size - done, buffer.size() - at);
+			std::memcpy(&buffer[at], data + done, run);
+			done += run;
+		}
+		head.store(h + size, std::memory_order_release);
+		return size;
+	}
+
+	// Consumer: appends everything queued to 'out'
+	size_t pop(std::vector<unsigned char>& out) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t h = head.load(std::memory_order_acquire);
+		for (size_t done = 0; done < h - t;) {
+			size_t at = (t + done) % buffer.size();
+			size_t run = std::min(h - t - done, buffer.size() - at);
+			out.insert(out.end(), &buffer[at], &buffer[at] + run);
+			done += run;
+		}
+		tail.store(h, std::memory_order_release);
+		return h - t;
+	}
+
+private:
+	std::vector<unsigned char> buffer;
+	std::atomic<size_t> head;   // bytes ever pushed
+	char padding[64];           // keeps the two sides off one cache line
+	std::atomic<size_t> tail;   // bytes ever popped
+};
+
+class Autosave {
+public:
+	struct ReplayStats {
+		size_t frames;
+		size_t shapes;
+		size_t bytes;
+		double seconds;
+
+		double megabytesPerSecond() const {
+			return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+		}
+	};
+
+	Autosave() : ring(JOURNAL_RING_BYTES), running(false), failed(false), journaled(nullptr), reported(false), sent(0),
+		journalBytes(0), liveBytes(0) {}
+
+	~Autosave() {
+		stop(false);
+	}
+
+	Autosave(const Autosave&) = delete;
+	Autosave& operator=(const Autosave&) = delete;
+
+	// Makes this instance the only one journaling to 'journalPath'; call
+	// before replaying it, so a second instance cannot take over a journal
+	// that is still live
+	bool claim(const std::string& journalPath) {
+		return lock.acquire(journalPath + ".lock");
+	}
+
+	// Starts the journal at 'journalPath' over, holding the scene as it is.
+	// The old journal is replaced only once the new one is on disk, so a
+	// crash here still finds what was recovered from it.
+	bool start(Scene& scene, const std::string& journalPath) {
+		stop(false);
+		if (!claim(journalPath)) return false;
+		path = journalPath;
+		journaled = &scene;
+		queued.clear();
+		pending.clear();
+		sent = 0;
+		snapshot(scene);
+		inbox.assign(pending.begin(), pending.end());   // the writer is not running yet
+		pending.clear();
+		size_t frames = fold();
+		bool replaced = replaceJournal(inbox.data(), frames);
+		inbox.clear();
+		if (!replaced || !openJournal()) return false;
+		failed = false;
+		reported = false;
+		running = true;
+		writer = std::thread(&Autosave::writerLoop, this);
+		return true;
+	}
+
+	// Waits until everything recorded is on disk, then ends the writer. A
+	// clean exit discards the journal, as there is nothing to recover, and
+	// gives up the claim on it.
+	void stop(bool discard) {
+		if (writer.joinable()) {
+			while (backlogged()) {
+				pump();
+				std::this_thread::yield();
+			}
+			running.store(false, std::memory_order_release);
+			writer.join();
+			file.close();
+			if (discard) std::remove(path.c_str());
+		}
+		if (discard) lock.release();
+	}
+
+	// The group's state after an edit. Only the handles are kept here;
+	// pump() packs the shapes as they are by then, a batch at a time, so
+	// a later state is journaled at worst, never an older one.
+	void record(const std::vector<ShapeHandle>& group, bool transformsOnly = false) {
+		if (!writer.joinable() || group.empty()) return;
+		queued.push_back(Queued{ std::move(spare), 0, transformsOnly });
+		queued.back().group.assign(group.begin(), group.end());
+		pump();
+	}
+
+	// The whole scene changed, e.g. a file was opened. Whatever was still
+	// queued is superseded.
+	void reset(Scene& scene) {
+		if (!writer.joinable()) return;
+		queued.clear();
+		symbolNumbers.clear();
+		symbolsSent.clear();
+		closeFrame(openFrame(JournalOp::RESET));
+		Queued everything = { std::vector<ShapeHandle>(), 0, false };
+		scene.handles(everything.group);
+		if (!everything.group.empty()) queued.push_back(std::move(everything));
+		pump();
+	}
+
+	// Call every frame: packs the next batch of queued shapes and moves
+	// packed frames into the ring as room allows
+	void pump() {
+		if (failed && !reported) {
+			std::cout << "Autosave could not write " << path << "\n";
+			reported = true;
+		}
+		for (size_t budget = JOURNAL_PACK_BATCH; budget > 0 && !queued.empty();) {
+			Queued& work = queued.front();
+			size_t count = std::min(budget, work.group.size() - work.next);
+			pack(*journaled, work.group.data() + work.next, count, work.transformsOnly);
+			work.next += count;
+			budget -= count;
+			if (work.next == work.group.size()) {
+				spare = std::move(work.group);
+				queued.pop_front();
+			}
+		}
+		if (sent == pending.size()) return;
+		sent += ring.push(pending.data() + sent, pending.size() - sent);
+		if (sent == pending.size()) {
+			pending.clear();
+			sent = 0;
+		}
+		else if (sent > pending.size() / 2) {
+			pending.erase(pending.begin(), pending.begin() + sent);
+			sent = 0;
+		}
+	}
+
+	// Shapes are still waiting to be packed, or frames for room in the ring
+	bool backlogged() const {
+		return !queued.empty() || sent < pending.size();
+	}
+
+	// Replaces the scene with a journal's contents. A torn or damaged frame
+	// ends the replay; everything before it is kept.
+	static bool replay(Scene& scene, const std::string& journalPath, ReplayStats& stats) {
+		auto start = std::chrono::steady_clock::now();
+		stats = ReplayStats{ 0, 0, 0, 0 };
+		MappedFile file;
+		if (!file.open(journalPath) || file.size() < 8 ||
+			!std::equal(JOURNAL_MAGIC, JOURNAL_MAGIC + 4, file.bytes())) return false;
+		std::uint32_t version;
+		std::memcpy(&version, file.bytes() + 4, 4);
+		if (version != JOURNAL_VERSION) return false;
+
+		// Frames fold into one bin, the newest per slot, which goes into
+		// the scene in a single putBack. A slot number only names a shape
+		// within the file and never sizes anything, so a damaged one cannot
+		// ask for gigabytes.
+		ShapeBin bin;
+		std::unordered_map<std::uint32_t, std::uint32_t> entryOf;   // slot -> bin entry
+		std::unordered_map<std::uint32_t, std::shared_ptr<Symbol>> symbols;
+		auto entry = [&](std::uint32_t slot, std::uint32_t generation) -> ShapeBin::Entry* {
+			auto found = entryOf.find(slot);
+			if (found == entryOf.end() || bin.entries[found->second].handle.generation != generation) return nullptr;
+			return &bin.entries[found->second];
+		};
+		auto drop = [&](std::uint32_t slot) {
+			auto found = entryOf.find(slot);
+			if (found == entryOf.end()) return;
+			bin.entries[found->second].handle = ShapeHandle();
+			entryOf.erase(found);
+		};
+
+		size_t at = 8;
+		while (at + JOURNAL_FRAME_HEADER <= file.size()) {
+			std::uint32_t length;
+			std::memcpy(&length, file.bytes() + at, 4);
+			JournalOp op = static_cast<JournalOp>(file.bytes()[at + 4]);
+			if (length > file.size() - at - JOURNAL_FRAME_HEADER) break;
+			Reader in(file.bytes() + at + JOURNAL_FRAME_HEADER, length);
+
+			bool good = true;
+			if (op == JournalOp::RESET) {
+				bin.clear();
+				entryOf.clear();
+				symbols.clear();
+			}
+			else if (op == JournalOp::REMOVE) {
+				std::uint32_t slot = 0, generation = 0;
+				good = in.get(slot) && in.get(generation);
+				if (good && entry(slot, generation)) drop(slot);
+			}
+			else if (op == JournalOp::TRANSFORM) {
+				std::uint32_t slot = 0, generation = 0;
+				Transform2D transform;
+				good = in.get(slot) && in.get(generation) && in.get(transform);
+				ShapeBin::Entry* target = good ? entry(slot, generation) : nullptr;
+				if (target) bin.shapeAt(*target).setTransform(transform);
+			}
+			else if (op == JournalOp::SYMBOL) {
+				std::uint32_t number = 0, color = 0, nameLength = 0, parts = 0;
+				good = in.get(number) && in.get(color) && in.get(nameLength) && nameLength <= in.left();
+				std::string name;
+				if (good) name.assign(reinterpret_cast<const char*>(in.skip(nameLength)), nameLength);
+				good = good && in.get(parts);
+				auto symbol = std::make_shared<Symbol>(name, sf::Color(color));
+				for (std::uint32_t i = 0; good && i < parts; i++) {
+					ShapeRecord record;
+					const sf::Vector2f* points = nullptr;
+					good = readShape(in, record, points) && record.kind != static_cast<std::uint8_t>(ShapeKind::INSTANCE);
+					if (good) unpackShape(record, points, nullptr, [&](auto part) { symbol->addPart(std::move(part)); });
+				}
+				if (good) symbols[number] = symbol;
+			}
+			else if (op == JournalOp::UPSERT) {
+				JournalShape head;
+				ShapeRecord record;
+				const sf::Vector2f* points = nullptr;
+				good = in.get(head) && readShape(in, record, points) && head.layer < MAX_LAYERS &&
+					head.slot != ShapeHandle::NONE;
+				bool instance = record.kind == static_cast<std::uint8_t>(ShapeKind::INSTANCE);
+				auto symbol = symbols.find(head.symbol);
+				if (good && instance && symbol == symbols.end()) good = false;
+				if (good) {
+					drop(head.slot);
+					entryOf[head.slot] = static_cast<std::uint32_t>(bin.entries.size());
+					unpackShape(record, points, instance ? symbol->second : nullptr, [&](auto shape) {
+						bin.add(ShapeHandle(head.slot, head.generation), head.layer, head.serial, std::move(shape));
+					});
+				}
+			}
+			else {
+				good = false;
+			}
+			if (!good) break;
+			at += JOURNAL_FRAME_HEADER + length;
+			stats.frames++;
+		}
+
+		// The survivors take consecutive slots; start() journals them afresh
+		bin.entries.erase(std::remove_if(bin.entries.begin(), bin.entries.end(),
+			[](const ShapeBin::Entry& e) { return e.handle.isNull(); }), bin.entries.end());
+		for (size_t i = 0; i < bin.entries.size(); i++) bin.entries[i].handle.slot = static_cast<unsigned int>(i);
+		scene.clear();
+		scene.resetLayers();
+		scene.putBack(bin);
+
+		stats.shapes = scene.size();
+		stats.bytes = at;
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+private:
+	// An edit's shapes, packed from 'next' on
+	struct Queued {
+		std::vector<ShapeHandle> group;
+		size_t next;
+		bool transformsOnly;
+	};
+
+	// Where a frame's byte range sits in the writer's arena
+	struct Kept {
+		size_t offset, length;
+		std::uint32_t generation;
+	};
+
+	// Bounds-checked cursor over a frame's payload
+	struct Reader {
+		const unsigned char* data;
+		size_t size, at;
+
+		Reader(const unsigned char* bytes, size_t length) : data(bytes), size(length), at(0) {}
+
+		size_t left() const { return size - at; }
+
+		const unsigned char* skip(size_t count) {
+			const unsigned char* p = data + at;
+			at += count;
+			return p;
+		}
+
+		template <typename T>
+		bool get(T& value) {
+			if (left() < sizeof(T)) return false;
+			std::memcpy(&value, skip(sizeof(T)), sizeof(T));
+			return true;
+		}
+	};
+
+	// Record plus its vertices, which are only valid while the file is
+	static bool readShape(Reader& in, ShapeRecord& record, const sf::Vector2f*& points) {
+		StrokeStyle style;
+		if (!in.get(record) || record.kind >= SHAPE_KINDS || !strokeFor(record, style) ||
+			record.vertexCount > in.left() / sizeof(sf::Vector2f)) return false;
+		points = reinterpret_cast<const sf::Vector2f*>(in.skip(record.vertexCount * sizeof(sf::Vector2f)));
+		return validShape(record, points);
+	}
+
+	ByteRing ring;
+	std::thread writer;
+	std::atomic<bool> running;
+	std::atomic<bool> failed;
+	std::string path;
+
+	// Event loop side
+	Scene* journaled;                     // the scene start() was given
+	bool reported;
+	std::deque<Queued> queued;            // recorded edits not yet packed
+	std::vector<ShapeHandle> spare;       // a packed edit's storage, reused for the next
+	std::vector<unsigned char> pending;   // packed frames not yet in the ring
+	size_t sent;                          // how much of 'pending' the ring has taken
+	std::vector<sf::Vector2f> points;
+	std::unordered_map<const Symbol*, std::uint32_t> symbolNumbers;
+	std::vector<std::shared_ptr<Symbol>> symbolsSent;   // keeps numbered symbols' addresses unique
+
+	FileLock lock;                        // on 'path' + ".lock"
+
+	// Writer side
+	std::ofstream file;
+	std::vector<unsigned char> inbox;     // popped bytes; may end in part of a frame
+	std::vector<unsigned char> arena;     // the newest frame of each live shape and symbol
+	std::unordered_map<std::uint32_t, Kept> keptShapes;    // by slot
+	std::unordered_map<std::uint32_t, Kept> keptSymbols;   // by number
+	size_t journalBytes;
+	size_t liveBytes;
+
+	// Packs frames for the shapes' current state into 'pending'
+	void pack(Scene& scene, const ShapeHandle* group, size_t count, bool transformsOnly) {
+		if (transformsOnly) pending.reserve(pending.size() + count * TRANSFORM_FRAME);
+		for (size_t i = 0; i < count; i++) {
+			const ShapeHandle& handle = group[i];
+			bool live = scene.visitShape(handle, [&](const auto& shape, int layer, unsigned long long serial) {
+				if (transformsOnly) {
+					packTransformFrame(handle, shape.transform);
+				}
+				else {
+					packShapeFrame(handle, shape, layer, serial);
+				}
+			});
+			if (!live) {
+				size_t frame = openFrame(JournalOp::REMOVE);
+				put(handle.slot);
+				put(handle.generation);
+				closeFrame(frame);
+			}
+		}
+
+	}
+
+	// A RESET frame followed by the whole scene
+	void snapshot(Scene& scene) {
+		symbolNumbers.clear();
+		symbolsSent.clear();
+		closeFrame(openFrame(JournalOp::RESET));
+		std::vector<ShapeHandle> everything;
+		scene.handles(everything);
+		pack(scene, everything.data(), everything.size(), false);
+	}
+
+	size_t openFrame(JournalOp op) {
+		size_t frame = pending.size();
+		pending.resize(frame + JOURNAL_FRAME_HEADER);
+		pending[frame + 4] = static_cast<unsigned char>(op);
+		return frame;
+	}
+
+	void closeFrame(size_t frame) {
+		std::uint32_t length = static_cast<std::uint32_t>(pending.size() - frame - JOURNAL_FRAME_HEADER);
+		std::memcpy(&pending[frame], &length, 4);
+	}
+
+	void append(const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		pending.insert(pending.end(), bytes, bytes + size);
+	}
+
+	template <typename T>
+	void put(const T& value) {
+		append(&value, sizeof(T));
+	}
+
+	static const size_t TRANSFORM_FRAME = JOURNAL_FRAME_HEADER + 8 + sizeof(Transform2D);
+
+	// The frame a held key or drag ends with for every selected shape, so
+	// it is built in place and appended once
+	void packTransformFrame(ShapeHandle handle, const Transform2D& transform) {
+		unsigned char frame[TRANSFORM_FRAME];
+		std::uint32_t length = TRANSFORM_FRAME - JOURNAL_FRAME_HEADER;
+		std::memcpy(frame, &length, 4);
+		frame[4] = static_cast<unsigned char>(JournalOp::TRANSFORM);
+		std::memcpy(frame + 5, &handle.slot, 4);
+		std::memcpy(frame + 9, &handle.generation, 4);
+		std::memcpy(frame + 13, &transform, sizeof(Transform2D));
+		append(frame, TRANSFORM_FRAME);
+	}
+
+	template <typename T>
+	void packShapeFrame(ShapeHandle handle, const T& shape, int layer, unsigned long long serial) {
+		JournalShape head = {};
+		head.slot = handle.slot;
+		head.generation = handle.generation;
+		head.serial = serial;
+		head.symbol = numberFor(shape);
+		head.layer = static_cast<std::uint8_t>(layer);
+
+		size_t frame = openFrame(JournalOp::UPSERT);
+		put(head);
+		appendShape(shape);
+		closeFrame(frame);
+	}
+
+	template <typename T>
+	void appendShape(const T& shape) {
+		ShapeRecord record = recordFor(shape, T::KIND);
+		points.clear();
+		packShape(shape, record, points);
+		record.firstVertex = 0;
+		put(record);
+		append(points.data(), points.size() * sizeof(sf::Vector2f));
+	}
+
+	std::uint32_t numberFor(const Shape&) {
+		return 0;
+	}
+
+	// A symbol is sent once, before the first instance that needs it
+	std::uint32_t numberFor(const Instance& instance) {
+		auto found = symbolNumbers.find(instance.symbol.get());
+		if (found != symbolNumbers.end()) return found->second;
+		std::uint32_t number = static_cast<std::uint32_t>(symbolsSent.size());
+		symbolNumbers[instance.symbol.get()] = number;
+		symbolsSent.push_back(instance.symbol);
+
+		Symbol& symbol = *instance.symbol;
+		std::uint32_t parts = 0;
+		symbol.forEachPart([&](const auto&) { parts++; });
+		size_t frame = openFrame(JournalOp::SYMBOL);
+		put(number);
+		put(symbol.color.toInteger());
+		put(static_cast<std::uint32_t>(symbol.name.size()));
+		append(symbol.name.data(), symbol.name.size());
+		put(parts);
+		symbol.forEachPart([&](const auto& part) { appendShape(part); });
+		closeFrame(frame);
+		return number;
+	}
+
+	bool openJournal() {
+		file.close();
+		file.clear();
+		file.open(path, std::ios::binary | std::ios::out | std::ios::app);
+		return static_cast<bool>(file);
+	}
+
+	// The frames become the whole journal. They go to a new file that is
+	// synced before it is renamed over the old one, so a crash at any point
+	// leaves one complete journal or the other. The caller reopens it.
+	bool replaceJournal(const unsigned char* frames, size_t size) {
+		std::string temporary = path + ".tmp";
+		bool replaced = writeSynced(temporary, { { JOURNAL_MAGIC, 4 }, { &JOURNAL_VERSION, 4 }, { frames, size } });
+		if (replaced) {
+			file.close();
+			replaced = replaceFile(temporary, path);
+		}
+		if (replaced) journalBytes = 8 + size;
+		else std::remove(temporary.c_str());
+		return replaced;
+	}
+
+	void writerLoop() {
+		for (;;) {
+			// Read before draining, so nothing pushed before stop() is missed
+			bool stopping = !running.load(std::memory_order_acquire);
+			if (ring.pop(inbox) == 0) {
+				if (stopping) break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(JOURNAL_POLL_MS));
+				continue;
+			}
+			absorb();
+		}
+	}
+
+	// Folds the whole frames at the front of the inbox into the arena and
+	// returns their length; a partial frame waits for the rest of its bytes
+	size_t fold() {
+		size_t at = 0;
+		while (at + JOURNAL_FRAME_HEADER <= inbox.size()) {
+			std::uint32_t length;
+			std::memcpy(&length, &inbox[at], 4);
+			size_t frameLength = JOURNAL_FRAME_HEADER + length;
+			if (frameLength > inbox.size() - at) break;
+			keep(static_cast<JournalOp>(inbox[at + 4]), at, frameLength);
+			at += frameLength;
+		}
+		return at;
+	}
+
+	// Appends the whole frames in the inbox to the journal
+	void absorb() {
+		size_t at = fold();
+		if (at == 0) return;
+
+		file.write(reinterpret_cast<const char*>(inbox.data()), at);
+		file.flush();
+		if (!file) failed = true;
+		journalBytes += at;
+		inbox.erase(inbox.begin(), inbox.begin() + at);
+
+		if (journalBytes > 2 * liveBytes + JOURNAL_COMPACT_MIN) compact();
+	}
+
+	void keep(JournalOp op, size_t frame, size_t length) {
+		const unsigned char* payload = &inbox[frame + JOURNAL_FRAME_HEADER];
+		std::uint32_t key = 0, generation = 0;
+		if (length >= JOURNAL_FRAME_HEADER + 8) {
+			std::memcpy(&key, payload, 4);
+			std::memcpy(&generation, payload + 4, 4);
+		}
+
+		switch (op) {
+		case JournalOp::RESET:
+			arena.clear();
+			keptShapes.clear();
+			keptSymbols.clear();
+			liveBytes = 0;
+			break;
+		case JournalOp::SYMBOL:
+			store(keptSymbols[key], frame, length, 0);
+			break;
+		case JournalOp::UPSERT:
+			store(keptShapes[key], frame, length, generation);
+			break;
+		case JournalOp::REMOVE: {
+			auto found = keptShapes.find(key);
+			if (found != keptShapes.end() && found->second.generation == generation) {
+				liveBytes -= found->second.length;
+				keptShapes.erase(found);
+			}
+			break;
+		}
+		case JournalOp::TRANSFORM: {
+			// Patched into the kept UPSERT, which stays the shape's only frame
+			auto found = keptShapes.find(key);
+			if (found != keptShapes.end() && found->second.generation == generation &&
+				length >= JOURNAL_FRAME_HEADER + 8 + sizeof(Transform2D)) {
+				std::memcpy(&arena[found->second.offset + JOURNAL_TRANSFORM_AT], payload + 8, sizeof(Transform2D));
+			}
+			break;
+		}
+		}
+	}
+
+	void store(Kept& kept, size_t frame, size_t length, std::uint32_t generation) {
+		liveBytes -= kept.length;   // zero for a new entry
+		kept.offset = arena.size();
+		kept.length = length;
+		kept.generation = generation;
+		arena.insert(arena.end(), inbox.begin() + frame, inbox.begin() + frame + length);
+		liveBytes += length;
+	}
+
+	// Rewrites the journal as just the live frames, symbols first. The new
+	// file replaces the old one only once it is complete.
+	void compact() {
+		std::vector<unsigned char> fresh;
+		fresh.reserve(liveBytes);
+		auto move = [&](std::unordered_map<std::uint32_t, Kept>& kept) {
+			for (auto& entry : kept) {
+				size_t offset = fresh.size();
+				fresh.insert(fresh.end(), arena.begin() + entry.second.offset,
+					arena.begin() + entry.second.offset + entry.second.length);
+				entry.second.offset = offset;
+			}
+		};
+		move(keptSymbols);
+		move(keptShapes);
+		arena.swap(fresh);
+
+		// On failure, keep appending to the old journal
+		replaceJournal(arena.data(), arena.size());
+		if (!openJournal()) failed = true;
+	}
+};
+
+// ============================================================================
+// SVG IMPORT (STREAMING)
+// ============================================================================
+// Reads the file in fixed-size chunks and handles each element as soon as
+// its closing '>' arrives, so memory is bounded by the largest single tag,
+// not the file. Shapes go straight into the scene, whose per-shape pick
+// bounds are filled in as they are added. Stroke width, dashes, joins and
+// caps are read per element; styles inherited from groups, transforms,
+// units and CSS classes are ignored. Arcs are skipped but keep the pen
+// position right.
+class SvgImporter {
+public:
+	struct Stats {
+		size_t shapes;
+		size_t skipped;      // unsupported path segments
+		size_t bytes;
+		double seconds;
+
+		double shapesPerSecond() const {
+			return seconds > 0 ? shapes / seconds : 0;
+		}
+	};
+
+	explicit SvgImporter(Scene& target) : scene(target) {}
+
+	bool import(const std::string& path, Stats& stats) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) return false;
+
+		auto start = std::chrono::steady_clock::now();
+		stats = Stats{ 0, 0, 0, 0 };
+		shapes = 0;
+		skipped = 0;
+
+		const size_t CHUNK = 1 << 16;
+		std::string pending;
+		std::vector<char> chunk(CHUNK);
+		size_t cursor = 0;
+
+		while (in) {
+			in.read(chunk.data(), CHUNK);
+			size_t got = static_cast<size_t>(in.gcount());
+			if (got == 0) break;
+			stats.bytes += got;
+
+			// Drop what was consumed before growing the buffer
+			pending.erase(0, cursor);
+			cursor = 0;
+			pending.append(chunk.data(), got);
+			cursor = scanTags(pending);
+		}
+
+		stats.shapes = shapes;
+		stats.skipped = skipped;
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return true;
 	}
 
 private:
-	void drawBresenhamLine(std::vector<sf::RectangleShape>& pixels,
-		sf::Vector2f p1, sf::Vector2f p2) {
-		int x1 = static_cast<int>(std::round(p1.x));
-		int y1 = static_cast<int>(std::round(p1.y));
-		int x2 = static_cast<int>(std::round(p2.x));
-		int y2 = static_cast<int>(std::round(p2.y));
-
-		int dx = std::abs(x2 - x1);
-		int dy = std::abs(y2 - y1);
-		int sx = (x1 < x2) ? 1 : -1;
-		int sy = (y1 < y2) ? 1 : -1;
-		int err = dx - dy;
+	struct Attribute {
+		const char* name;
+		size_t nameLength;
+		const char* value;
+		size_t valueLength;
+	};
+
+	Scene& scene;
+	std::vector<Attribute> attributes;
+	std::vector<sf::Vector2f> points;
+	StrokeStyle style;   // stroke of the element being read
+	size_t shapes;
+	size_t skipped;
+
+	// Handles every complete tag in 'text'; returns where the first
+	// incomplete one starts
+	size_t scanTags(const std::string& text) {
+		size_t pos = 0;
+		const size_t size = text.size();
+		while (true) {
+			size_t open = text.find('<', pos);
+			if (open == std::string::npos) return size;
+
+			// Comments and CDATA end with their own terminator
+			if (text.compare(open, 4, "<!--") == 0 || text.compare(open, 9, "<![CDATA[") == 0) {
+				const char* terminator = (text[open + 2] == '-') ? "-->" : "]]>";
+				size_t close = text.find(terminator, open + 4);
+				if (close == std::string::npos) return open;
+				pos = close + 3;
+				continue;
+			}
+
+			// Find the closing '>' outside quoted attribute values
+			char quote = 0;
+			size_t close = open + 1;
+			for (; close < size; close++) {
+				char c = text[close];
+				if (quote) {
+					if (c == quote) quote = 0;
+				}
+				else if (c == '"' || c == '\'') {
+					quote = c;
+				}
+				else if (c == '>') {
+					break;
+				}
+			}
+			if (close >= size) return open;
+
+			element(text.data() + open + 1, text.data() + close);
+			pos = close + 1;
+		}
+	}
+
+	void element(const char* begin, const char* end) {
+		if (begin == end || *begin == '/' || *begin == '?' || *begin == '!') return;
+
+		const char* nameEnd = begin;
+		while (nameEnd < end && !std::isspace(static_cast<unsigned char>(*nameEnd)) && *nameEnd != '/') nameEnd++;
+		std::string name(begin, nameEnd);
+		if (name != "line" && name != "circle" && name != "ellipse" && name != "rect" &&
+			name != "polygon" && name != "polyline" && name != "path") return;
+
+		parseAttributes(nameEnd, end);
+		sf::Color stroke = colorOf("stroke", sf::Color::White);
+		bool hasFill = false;
+		sf::Color fill = fillOf(hasFill);
+		sf::Color outline = hasAttribute("stroke") || !hasFill ? stroke : fill;
+		style = strokeStyleOf();
+
+		if (name == "line") {
+			addShape(Line(sf::Vector2f(number("x1"), number("y1")),
+				sf::Vector2f(number("x2"), number("y2")), Line::BRESENHAM, stroke));
+		}
+		else if (name == "circle") {
+			addShape(Circle(sf::Vector2f(number("cx"), number("cy")), number("r"), outline));
+		}
+		else if (name == "ellipse") {
+			addShape(Ellipse(sf::Vector2f(number("cx"), number("cy")), number("rx"), number("ry"), outline, hasFill));
+		}
+		else if (name == "rect") {
+			float x = number("x"), y = number("y");
+			float w = number("width"), h = number("height");
+			addShape(Polygon({ sf::Vector2f(x, y), sf::Vector2f(x + w, y),
+				sf::Vector2f(x + w, y + h), sf::Vector2f(x, y + h) }, outline, hasFill, fillRuleOf()));
+		}
+		else if (name == "polygon" || name == "polyline") {
+			points.clear();
+			const Attribute* list = find("points");
+			if (list) {
+				const char* p = list->value;
+				const char* listEnd = p + list->valueLength;
+				float x, y;
+				while (nextNumber(p, listEnd, x) && nextNumber(p, listEnd, y)) {
+					points.push_back(sf::Vector2f(x, y));
+				}
+			}
+
+			// A polyline is open, so it becomes a chain of segments
+			if (name == "polygon" && points.size() >= 3) {
+				addShape(Polygon(points, outline, hasFill, fillRuleOf()));
+			}
+			else {
+				for (size_t i = 1; i < points.size(); i++) {
+					addShape(Line(points[i - 1], points[i], Line::BRESENHAM, stroke));
+				}
+			}
+		}
+		else {
+			const Attribute* data = find("d");
+			if (data) parsePath(data->value, data->value + data->valueLength, stroke);
+		}
+	}
+
+	template <typename T>
+	void addShape(T shape) {
+		shape.stroke = style;
+		scene.add(std::move(shape));
+		shapes++;
+	}
+
+	// Path data: M L H V C S Q T Z (absolute and relative). C/S become cubic
+	// and Q/T quadratic Bezier curves; straight segments become lines.
+	void parsePath(const char* p, const char* end, sf::Color color) {
+		sf::Vector2f current(0, 0), subpathStart(0, 0), lastControl(0, 0);
+		char command = 0, previous = 0;
+		float v[7];
+
+		while (true) {
+			while (p < end && (std::isspace(static_cast<unsigned char>(*p)) || *p == ',')) p++;
+			if (p >= end) return;
+
+			if (std::isalpha(static_cast<unsigned char>(*p))) {
+				command = *p++;
+			}
+			else if (command == 0) {
+				return;
+			}
+
+			char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(command)));
+			bool relative = command != upper;
+			sf::Vector2f base = relative ? current : sf::Vector2f(0, 0);
+
+			if (upper == 'Z') {
+				if (current != subpathStart) addShape(Line(current, subpathStart, Line::BRESENHAM, color));
+				current = subpathStart;
+				previous = 'Z';
+				command = 0;
+				continue;
+			}
+
+			int arity = 0;
+			switch (upper) {
+			case 'M': case 'L': case 'T': arity = 2; break;
+			case 'H': case 'V': arity = 1; break;
+			case 'C': arity = 6; break;
+			case 'S': case 'Q': arity = 4; break;
+			case 'A': arity = 7; break;
+			default: return;
+			}
+			for (int i = 0; i < arity; i++) {
+				if (!nextNumber(p, end, v[i])) return;
+			}
 
+			// Smooth segments reflect the previous control point
+			sf::Vector2f reflected = current;
+			if ((upper == 'S' && (previous == 'C' || previous == 'S')) ||
+				(upper == 'T' && (previous == 'Q' || previous == 'T'))) {
+				reflected = current * 2.0f - lastControl;
+			}
+
+			sf::Vector2f next;
+			switch (upper) {
+			case 'M':
+				next = base + sf::Vector2f(v[0], v[1]);
+				subpathStart = next;
+				command = relative ? 'l' : 'L';   // further pairs are line-tos
+				break;
+			case 'L':
+				next = base + sf::Vector2f(v[0], v[1]);
+				addShape(Line(current, next, Line::BRESENHAM, color));
+				break;
+			case 'H':
+				next = sf::Vector2f(relative ? current.x + v[0] : v[0], current.y);
+				addShape(Line(current, next, Line::BRESENHAM, color));
+				break;
+			case 'V':
+				next = sf::Vector2f(current.x, relative ? current.y + v[0] : v[0]);
+				addShape(Line(current, next, Line::BRESENHAM, color));
+				break;
+			case 'C':
+			case 'S': {
+				sf::Vector2f c1 = (upper == 'C') ? base + sf::Vector2f(v[0], v[1]) : reflected;
+				const float* rest = (upper == 'C') ? v + 2 : v;
+				lastControl = base + sf::Vector2f(rest[0], rest[1]);
+				next = base + sf::Vector2f(rest[2], rest[3]);
+				addShape(BezierCurve({ current, c1, lastControl, next }, color));
+				break;
+			}
+			case 'Q':
+			case 'T':
+				lastControl = (upper == 'Q') ? base + sf::Vector2f(v[0], v[1]) : reflected;
+				next = base + ((upper == 'Q') ? sf::Vector2f(v[2], v[3]) : sf::Vector2f(v[0], v[1]));
+				addShape(BezierCurve({ current, lastControl, next }, color));
+				break;
+			case 'A':
+				next = base + sf::Vector2f(v[5], v[6]);
+				skipped++;
+				break;
+			}
+			current = next;
+			previous = upper;
+		}
+	}
+
+	void parseAttributes(const char* p, const char* end) {
+		attributes.clear();
 		while (true) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(static_cast<float>(x1), static_cast<float>(y1));
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
+			while (p < end && (std::isspace(static_cast<unsigned char>(*p)) || *p == '/')) p++;
+			const char* name = p;
+			while (p < end && *p != '=' && !std::isspace(static_cast<unsigned char>(*p))) p++;
+			const char* nameEnd = p;
+			while (p < end && std::isspace(static_cast<unsigned char>(*p))) p++;
+			if (p >= end || *p != '=') return;
+			p++;
+			while (p < end && std::isspace(static_cast<unsigned char>(*p))) p++;
+			if (p >= end || (*p != '"' && *p != '\'')) return;
+
+			char quote = *p++;
+			const char* value = p;
+			while (p < end && *p != quote) p++;
+			attributes.push_back(Attribute{ name, static_cast<size_t>(nameEnd - name),
+				value, static_cast<size_t>(p - value) });
+			if (p < end) p++;
+		}
+	}
+
+	const Attribute* find(const char* name) const {
+		size_t length = std::strlen(name);
+		for (auto& attribute : attributes) {
+			if (attribute.nameLength == length && std::memcmp(attribute.name, name, length) == 0) {
+				return &attribute;
+			}
+		}
+		return nullptr;
+	}
+
+	bool hasAttribute(const char* name) const {
+		return find(name) != nullptr || !styleValue(name).empty();
+	}
+
+	float number(const char* name) const {
+		const Attribute* attribute = find(name);
+		float value = 0;
+		if (attribute) {
+			const char* p = attribute->value;
+			nextNumber(p, p + attribute->valueLength, value);
+		}
+		return value;
+	}
+
+	// Presentation attribute, or the same property inside style="..."
+	std::string property(const char* name) const {
+		std::string inStyle = styleValue(name);
+		if (!inStyle.empty()) return inStyle;
+		const Attribute* attribute = find(name);
+		return attribute ? std::string(attribute->value, attribute->valueLength) : std::string();
+	}
+
+	std::string styleValue(const char* name) const {
+		const Attribute* style = find("style");
+		if (!style) return std::string();
+		std::string text(style->value, style->valueLength);
+		std::string key = std::string(name) + ":";
+		size_t at = 0;
+		while ((at = text.find(key, at)) != std::string::npos) {
+			if (at == 0 || text[at - 1] == ';' || std::isspace(static_cast<unsigned char>(text[at - 1]))) break;
+			at += key.size();
+		}
+		if (at == std::string::npos) return std::string();
+		size_t begin = text.find_first_not_of(' ', at + key.size());
+		if (begin == std::string::npos) return std::string();
+		size_t stop = text.find(';', begin);
+		return text.substr(begin, stop == std::string::npos ? std::string::npos : stop - begin);
+	}
+
+	sf::Color colorOf(const char* name, sf::Color fallback) const {
+		std::string value = property(name);
+		sf::Color color;
+		return parseColor(value, color) ? color : fallback;
+	}
+
+	// SVG fills by default; only an explicit fill is honoured here since the
+	// default black would vanish on the canvas
+	sf::Color fillOf(bool& filled) const {
+		std::string value = property("fill");
+		sf::Color color;
+		filled = value != "none" && parseColor(value, color);
+		return filled ? color : sf::Color::White;
+	}
+
+	FillRule fillRuleOf() const {
+		return property("fill-rule") == "evenodd" ? FillRule::EVEN_ODD : FillRule::NON_ZERO;
+	}
+
+	// The default 1-unit stroke stays a hairline. Odd dash lists repeat
+	// in SVG; a single length becomes on/off, longer ones are cut to pairs.
+	StrokeStyle strokeStyleOf() const {
+		StrokeStyle result;
+		std::string width = property("stroke-width");
+		if (!width.empty()) {
+			float w = std::strtof(width.c_str(), nullptr);
+			if (w > 1) result.width = std::min(w, MAX_STROKE_WIDTH);
+		}
+
+		std::string dashes = property("stroke-dasharray");
+		const char* p = dashes.c_str();
+		float length;
+		while (result.dashCount < StrokeStyle::MAX_DASHES && nextNumber(p, p + dashes.size(), length)) {
+			result.dashes[result.dashCount++] = std::max(0.0f, length);
+		}
+		if (result.dashCount == 1) {
+			result.dashes[1] = result.dashes[0];
+			result.dashCount = 2;
+		}
+		result.dashCount &= ~1;
+
+		std::string join = property("stroke-linejoin");
+		if (join == "round") result.join = LineJoin::ROUND;
+		else if (join == "bevel") result.join = LineJoin::BEVEL;
+
+		std::string cap = property("stroke-linecap");
+		if (cap == "round") result.cap = LineCap::ROUND;
+		else if (cap == "square") result.cap = LineCap::SQUARE;
+		return result;
+	}
+
+	static bool parseColor(const std::string& value, sf::Color& color) {
+		if (value.empty() || value == "none") return false;
+		if (value[0] == '#') {
+			unsigned long rgb = std::strtoul(value.c_str() + 1, nullptr, 16);
+			if (value.size() == 4) {
+				color = sf::Color(static_cast<sf::Uint8>(((rgb >> 8) & 0xF) * 17),
+					static_cast<sf::Uint8>(((rgb >> 4) & 0xF) * 17), static_cast<sf::Uint8>((rgb & 0xF) * 17));
+			}
+			else {
+				color = sf::Color(static_cast<sf::Uint8>(rgb >> 16), static_cast<sf::Uint8>(rgb >> 8),
+					static_cast<sf::Uint8>(rgb));
+			}
+			return true;
+		}
+		if (value.compare(0, 4, "rgb(") == 0) {
+			const char* p = value.c_str() + 4;
+			const char* end = value.c_str() + value.size();
+			float r = 0, g = 0, b = 0;
+			nextNumber(p, end, r);
+			nextNumber(p, end, g);
+			nextNumber(p, end, b);
+			color = sf::Color(static_cast<sf::Uint8>(r), static_cast<sf::Uint8>(g), static_cast<sf::Uint8>(b));
+			return true;
+		}
+
+		static const struct { const char* name; sf::Color color; } named[] = {
+			{ "black", sf::Color::Black }, { "white", sf::Color::White }, { "red", sf::Color::Red },
+			{ "green", sf::Color(0, 128, 0) }, { "lime", sf::Color::Green }, { "blue", sf::Color::Blue },
+			{ "yellow", sf::Color::Yellow }, { "cyan", sf::Color::Cyan }, { "magenta", sf::Color::Magenta },
+			{ "gray", sf::Color(128, 128, 128) }, { "grey", sf::Color(128, 128, 128) },
+			{ "orange", sf::Color(255, 165, 0) }
+		};
+		for (auto& entry : named) {
+			if (value == entry.name) {
+				color = entry.color;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Next number in a list separated by whitespace and/or commas
+	static bool nextNumber(const char*& p, const char* end, float& out) {
+		while (p < end && (std::isspace(static_cast<unsigned char>(*p)) || *p == ',')) p++;
+		if (p >= end) return false;
+		char* stop = nullptr;
+		out = std::strtof(p, &stop);
+		if (stop == p || stop > end) return false;
+		p = stop;
+		return true;
+	}
+};
+
+// ============================================================================
+// TILED RASTER EXPORT (PPM / PNG)
+// ============================================================================
+// Streams an image to disk one row at a time. PNG output uses stored
+// (uncompressed) deflate blocks, so no compression library is needed and
+// every row can be written as soon as it is finished.
+class ImageStreamWriter {
+public:
+	ImageStreamWriter() : png(false), width(0), adlerA(1), adlerB(0) {}
+
+	bool open(const std::string& path, unsigned int w, unsigned int h) {
+		std::string extension = path.size() > 4 ? path.substr(path.size() - 4) : "";
+		png = (extension == ".png" || extension == ".PNG");
+		width = w;
+		out.open(path, std::ios::binary);
+		if (!out) return false;
+
+		if (!png) {
+			out << "P6\n" << w << " " << h << "\n255\n";
+			return static_cast<bool>(out);
+		}
+
+		static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+		out.write(reinterpret_cast<const char*>(signature), 8);
+
+		unsigned char header[13];
+		putBigEndian(header, w);
+		putBigEndian(header + 4, h);
+		header[8] = 8;      // bits per channel
+		header[9] = 2;      // RGB
+		header[10] = 0;     // deflate
+		header[11] = 0;     // adaptive filtering
+		header[12] = 0;     // no interlace
+		writeChunk("IHDR", header, 13);
+
+		// zlib header: deflate, 32K window, no preset dictionary
+		const unsigned char zlibHeader[2] = { 0x78, 0x01 };
+		writeChunk("IDAT", zlibHeader, 2);
+		return static_cast<bool>(out);
+	}
+
+	// One row of width * 3 RGB bytes
+	void writeRow(const unsigned char* rgb) {
+		if (!png) {
+			out.write(reinterpret_cast<const char*>(rgb), static_cast<std::streamsize>(width) * 3);
+			return;
+		}
+
+		// Filter type 0, then the row, split into stored blocks of <= 64K
+		row.clear();
+		row.push_back(0);
+		row.insert(row.end(), rgb, rgb + static_cast<size_t>(width) * 3);
+		updateAdler(row.data(), row.size());
+
+		block.clear();
+		for (size_t offset = 0; offset < row.size(); offset += 65535) {
+			size_t length = std::min<size_t>(65535, row.size() - offset);
+			appendStoredBlock(row.data() + offset, length, false);
+		}
+		writeChunk("IDAT", block.data(), block.size());
+	}
+
+	bool finish() {
+		if (png) {
+			block.clear();
+			appendStoredBlock(nullptr, 0, true);
+			unsigned char adler[4];
+			putBigEndian(adler, (adlerB << 16) | adlerA);
+			block.insert(block.end(), adler, adler + 4);
+			writeChunk("IDAT", block.data(), block.size());
+			writeChunk("IEND", nullptr, 0);
+		}
+		out.close();
+		return !out.fail();
+	}
+
+private:
+	std::ofstream out;
+	bool png;
+	unsigned int width;
+	std::uint32_t adlerA, adlerB;
+	std::vector<unsigned char> row;
+	std::vector<unsigned char> block;
+
+	static void putBigEndian(unsigned char* p, std::uint32_t value) {
+		p[0] = static_cast<unsigned char>(value >> 24);
+		p[1] = static_cast<unsigned char>(value >> 16);
+		p[2] = static_cast<unsigned char>(value >> 8);
+		p[3] = static_cast<unsigned char>(value);
+	}
+
+	static std::uint32_t crc(std::uint32_t c, const unsigned char* data, size_t length) {
+		static std::uint32_t table[256];
+		static bool ready = false;
+		if (!ready) {
+			for (std::uint32_t n = 0; n < 256; n++) {
+				std::uint32_t v = n;
+				for (int k = 0; k < 8; k++) v = (v & 1) ? 0xEDB88320u ^ (v >> 1) : v >> 1;
+				table[n] = v;
+			}
+			ready = true;
+		}
+		for (size_t i = 0; i < length; i++) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+		return c;
+	}
+
+	void updateAdler(const unsigned char* data, size_t length) {
+		// Reduce every 5552 bytes, the most that cannot overflow 32 bits
+		while (length > 0) {
+			size_t n = std::min<size_t>(length, 5552);
+			for (size_t i = 0; i < n; i++) {
+				adlerA += data[i];
+				adlerB += adlerA;
+			}
+			adlerA %= 65521;
+			adlerB %= 65521;
+			data += n;
+			length -= n;
+		}
+	}
+
+	void appendStoredBlock(const unsigned char* data, size_t length, bool last) {
+		std::uint16_t len = static_cast<std::uint16_t>(length);
+		std::uint16_t nlen = static_cast<std::uint16_t>(~len);
+		block.push_back(last ? 1 : 0);
+		block.push_back(static_cast<unsigned char>(len));
+		block.push_back(static_cast<unsigned char>(len >> 8));
+		block.push_back(static_cast<unsigned char>(nlen));
+		block.push_back(static_cast<unsigned char>(nlen >> 8));
+		if (length > 0) block.insert(block.end(), data, data + length);
+	}
+
+	void writeChunk(const char* type, const unsigned char* data, size_t length) {
+		unsigned char word[4];
+		putBigEndian(word, static_cast<std::uint32_t>(length));
+		out.write(reinterpret_cast<const char*>(word), 4);
+		out.write(type, 4);
+		if (length > 0) out.write(reinterpret_cast<const char*>(data), length);
+
+		std::uint32_t c = crc(0xFFFFFFFFu, reinterpret_cast<const unsigned char*>(type), 4);
+		c = crc(c, data, length) ^ 0xFFFFFFFFu;
+		putBigEndian(word, c);
+		out.write(reinterpret_cast<const char*>(word), 4);
+	}
+};
+
+// Renders a world rectangle into a width x height image one band of rows
+// at a time. Each band culls the scene to its own rows and rasterizes with
+// the usual shape algorithms on the worker pool, with the band as the
+// view's screen: fills only scan the band's rows and lines only step
+// through it, so a shape crossing many bands is not redrawn whole in each.
+// The runs are composited into column tiles in parallel, then the band's
+// rows are streamed out. Memory is one band of pixels plus the runs of the
+// shapes touching it, which stays proportional to the band only while no
+// band meets a large share of the drawing.
+class TiledExporter {
+public:
+	TiledExporter(Scene& s, WorkerPool& w) : scene(s), workers(w) {}
+
+	bool exportImage(const std::string& path, sf::FloatRect world,
+		unsigned int width, unsigned int height, sf::Color background, bool antialias = false) {
+		if (width == 0 || height == 0 || world.width <= 0 || world.height <= 0) return false;
+
+		ImageStreamWriter writer;
+		if (!writer.open(path, width, height)) return false;
+
+		RasterView view;
+		view.antialias = antialias;
+		view.zoom = std::min(width / world.width, height / world.height);
+		view.offset = sf::Vector2f(-world.left * view.zoom, -world.top * view.zoom);
+
+		const int tiles = static_cast<int>((width + EXPORT_TILE - 1) / EXPORT_TILE);
+		band.resize(static_cast<size_t>(width) * EXPORT_TILE * 3);
+
+		for (unsigned int top = 0; top < height; top += EXPORT_TILE) {
+			unsigned int rows = std::min<unsigned int>(EXPORT_TILE, height - top);
+			view.screen = sf::FloatRect(0, static_cast<float>(top),
+				static_cast<float>(width), static_cast<float>(rows));
+
+			int chunks = scene.rasterizeChunks(workers, view);
+			bucketRuns(chunks, tiles, width);
+			workers.run(tiles, [&](int t) {
+				int x0 = t * EXPORT_TILE;
+				int x1 = std::min<int>(x0 + EXPORT_TILE, width);
+				compositeTile(t, x0, x1, top, rows, width, background);
+			});
+
+			for (unsigned int y = 0; y < rows; y++) {
+				writer.writeRow(band.data() + static_cast<size_t>(y) * width * 3);
+			}
+		}
+		return writer.finish();
+	}
 
-			if (x1 == x2 && y1 == y2) break;
+private:
+	Scene& scene;
+	WorkerPool& workers;
+	std::vector<unsigned char> band;
+	// A run and, for a block, its alphas
+	struct TileRun {
+		const PixelRun* run;
+		const sf::Uint8* alphas;
+	};
 
-			int e2 = 2 * err;
-			if (e2 > -dy) { err -= dy; x1 += sx; }
-			if (e2 < dx) { err += dx; y1 += sy; }
+	std::vector<std::vector<TileRun>> buckets;   // runs per column tile
+
+	// Files each run under every tile it overlaps, keeping painter's order
+	void bucketRuns(int chunks, int tiles, unsigned int width) {
+		buckets.resize(tiles);
+		for (auto& bucket : buckets) bucket.clear();
+
+		for (int c = 0; c < chunks; c++) {
+			const PixelBuffer& chunk = scene.chunk(c);
+			for (const PixelRun& r : chunk.runs) {
+				float right = std::min(r.x + r.w, static_cast<float>(width));
+				if (right <= 0 || r.x >= width) continue;
+				int first = std::max(0, static_cast<int>(r.x)) / EXPORT_TILE;
+				int last = std::min(tiles - 1, static_cast<int>(right) / EXPORT_TILE);
+				for (int t = first; t <= last; t++) buckets[t].push_back(TileRun{ &r, chunk.alphasOf(r) });
+			}
 		}
 	}
 
-	void scanLineFill(std::vector<sf::RectangleShape>& pixels) {
-		if (vertices.empty()) return;
+	// Fills columns [x0, x1) of the band from the tile's runs, in order.
+	// A run covers the pixels whose centres lie inside it, as on screen.
+	void compositeTile(int tile, int x0, int x1, unsigned int top, unsigned int rows,
+		unsigned int width, sf::Color background) {
+		for (unsigned int y = 0; y < rows; y++) {
+			unsigned char* p = band.data() + (static_cast<size_t>(y) * width + x0) * 3;
+			for (int x = x0; x < x1; x++, p += 3) {
+				p[0] = background.r; p[1] = background.g; p[2] = background.b;
+			}
+		}
+
+		const float bandTop = static_cast<float>(top);
+		for (const TileRun& entry : buckets[tile]) {
+			const PixelRun& r = *entry.run;
+			int rx0 = std::max(x0, static_cast<int>(std::ceil(r.x - 0.5f)));
+			int rx1 = std::min(x1, static_cast<int>(std::ceil(r.x + r.w - 0.5f)));
+			int ry0 = std::max(0, static_cast<int>(std::ceil(r.y - bandTop - 0.5f)));
+			int ry1 = std::min(static_cast<int>(rows), static_cast<int>(std::ceil(r.y + r.h - bandTop - 0.5f)));
+			if (rx0 >= rx1 || ry0 >= ry1) continue;
+
+			// A block starts on a whole pixel, its first alpha's
+			const sf::Uint8* alphas = entry.alphas;
+			const int blockLeft = static_cast<int>(r.x), blockTop = static_cast<int>(r.y - bandTop);
+			for (int y = ry0; y < ry1; y++) {
+				unsigned char* p = band.data() + (static_cast<size_t>(y) * width + rx0) * 3;
+				const sf::Uint8* row = alphas ? alphas + (y - blockTop) * AA_ATLAS_WIDTH : nullptr;
+				for (int x = rx0; x < rx1; x++, p += 3) {
+					unsigned int alpha = row ? row[x - blockLeft] * r.color.a / 255 : r.color.a;
+					if (alpha == 255) {
+						p[0] = r.color.r; p[1] = r.color.g; p[2] = r.color.b;
+					}
+					else {
+						p[0] = static_cast<unsigned char>((r.color.r * alpha + p[0] * (255 - alpha)) / 255);
+						p[1] = static_cast<unsigned char>((r.color.g * alpha + p[1] * (255 - alpha)) / 255);
+						p[2] = static_cast<unsigned char>((r.color.b * alpha + p[2] * (255 - alpha)) / 255);
+					}
+				}
+			}
+		}
+	}
+};
 
-		// Find bounding box
-		float minY = vertices[0].y, maxY = vertices[0].y;
-		for (auto& v : vertices) {
-			minY = std::min(minY, v.y);
-			maxY = std::max(maxY, v.y);
+// ============================================================================
+// FLOOD FILL (SCAN-LINE, EXPLICIT SPAN STACK)
+// ============================================================================
+// The paint bucket works on a picture of the visible layers as they are on
+// screen. The stack holds row segments still to scan, each with the
+// direction it was reached from. Every run of matching pixels found in a
+// segment is grown left and right into a whole span, then the next row on
+// is queued under the span, and the row it came from only where the span
+// sticks out past its parent. A fill of any size uses no call stack, and
+// most pixels are tested once or twice.
+class FloodFill {
+public:
+	FloodFill() : width(0), height(0) {}
+
+	// Paints the runs of the visible layers under 'view' into a w x h image,
+	// covering the pixels whose centres lie inside each run, as on screen
+	void capture(Scene& scene, WorkerPool& workers, RasterView view, int w, int h, sf::Color background) {
+		width = w;
+		height = h;
+		view.screen = sf::FloatRect(0, 0, static_cast<float>(w), static_cast<float>(h));
+		pixels.assign(static_cast<size_t>(w) * h, pack(background));
+
+		int chunks = scene.rasterizeChunks(workers, view);
+		for (int c = 0; c < chunks; c++) {
+			const PixelBuffer& chunk = scene.chunk(c);
+			for (const PixelRun& r : chunk.runs) {
+				int x0 = std::max(0, static_cast<int>(std::ceil(r.x - 0.5f)));
+				int x1 = std::min(w, static_cast<int>(std::ceil(r.x + r.w - 0.5f)));
+				int y0 = std::max(0, static_cast<int>(std::ceil(r.y - 0.5f)));
+				int y1 = std::min(h, static_cast<int>(std::ceil(r.y + r.h - 0.5f)));
+				if (x0 >= x1 || y0 >= y1) continue;
+
+				if (const sf::Uint8* alphas = chunk.alphasOf(r)) {
+					sf::Color color = r.color;
+					for (int y = y0; y < y1; y++) {
+						std::uint32_t* row = pixels.data() + static_cast<size_t>(y) * w;
+						const sf::Uint8* rowAlphas = alphas + (y - static_cast<int>(r.y)) * AA_ATLAS_WIDTH;
+						for (int x = x0; x < x1; x++) {
+							color.a = static_cast<sf::Uint8>(rowAlphas[x - static_cast<int>(r.x)] * r.color.a / 255);
+							row[x] = blend(row[x], color);
+						}
+					}
+					continue;
+				}
+				std::uint32_t color = pack(r.color);
+				for (int y = y0; y < y1; y++) {
+					std::uint32_t* row = pixels.data() + static_cast<size_t>(y) * w;
+					if (r.color.a == 255) {
+						std::fill(row + x0, row + x1, color);
+						continue;
+					}
+					for (int x = x0; x < x1; x++) row[x] = blend(row[x], r.color);
+				}
+			}
 		}
+	}
 
-		// Scan line algorithm
-		for (int y = static_cast<int>(minY); y <= static_cast<int>(maxY); y++) {
-			std::vector<float> intersections;
-
-			// Find intersections with edges
-			for (size_t i = 0; i < vertices.size(); i++) {
-				sf::Vector2f p1 = vertices[i];
-				sf::Vector2f p2 = vertices[(i + 1) % vertices.size()];
+	// Spans of the pixels joined to (x, y) whose colour is within
+	// 'tolerance' of the seed's on every channel. Uses up the capture:
+	// filled pixels are marked, so capture again before the next fill.
+	bool fill(int x, int y, int tolerance, std::vector<Span>& out) {
+		out.clear();
+		if (x < 0 || y < 0 || x >= width || y >= height) return false;
+
+		const std::uint32_t seedColor = pixels[static_cast<size_t>(y) * width + x];
+		auto matches = [&](std::uint32_t p) {
+			if (p == seedColor) return true;
+			if (p & FILLED) return false;
+			return std::abs(int(p & 0xFF) - int(seedColor & 0xFF)) <= tolerance &&
+				std::abs(int((p >> 8) & 0xFF) - int((seedColor >> 8) & 0xFF)) <= tolerance &&
+				std::abs(int((p >> 16) & 0xFF) - int((seedColor >> 16) & 0xFF)) <= tolerance;
+		};
 
-				if ((p1.y <= y && p2.y > y) || (p2.y <= y && p1.y > y)) {
-					float x = p1.x + (y - p1.y) * (p2.x - p1.x) / (p2.y - p1.y);
-					intersections.push_back(x);
+		segments.clear();
+		segments.push_back(Segment{ y, x, x, 0 });
+		while (!segments.empty()) {
+			Segment seg = segments.back();
+			segments.pop_back();
+			std::uint32_t* row = pixels.data() + static_cast<size_t>(seg.y) * width;
+
+			for (int at = seg.left; at <= seg.right; at++) {
+				if (!matches(row[at])) continue;
+
+				// Only a run starting at the segment's left end can reach
+				// further left; any run can reach further right
+				int left = at, right = at;
+				row[at] |= FILLED;
+				if (at == seg.left) {
+					while (left > 0 && matches(row[left - 1])) row[--left] |= FILLED;
 				}
-			}
-
-			std::sort(intersections.begin(), intersections.end());
+				while (right + 1 < width && matches(row[right + 1])) row[++right] |= FILLED;
+				out.push_back(Span{ seg.y, left, right });
 
-			// Fill between pairs of intersections
-			for (size_t i = 0; i + 1 < intersections.size(); i += 2) {
-				for (int x = static_cast<int>(intersections[i]);
-					x <= static_cast<int>(intersections[i + 1]); x++) {
-					sf::RectangleShape pixel(sf::Vector2f(2, 2));
-					pixel.setPosition(static_cast<float>(x), static_cast<float>(y));
-					pixel.setFillColor(color);
-					pixels.push_back(pixel);
+				if (seg.dy == 0) {
+					pushSegment(seg.y - 1, left, right, -1);
+					pushSegment(seg.y + 1, left, right, 1);
 				}
+				else {
+					pushSegment(seg.y + seg.dy, left, right, seg.dy);
+					if (left < seg.left) pushSegment(seg.y - seg.dy, left, seg.left - 1, -seg.dy);
+					if (right > seg.right) pushSegment(seg.y - seg.dy, seg.right + 1, right, -seg.dy);
+				}
+				at = right + 1;
 			}
 		}
+		return !out.empty();
 	}
 
-	float distanceToSegment(sf::Vector2f p, sf::Vector2f a, sf::Vector2f b) {
-		float dx = b.x - a.x;
-		float dy = b.y - a.y;
-		float lengthSquared = dx * dx + dy * dy;
+private:
+	// Columns [left, right] of row y, reached from row y - dy (dy 0 for the seed)
+	struct Segment {
+		int y, left, right, dy;
+	};
 
-		if (lengthSquared == 0) {
-			dx = p.x - a.x;
-			dy = p.y - a.y;
-			return sqrt(dx * dx + dy * dy);
-		}
+	// Set on filled pixels; captured colours keep this byte clear
+	static const std::uint32_t FILLED = 0x01000000u;
 
-		float t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared;
-		t = std::max(0.0f, std::min(1.0f, t));
+	int width, height;
+	std::vector<std::uint32_t> pixels;   // 0x00BBGGRR
+	std::vector<Segment> segments;
 
-		float projX = a.x + t * dx;
-		float projY = a.y + t * dy;
+	static std::uint32_t pack(sf::Color c) {
+		return c.r | (c.g << 8) | (static_cast<std::uint32_t>(c.b) << 16);
+	}
 
-		dx = p.x - projX;
-		dy = p.y - projY;
-		return sqrt(dx * dx + dy * dy);
+	static std::uint32_t blend(std::uint32_t under, sf::Color c) {
+		unsigned int a = c.a;
+		unsigned int r = (c.r * a + (under & 0xFF) * (255 - a)) / 255;
+		unsigned int g = (c.g * a + ((under >> 8) & 0xFF) * (255 - a)) / 255;
+		unsigned int b = (c.b * a + ((under >> 16) & 0xFF) * (255 - a)) / 255;
+		return r | (g << 8) | (b << 16);
+	}
+
+	void pushSegment(int y, int left, int right, int dy) {
+		if (y >= 0 && y < height) segments.push_back(Segment{ y, left, right, dy });
 	}
 };
 
 // ============================================================================
-// BEZIER CURVE CLASS (PARAMETRIC CURVES)
+// CAMERA (PAN / ZOOM VIEW)
 // ============================================================================
-class BezierCurve : public Shape {
+// The sf::View maps mouse pixels to world coordinates; rasterization uses the
+// equivalent RasterView so shapes are drawn at their on-screen size.
+class Camera {
 public:
-	std::vector<sf::Vector2f> controlPoints;
-	int segments;
+	sf::View view;
 
-	BezierCurve(std::vector<sf::Vector2f> points, sf::Color col, int segs = 100)
-		: controlPoints(points), segments(segs) {
-		color = col;
+	Camera(float width, float height)
+		: view(sf::FloatRect(0, 0, width, height)), screenSize(width, height) {}
+
+	float zoom() const {
+		return screenSize.x / view.getSize().x;
 	}
 
-	void draw(std::vector<sf::RectangleShape>& pixels) override {
-		if (controlPoints.size() < 2) return;
+	RasterView rasterView() const {
+		RasterView rv;
+		rv.zoom = zoom();
+		sf::Vector2f topLeft = view.getCenter() - view.getSize() / 2.0f;
+		rv.offset = sf::Vector2f(-topLeft.x * rv.zoom, -topLeft.y * rv.zoom);
+		rv.screen = sf::FloatRect(0, 0, screenSize.x, screenSize.y);
+		return rv;
+	}
 
-		// Draw control points
-		for (auto& cp : controlPoints) {
-			sf::RectangleShape marker(sf::Vector2f(6, 6));
-			marker.setPosition(cp.x - 3, cp.y - 3);
-			marker.setFillColor(sf::Color(100, 100, 100));
-			pixels.push_back(marker);
-		}
+	// Zoom about a screen pixel, keeping the world point under it fixed
+	void zoomAt(sf::Vector2f pixel, float factor) {
+		float target = std::max(ZOOM_MIN, std::min(ZOOM_MAX, zoom() * factor));
+		sf::Vector2f before = toWorld(pixel);
+		view.setSize(screenSize.x / target, screenSize.y / target);
+		sf::Vector2f after = toWorld(pixel);
+		view.move(before - after);
+	}
+
+	void pan(sf::Vector2f pixelDelta) {
+		view.move(-pixelDelta.x / zoom(), -pixelDelta.y / zoom());
+	}
 
-		// Draw curve using De Casteljau's algorithm
-		sf::Vector2f prevPoint = evaluateBezier(0.0f);
-		for (int i = 1; i <= segments; i++) {
-			float t = static_cast<float>(i) / segments;
-			sf::Vector2f currentPoint = evaluateBezier(t);
+	void resize(float width, float height) {
+		float z = zoom();
+		screenSize = sf::Vector2f(width, height);
+		view.setSize(width / z, height / z);
+	}
 
-			drawBresenhamLine(pixels, prevPoint, currentPoint);
-			prevPoint = currentPoint;
-		}
+	void reset() {
+		view.setSize(screenSize);
+		view.setCenter(screenSize / 2.0f);
 	}
 
-	bool containsPoint(sf::Vector2f point) override {
-		// Check proximity to any control point
-		for (auto& cp : controlPoints) {
-			float dx = point.x - cp.x;
-			float dy = point.y - cp.y;
-			if (sqrt(dx * dx + dy * dy) < SELECTION_THRESHOLD) {
-				return true;
+	sf::Vector2f toWorld(sf::Vector2f pixel) const {
+		sf::Vector2f topLeft = view.getCenter() - view.getSize() / 2.0f;
+		return topLeft + pixel / zoom();
+	}
+
+private:
+	sf::Vector2f screenSize;
+};
+
+// ============================================================================
+// ANTI-ALIASED CANVAS UPDATES (COVERAGE ATLAS)
+// ============================================================================
+// With anti-aliasing on, the chunks' coverage shelves go up as a texture
+// of white texels and each block is drawn as one quad tinted by its run's
+// colour, so the GPU blends blocks just as it blends solid quads. Row 0
+// holds the opaque texel the solid runs use; each chunk's shelves start on
+// a row of their own, so the chunks are expanded into texels and quads in
+// parallel. A chunk that does not fit in the largest texture is drawn a
+// quad per block pixel instead.
+class CoverageAtlas {
+public:
+	CoverageAtlas(Scene& s, WorkerPool& w) : scene(s), workers(w) {}
+
+	// Fills 'quads' for the layer in 'view', to be drawn with texture()
+	void rasterize(std::vector<sf::Vertex>& quads, const RasterView& view, int layer) {
+		int chunks = scene.rasterizeChunks(workers, view, layer);
+		const unsigned int maxRows = sf::Texture::getMaximumSize();
+
+		firstRows.resize(chunks);
+		offsets.resize(chunks + 1);
+		offsets[0] = 0;
+		unsigned int rows = 1;
+		for (int c = 0; c < chunks; c++) {
+			const PixelBuffer& chunk = scene.chunk(c);
+			unsigned int need = static_cast<unsigned int>(chunk.coverage.size() / AA_ATLAS_WIDTH);
+			firstRows[c] = (need <= maxRows - rows) ? rows : 0;
+			rows += firstRows[c] ? need : 0;
+			offsets[c + 1] = offsets[c] + 4 * (firstRows[c] ? chunk.texturedQuadCount() : chunk.quadCount());
+		}
+		quads.resize(offsets[chunks]);
+		texels.resize(static_cast<size_t>(rows) * AA_ATLAS_WIDTH);
+		texels[0] = texel(255);
+
+		workers.run(chunks, [&](int c) {
+			const PixelBuffer& chunk = scene.chunk(c);
+			if (!firstRows[c]) {
+				chunk.toQuads(quads.data() + offsets[c]);
+				return;
 			}
+			std::uint32_t* out = texels.data() + static_cast<size_t>(firstRows[c]) * AA_ATLAS_WIDTH;
+			for (sf::Uint8 alpha : chunk.coverage) *out++ = texel(alpha);
+			chunk.toTexturedQuads(quads.data() + offsets[c], firstRows[c]);
+		});
+
+		// The texture only grows, by doubling, and only its used rows go up
+		if (atlas.getSize().y < rows) {
+			unsigned int height = std::max(64u, atlas.getSize().y);
+			while (height < rows) height = std::min(maxRows, height * 2);
+			atlas.create(AA_ATLAS_WIDTH, height);
 		}
-		return false;
+		atlas.update(reinterpret_cast<const sf::Uint8*>(texels.data()), AA_ATLAS_WIDTH, rows, 0, 0);
 	}
 
-	void translate(float dx, float dy) override {
-		for (auto& cp : controlPoints) {
-			cp.x += dx;
-			cp.y += dy;
-		}
+	const sf::Texture& texture() const {
+		return atlas;
 	}
 
-	void rotate(float angleDegrees) override {
-		sf::Vector2f center = getCenter();
-		float angleRad = angleDegrees * PI / 180.0f;
+private:
+	Scene& scene;
+	WorkerPool& workers;
+	sf::Texture atlas;
+	std::vector<std::uint32_t> texels;       // RGBA bytes in memory order
+	std::vector<unsigned int> firstRows;     // per chunk, 0 when drawn without the atlas
+	std::vector<size_t> offsets;             // per chunk, first vertex
+
+	static std::uint32_t texel(sf::Uint8 alpha) {
+		sf::Color white(255, 255, 255, alpha);
+		std::uint32_t value;
+		std::memcpy(&value, &white, sizeof(value));
+		return value;
+	}
+};
 
-		for (auto& cp : controlPoints) {
-			float dx = cp.x - center.x;
-			float dy = cp.y - center.y;
-			float xNew = dx * cos(angleRad) - dy * sin(angleRad);
-			float yNew = dx * sin(angleRad) + dy * cos(angleRad);
-			cp.x = center.x + xNew;
-			cp.y = center.y + yNew;
+// ============================================================================
+// REDRAW SCHEDULER (DAMAGE TRACKING)
+// ============================================================================
+// Each layer is rasterized into its own persistent canvas. Edits report
+// the screen area and the layers they touched, and only that area of
+// those layers is re-rasterized; overlay changes (HUD, markers, highlight)
+// just ask for a frame, which recomposites the canvases. With nothing
+// pending the main loop blocks in waitEvent. In anti-aliased mode, areas
+// redrawn aliased while the user is panning, zooming or dragging are kept
+// as rough and redrawn smooth once the input settles.
+class RedrawScheduler {
+public:
+	static const std::uint32_t EVERY_LAYER = 0xFFFFFFFFu;
+
+	RedrawScheduler() : roughLayers(0), frameNeeded(true) {}
+
+	// Damages 'area' on every layer whose bit is set in 'layers'
+	void invalidate(const sf::FloatRect& area, std::uint32_t layers = EVERY_LAYER) {
+		if (area.width <= 0 || area.height <= 0) return;
+		for (int l = 0; l < MAX_LAYERS; l++) {
+			if (!(layers & (1u << l))) continue;
+			Damage& d = damage[l];
+			d.area = d.damaged ? unite(d.area, area) : area;
+			d.damaged = true;
 		}
+		frameNeeded = true;
 	}
 
-	void scale(float factor) override {
-		sf::Vector2f center = getCenter();
-		for (auto& cp : controlPoints) {
-			cp = center + (cp - center) * factor;
-		}
+	void invalidateLayer(int layer) {
+		damage[layer].wholeCanvas = true;
+		frameNeeded = true;
 	}
 
-	sf::Vector2f getCenter() override {
-		sf::Vector2f sum(0, 0);
-		for (auto& cp : controlPoints) {
-			sum += cp;
-		}
-		return sum / static_cast<float>(controlPoints.size());
+	void invalidateAll() {
+		for (auto& d : damage) d.wholeCanvas = true;
+		frameNeeded = true;
 	}
 
-	std::string getInfo() override {
-		std::stringstream ss;
-		ss << "Bezier Curve | Control Points: " << controlPoints.size();
-		return ss.str();
+	void requestFrame() {
+		frameNeeded = true;
 	}
 
-private:
-	sf::Vector2f evaluateBezier(float t) {
-		// De Casteljau's algorithm for Bezier curve evaluation
-		std::vector<sf::Vector2f> points = controlPoints;
+	bool idle() const {
+		return !frameNeeded;
+	}
 
-		while (points.size() > 1) {
-			std::vector<sf::Vector2f> newPoints;
-			for (size_t i = 0; i < points.size() - 1; i++) {
-				sf::Vector2f interpolated;
-				interpolated.x = (1 - t) * points[i].x + t * points[i + 1].x;
-				interpolated.y = (1 - t) * points[i].y + t * points[i + 1].y;
-				newPoints.push_back(interpolated);
-			}
-			points = newPoints;
+	bool hasDamage(int layer) const {
+		return damage[layer].damaged || damage[layer].wholeCanvas;
+	}
+
+	// Pending damage rounded out to whole pixels and clipped to the canvas
+	sf::IntRect takeDamage(int layer, sf::Vector2u size) {
+		Damage& d = damage[layer];
+		sf::IntRect area(0, 0, static_cast<int>(size.x), static_cast<int>(size.y));
+		if (!d.wholeCanvas) {
+			int left = std::max(0, static_cast<int>(std::floor(d.area.left)));
+			int top = std::max(0, static_cast<int>(std::floor(d.area.top)));
+			int right = std::min(area.width, static_cast<int>(std::ceil(d.area.left + d.area.width)));
+			int bottom = std::min(area.height, static_cast<int>(std::ceil(d.area.top + d.area.height)));
+			area = sf::IntRect(left, top, std::max(0, right - left), std::max(0, bottom - top));
 		}
+		d.damaged = false;
+		d.wholeCanvas = false;
+		return area;
+	}
+
+	void frameDone() {
+		frameNeeded = false;
+	}
 
-		return points[0];
+	// Notes that 'area' of the layer was drawn aliased in anti-aliased mode
+	void markRough(const sf::IntRect& area, int layer) {
+		sf::FloatRect bounds(area);
+		rough[layer] = (roughLayers & (1u << layer)) ? unite(rough[layer], bounds) : bounds;
+		roughLayers |= 1u << layer;
 	}
 
-	void drawBresenhamLine(std::vector<sf::RectangleShape>& pixels,
-		sf::Vector2f p1, sf::Vector2f p2) {
-		int x1 = static_cast<int>(std::round(p1.x));
-		int y1 = static_cast<int>(std::round(p1.y));
-		int x2 = static_cast<int>(std::round(p2.x));
-		int y2 = static_cast<int>(std::round(p2.y));
+	// Damages every rough area so the next frame redraws it smooth
+	void smoothRough() {
+		for (int l = 0; l < MAX_LAYERS; l++) {
+			if (roughLayers & (1u << l)) invalidate(rough[l], 1u << l);
+		}
+		roughLayers = 0;
+	}
 
-		int dx = std::abs(x2 - x1);
-		int dy = std::abs(y2 - y1);
-		int sx = (x1 < x2) ? 1 : -1;
-		int sy = (y1 < y2) ? 1 : -1;
-		int err = dx - dy;
+	// Rough areas are dropped when anti-aliasing is turned off
+	void clearRough() {
+		roughLayers = 0;
+	}
 
-		while (true) {
-			sf::RectangleShape pixel(sf::Vector2f(2, 2));
-			pixel.setPosition(static_cast<float>(x1), static_cast<float>(y1));
-			pixel.setFillColor(color);
-			pixels.push_back(pixel);
+private:
+	struct Damage {
+		sf::FloatRect area;
+		bool damaged;
+		bool wholeCanvas;
 
-			if (x1 == x2 && y1 == y2) break;
+		Damage() : damaged(false), wholeCanvas(true) {}
+	};
 
-			int e2 = 2 * err;
-			if (e2 > -dy) { err -= dy; x1 += sx; }
-			if (e2 < dx) { err += dx; y1 += sy; }
-		}
+	static sf::FloatRect unite(const sf::FloatRect& a, const sf::FloatRect& b) {
+		float left = std::min(a.left, b.left), top = std::min(a.top, b.top);
+		float right = std::max(a.left + a.width, b.left + b.width);
+		float bottom = std::max(a.top + a.height, b.top + b.height);
+		return sf::FloatRect(left, top, right - left, bottom - top);
 	}
+
+	Damage damage[MAX_LAYERS];
+	sf::FloatRect rough[MAX_LAYERS];
+	std::uint32_t roughLayers;
+	bool frameNeeded;
 };
 
+// Pixel-for-pixel view whose viewport covers only 'area', so anything drawn
+// through it is clipped to that rectangle
+sf::View clipView(const sf::IntRect& area, sf::Vector2u size) {
+	sf::FloatRect bounds(area);
+	sf::View clip(bounds);
+	clip.setViewport(sf::FloatRect(
+		static_cast<float>(area.left) / size.x, static_cast<float>(area.top) / size.y,
+		static_cast<float>(area.width) / size.x, static_cast<float>(area.height) / size.y));
+	return clip;
+}
+
 // ============================================================================
 // UI CLASS FOR DRAWING INTERFACE
 // ============================================================================
@@ -769,14 +7657,74 @@ private:
 	sf::Font font;
 	bool fontLoaded;
 
+	// Text objects persist across frames; setString (and the glyph layout
+	// it triggers) only runs when the displayed content changes
+	sf::Text modeText;
+	sf::Text countText;
+	sf::Text infoText;
+	std::vector<sf::Text> helpTexts;
+	std::string shownMode;
+	std::string shownInfo;
+	int shownCount;
+
+	// Grid lines for one spacing and window size, shifted by a transform
+	// while panning so they only rebuild on zoom or resize
+	sf::VertexArray gridLines;
+	float gridStep;
+	sf::Vector2f gridExtent;
+
+	void setupText(sf::Text& text, unsigned int size, sf::Color color, float x, float y) {
+		text.setFont(font);
+		text.setCharacterSize(size);
+		text.setFillColor(color);
+		text.setPosition(x, y);
+	}
+
+	void rebuildGrid(float step, float width, float height) {
+		gridLines.clear();
+		gridStep = step;
+		gridExtent = sf::Vector2f(width, height);
+
+		// Lines start one step early to cover the pan shift
+		for (float x = 0; x < width; x += step) {
+			gridLines.append(sf::Vertex(sf::Vector2f(x, -step), sf::Color(50, 50, 50)));
+			gridLines.append(sf::Vertex(sf::Vector2f(x, height), sf::Color(50, 50, 50)));
+		}
+		for (float y = 0; y < height; y += step) {
+			gridLines.append(sf::Vertex(sf::Vector2f(-step, y), sf::Color(50, 50, 50)));
+			gridLines.append(sf::Vertex(sf::Vector2f(width, y), sf::Color(50, 50, 50)));
+		}
+	}
+
 public:
-	UI() : fontLoaded(false) {
+	UI() : fontLoaded(false), shownCount(-1), gridLines(sf::Lines), gridStep(0) {
 		// Try to load system font
 		if (!font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf")) {
 			std::cout << "Warning: Could not load font. UI text disabled.\n";
+			return;
 		}
-		else {
-			fontLoaded = true;
+		fontLoaded = true;
+
+		setupText(modeText, 18, sf::Color::White, 10, 10);
+		setupText(countText, 18, sf::Color::White, 10, 35);
+		setupText(infoText, 16, sf::Color::Yellow, 10, 60);
+
+		std::vector<std::string> helpLines = {
+			"MODES: 1=Select 2=DDA 3=Bresenham 4=Circle 5=Ellipse 6=Polygon 7=Curve (B=Type) 8=Place Symbol 9=Bucket",
+			"SELECT: Click=Pick Shift+Click=Add | Drag=Box (leftward=Crossing) Ctrl+Drag=Lasso | NURBS: Shift+Click=Heavy Point",
+			"TRANSFORM: Drag/Arrows=Move Q/E=Rotate W/S=Scale | VIEW: Wheel=Zoom MMB-Drag=Pan 0=Reset A=Anti-alias",
+			"LAYERS: L=New | PgUp/PgDn=Switch | H=Hide | K=Lock | T=Move Selection Here",
+			"STROKE: [ ]=Width | D=Dashes | J=Join | X=Cap (new shapes and the selection) | POLYGONS: U=Union I=Intersect O=Subtract",
+			"OTHER: Ctrl+Z/Ctrl+Y=Undo/Redo | M=Make Symbol | F=Fill | R=Fill Rule | N=Snap | Del=Delete | C=Clear | F5=Save F9=Load F6=Export | ESC=Exit"
+		};
+
+		float yPos = WINDOW_HEIGHT - 140;
+		for (auto& line : helpLines) {
+			sf::Text helpText;
+			setupText(helpText, 14, sf::Color(150, 150, 150), 10, yPos);
+			helpText.setString(line);
+			helpTexts.push_back(helpText);
+			yPos += 20;
 		}
 	}
 
@@ -785,31 +7733,25 @@ public:
 		if (!fontLoaded) return;
 
 		// Mode indicator
-		sf::Text modeText;
-		modeText.setFont(font);
-		modeText.setString("Mode: " + mode);
-		modeText.setCharacterSize(18);
-		modeText.setFillColor(sf::Color::White);
-		modeText.setPosition(10, 10);
+		if (mode != shownMode) {
+			shownMode = mode;
+			modeText.setString("Mode: " + mode);
+		}
 		window.draw(modeText);
 
 		// Shape count
-		sf::Text countText;
-		countText.setFont(font);
-		countText.setString("Shapes: " + std::to_string(shapeCount));
-		countText.setCharacterSize(18);
-		countText.setFillColor(sf::Color::White);
-		countText.setPosition(10, 35);
+		if (shapeCount != shownCount) {
+			shownCount = shapeCount;
+			countText.setString("Shapes: " + std::to_string(shapeCount));
+		}
 		window.draw(countText);
 
 		// Shape info
-		if (!shapeInfo.empty()) {
-			sf::Text infoText;
-			infoText.setFont(font);
+		if (shapeInfo != shownInfo) {
+			shownInfo = shapeInfo;
 			infoText.setString(shapeInfo);
-			infoText.setCharacterSize(16);
-			infoText.setFillColor(sf::Color::Yellow);
-			infoText.setPosition(10, 60);
+		}
+		if (!shownInfo.empty()) {
 			window.draw(infoText);
 		}
 
@@ -820,54 +7762,51 @@ public:
 	void drawHelp(sf::RenderWindow& window) {
 		if (!fontLoaded) return;
 
-		std::vector<std::string> helpLines = {
-			"MODES: 1=Select 2=DDA 3=Bresenham 4=Circle 5=Ellipse 6=Polygon 7=Bezier",
-			"TRANSFORM: Arrows=Move Q/E=Rotate W/S=Scale",
-			"OTHER: F=Fill Toggle | Del=Delete | C=Clear | ESC=Exit"
-		};
-
-		float yPos = WINDOW_HEIGHT - 80;
-		for (auto& line : helpLines) {
-			sf::Text helpText;
-			helpText.setFont(font);
-			helpText.setString(line);
-			helpText.setCharacterSize(14);
-			helpText.setFillColor(sf::Color(150, 150, 150));
-			helpText.setPosition(10, yPos);
+		for (auto& helpText : helpTexts) {
 			window.draw(helpText);
-			yPos += 20;
 		}
 	}
 
-	void drawGrid(sf::RenderWindow& window, int gridSize = 50) {
-		for (int x = 0; x < WINDOW_WIDTH; x += gridSize) {
-			sf::Vertex line[] = {
-				sf::Vertex(sf::Vector2f(static_cast<float>(x), 0), sf::Color(50, 50, 50)),
-				sf::Vertex(sf::Vector2f(static_cast<float>(x), WINDOW_HEIGHT), sf::Color(50, 50, 50))
-			};
-			window.draw(line, 2, sf::Lines);
-		}
+	// Grid lines sit on world multiples of gridSize; spacing doubles while
+	// they would be closer than a few pixels apart. Drawn in one call.
+	void drawGrid(sf::RenderTarget& target, const RasterView& view, int gridSize = 50) {
+		float step = gridSize * view.zoom;
+		while (step < 8.0f) step *= 2.0f;
 
-		for (int y = 0; y < WINDOW_HEIGHT; y += gridSize) {
-			sf::Vertex line[] = {
-				sf::Vertex(sf::Vector2f(0, static_cast<float>(y)), sf::Color(50, 50, 50)),
-				sf::Vertex(sf::Vector2f(WINDOW_WIDTH, static_cast<float>(y)), sf::Color(50, 50, 50))
-			};
-			window.draw(line, 2, sf::Lines);
+		if (step != gridStep || view.screen.width != gridExtent.x || view.screen.height != gridExtent.y) {
+			rebuildGrid(step, view.screen.width, view.screen.height);
 		}
+
+		sf::RenderStates states;
+		states.transform.translate(view.offset.x - std::floor(view.offset.x / step) * step,
+			view.offset.y - std::floor(view.offset.y / step) * step);
+		target.draw(gridLines, states);
 	}
 };
 
 // ============================================================================
 // MAIN APPLICATION
 // ============================================================================
-int main() {
+// Keys polled every frame while a shape is selected
+bool isTransformKeyHeld() {
+	static const sf::Keyboard::Key keys[] = {
+		sf::Keyboard::Left, sf::Keyboard::Right, sf::Keyboard::Up, sf::Keyboard::Down,
+		sf::Keyboard::Q, sf::Keyboard::E, sf::Keyboard::W, sf::Keyboard::S
+	};
+	for (sf::Keyboard::Key key : keys) {
+		if (sf::Keyboard::isKeyPressed(key)) return true;
+	}
+	return false;
+}
+
+int main(int argc, char* argv[]) {
 	sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT),
 		"Advanced Mini-CAD: Multi-Algorithm Graphics Editor");
 	window.setFramerateLimit(60);
 
-	std::vector<std::shared_ptr<Shape>> shapes;
+	Scene scene;
 	std::vector<sf::Vector2f> tempPoints;
+	std::vector<float> tempWeights;   // NURBS weights of tempPoints
 
 	enum Mode {
 		SELECTION = 1,
@@ -876,23 +7815,375 @@ int main() {
 		DRAW_CIRCLE = 4,
 		DRAW_ELLIPSE = 5,
 		DRAW_POLYGON = 6,
-		DRAW_BEZIER = 7
+		DRAW_BEZIER = 7,
+		PLACE_SYMBOL = 8,
+		PAINT_BUCKET = 9
 	};
 
 	Mode currentMode = SELECTION;
-	std::shared_ptr<Shape> selectedShape = nullptr;
-	bool fillPolygon = false;
+	enum CurveType { BEZIER_CURVE, B_SPLINE, NURBS };
+	CurveType curveType = BEZIER_CURVE;   // what DRAW_BEZIER makes
+	std::vector<ShapeHandle> selection;
+	History history;
+	Autosave autosave;
+	std::shared_ptr<Symbol> currentSymbol;   // what PLACE_SYMBOL stamps
+	int symbolsMade = 0;
+	bool fillShapes = false;
+	FillRule fillRule = FillRule::EVEN_ODD;
+	StrokeStyle currentStroke;   // hairline until widened or dashed
+	int dashPattern = 0;
 	bool showGrid = true;
+	bool antialias = false;   // coverage rendering, on screen and in exports
+	bool snapping = true;
+	bool snapVisible = false;
+	sf::Vector2f snapTarget;
 
 	UI ui;
+	WorkerPool workers;
+	std::vector<sf::Vertex> quads;
+	Camera camera(static_cast<float>(WINDOW_WIDTH), static_cast<float>(WINDOW_HEIGHT));
+	bool panning = false;
+	sf::Vector2i panAnchor;
+
+	// Left-drag in selection mode: move the selection, rubber-band a box
+	// or trace a lasso
+	enum Gesture { NO_GESTURE, MOVING, BOXING, LASSOING };
+	Gesture gesture = NO_GESTURE;
+	sf::Vector2f dragStart, dragLast;
+	sf::Vector2f dragDelta(0, 0);   // motion not yet applied to the selection
+	std::vector<sf::Vector2f> lasso;
+
+	// Scene file: F5 saves, F9 loads; a path on the command line opens it.
+	// An .svg path is imported instead and saves go next to it as .mcad.
+	std::string scenePath = (argc > 1) ? argv[1] : "scene.mcad";
+	auto openScene = [&]() {
+		auto start = std::chrono::steady_clock::now();
+		if (!loadScene(scene, scenePath)) {
+			std::cout << "Could not load scene file: " << scenePath << "\n";
+			return;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Loaded " << scene.size() << " shapes from " << scenePath
+			<< " in " << std::fixed << std::setprecision(1) << ms << " ms\n";
+		selection.clear();
+		tempPoints.clear();
+		history.clear();
+		autosave.reset(scene);
+	};
+	// F6 renders the whole drawing to a PNG next to the scene file
+	auto exportScene = [&]() {
+		sf::FloatRect world = scene.bounds();
+		if (world.width <= 0 || world.height <= 0) return;
+		float scale = EXPORT_SIZE / std::max(world.width, world.height);
+		unsigned int width = std::max(1u, static_cast<unsigned int>(world.width * scale));
+		unsigned int height = std::max(1u, static_cast<unsigned int>(world.height * scale));
+		std::string imagePath = scenePath.substr(0, scenePath.rfind('.')) + ".png";
+
+		auto start = std::chrono::steady_clock::now();
+		TiledExporter exporter(scene, workers);
+		if (!exporter.exportImage(imagePath, world, width, height, sf::Color(25, 25, 35), antialias)) {
+			std::cout << "Could not export image: " << imagePath << "\n";
+			return;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Exported " << width << "x" << height << " to " << imagePath << " in "
+			<< std::fixed << std::setprecision(1) << seconds << " s\n";
+	};
+
+	std::string extension = scenePath.size() > 4 ? scenePath.substr(scenePath.size() - 4) : "";
+	if (extension == ".svg" || extension == ".SVG") {
+		SvgImporter importer(scene);
+		SvgImporter::Stats stats;
+		if (importer.import(scenePath, stats)) {
+			std::cout << "Imported " << stats.shapes << " shapes (" << stats.skipped << " arcs skipped) from "
+				<< scenePath << " in " << std::fixed << std::setprecision(1) << stats.seconds * 1000.0
+				<< " ms, " << std::setprecision(0) << stats.shapesPerSecond() << " shapes/sec\n";
+		}
+		else {
+			std::cout << "Could not read SVG file: " << scenePath << "\n";
+		}
+		scenePath.replace(scenePath.size() - 4, 4, ".mcad");
+	}
+	else if (argc > 1) {
+		openScene();
+	}
+
+	// Edits are journaled beside the scene file as they happen. A journal
+	// that is still there means the last session did not exit cleanly,
+	// unless another instance has the scene open and is writing it.
+	std::string journalPath = scenePath + ".journal";
+	Autosave::ReplayStats recovered;
+	if (!autosave.claim(journalPath)) {
+		std::cout << "Another instance is journaling to " << journalPath << "; autosave is off\n";
+	}
+	else {
+		if (Autosave::replay(scene, journalPath, recovered)) {
+			std::cout << "Recovered " << recovered.shapes << " shapes from " << journalPath << " ("
+				<< recovered.frames << " frames) in " << std::fixed << std::setprecision(1)
+				<< recovered.seconds * 1000.0 << " ms, " << recovered.megabytesPerSecond() << " MB/s\n";
+		}
+		if (!autosave.start(scene, journalPath)) {
+			std::cout << "Could not start autosave journal: " << journalPath << "\n";
+		}
+	}
+	history.onChange = [&](const std::vector<ShapeHandle>& group, bool transformsOnly) {
+		autosave.record(group, transformsOnly);
+	};
+
+	// One transparent canvas per layer, created as layers appear
+	std::vector<std::unique_ptr<sf::RenderTexture>> canvases;
+	sf::Vector2u canvasSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+	CoverageAtlas coverageAtlas(scene, workers);
+	RedrawScheduler scheduler;
+
+	// Frames drawn while the view or selection is moving stay aliased in
+	// anti-aliased mode; the moved areas are smoothed once input settles
+	bool moving = false;
+	sf::Clock settleClock;
+	auto interacted = [&]() {
+		if (!antialias) return;
+		moving = true;
+		settleClock.restart();
+	};
+	auto syncCanvases = [&]() {
+		while (canvases.size() < static_cast<size_t>(scene.layerCount())) {
+			canvases.emplace_back(new sf::RenderTexture());
+			canvases.back()->create(canvasSize.x, canvasSize.y);
+			scheduler.invalidateLayer(static_cast<int>(canvases.size() - 1));
+		}
+	};
+
+	// Picking and the bucket work on what is under the cursor
+	auto snapsPoints = [&]() {
+		return snapping && currentMode != SELECTION && currentMode != PAINT_BUCKET;
+	};
+
+	// Every new shape damages the area it lands on; locked layers take none
+	auto addShape = [&](auto shape) {
+		if (scene.layer(scene.activeLayer()).locked) return;
+		if (decltype(shape)::KIND != ShapeKind::INSTANCE && decltype(shape)::KIND != ShapeKind::FILL) {
+			shape.stroke = currentStroke;
+		}
+		ShapeHandle handle = scene.add(std::move(shape));
+		history.added({ handle });
+		scheduler.invalidate(scene.screenBounds(handle, camera.rasterView()), 1u << scene.layerOf(handle));
+	};
+
+	// The bucket fills the screen region under a pixel as the visible
+	// layers show it, and keeps the result as a fill region on the active
+	// layer, which its canvas then caches like any other shape
+	FloodFill floodFill;
+	std::vector<Span> filled;
+	auto paintBucket = [&](sf::Vector2i pixel) {
+		RasterView view = camera.rasterView();
+		floodFill.capture(scene, workers, view, canvasSize.x, canvasSize.y, sf::Color(25, 25, 35));
+		if (!floodFill.fill(pixel.x, pixel.y, FILL_TOLERANCE, filled)) return;
+		addShape(FillRegion::fromScreen(filled, view, sf::Color(230, 120, 40)));
+	};
+
+	auto select = [&](std::vector<ShapeHandle> handles) {
+		history.closeTransform();
+		for (auto& handle : selection) {
+			if (Shape* shape = scene.get(handle)) shape->isSelected = false;
+		}
+		selection = std::move(handles);
+		for (auto& handle : selection) {
+			if (Shape* shape = scene.get(handle)) shape->isSelected = true;
+		}
+	};
+
+	// Screen area a whole group covers, padded like screenBounds
+	auto groupScreenBounds = [&](const std::vector<ShapeHandle>& group) {
+		if (group.size() == 1) return scene.screenBounds(group[0], camera.rasterView());
+		sf::FloatRect world = scene.groupBounds(group);
+		RasterView view = camera.rasterView();
+		sf::Vector2f a = view.toScreen(sf::Vector2f(world.left, world.top));
+		sf::Vector2f b = view.toScreen(sf::Vector2f(world.left + world.width, world.top + world.height));
+		return sf::FloatRect(a.x - 4, a.y - 4, b.x - a.x + 8, b.y - a.y + 8);
+	};
+
+	auto selectionScreenBounds = [&]() {
+		return groupScreenBounds(selection);
+	};
+
+	// A single shape turns about its own centre, a group about its box centre
+	auto selectionPivot = [&]() {
+		if (selection.size() == 1) {
+			Shape* shape = scene.get(selection[0]);
+			return shape ? shape->getCenter() : sf::Vector2f(0, 0);
+		}
+		sf::FloatRect world = scene.groupBounds(selection);
+		return sf::Vector2f(world.left + world.width / 2, world.top + world.height / 2);
+	};
+
+	// Stroke keys restyle the selection along with the next shapes drawn
+	auto restyleSelection = [&]() {
+		if (selection.empty()) return;
+		std::uint32_t touched = scene.layersOf(selection);
+		scheduler.invalidate(selectionScreenBounds(), touched);
+		history.setStroke(scene, selection, currentStroke);
+		scheduler.invalidate(selectionScreenBounds(), touched);
+	};
+
+	// Boolean of the selected polygons in the order they were picked, so a
+	// difference keeps the first minus the rest. The results replace them
+	// on the first one's layer as one undo step.
+	PolygonBoolean clipper;
+	auto combinePolygons = [&](PolygonBoolean::Operation op) {
+		std::vector<ShapeHandle> used;
+		std::vector<Polygon*> polygons;
+		for (auto& handle : selection) {
+			if (Polygon* polygon = dynamic_cast<Polygon*>(scene.get(handle))) {
+				used.push_back(handle);
+				polygons.push_back(polygon);
+			}
+		}
+		if (polygons.size() < 2) return;
+
+		Polygon like({}, polygons[0]->color, polygons[0]->filled, polygons[0]->fillRule);
+		like.stroke = polygons[0]->stroke;
+		std::vector<Polygon> results;
+		clipper.reset();
+		for (Polygon* polygon : polygons) clipper.addPolygon(*polygon);
+		clipper.run(op, like, results);
+
+		int layer = scene.layerOf(used[0]);
+		scheduler.invalidate(groupScreenBounds(used), scene.layersOf(used));
+		history.begin();
+		history.remove(scene, used);
+		selection.clear();
+		int previousLayer = scene.activeLayer();
+		scene.setActiveLayer(layer);
+		std::vector<ShapeHandle> made;
+		for (auto& result : results) made.push_back(scene.add(std::move(result)));
+		scene.setActiveLayer(previousLayer);
+		history.added(made);
+		history.end();
+		for (auto& handle : made) {
+			scheduler.invalidate(scene.screenBounds(handle, camera.rasterView()), 1u << layer);
+		}
+		select(made);
+		gesture = NO_GESTURE;
+	};
+
+	// Steps back or forward through the history, redrawing what the step
+	// touched where it was and where it ends up
+	auto replay = [&](bool redoing) {
+		std::vector<ShapeHandle> touched;
+		if (redoing) history.redoGroup(touched);
+		else history.undoGroup(touched);
+		select({});
+		gesture = NO_GESTURE;
+
+		scheduler.invalidate(groupScreenBounds(touched), scene.layersOf(touched));
+		if (!(redoing ? history.redo(scene) : history.undo(scene))) return;
+		scheduler.invalidate(groupScreenBounds(touched), scene.layersOf(touched));
+	};
 
 	while (window.isOpen()) {
+		// Sleep until input arrives unless a frame is pending or a held key
+		// is transforming the selection
+		bool transforming = !selection.empty() && isTransformKeyHeld();
+		autosave.pump();
 		sf::Event event;
-		while (window.pollEvent(event)) {
+		bool hasEvent = (scheduler.idle() && !transforming && !autosave.backlogged() && !moving) ?
+			window.waitEvent(event) : window.pollEvent(event);
+
+		while (hasEvent) {
+			// Plain pointer motion changes nothing on screen
+			if (event.type != sf::Event::MouseMoved) {
+				scheduler.requestFrame();
+			}
+
 			if (event.type == sf::Event::Closed) {
 				window.close();
 			}
 
+			// Keep the window's own view 1:1 with pixels; the camera does the rest
+			if (event.type == sf::Event::Resized) {
+				float w = static_cast<float>(event.size.width);
+				float h = static_cast<float>(event.size.height);
+				window.setView(sf::View(sf::FloatRect(0, 0, w, h)));
+				camera.resize(w, h);
+				canvasSize = sf::Vector2u(event.size.width, event.size.height);
+				for (auto& canvas : canvases) canvas->create(canvasSize.x, canvasSize.y);
+				scheduler.invalidateAll();
+				interacted();
+			}
+
+			// Camera: wheel zooms about the cursor, middle-drag pans
+			if (event.type == sf::Event::MouseWheelScrolled) {
+				sf::Vector2f pixel(static_cast<float>(event.mouseWheelScroll.x),
+					static_cast<float>(event.mouseWheelScroll.y));
+				camera.zoomAt(pixel, std::pow(ZOOM_STEP, event.mouseWheelScroll.delta));
+				scheduler.invalidateAll();
+				interacted();
+			}
+			if (event.type == sf::Event::MouseButtonPressed &&
+				event.mouseButton.button == sf::Mouse::Middle) {
+				panning = true;
+				panAnchor = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+			}
+			if (event.type == sf::Event::MouseButtonReleased &&
+				event.mouseButton.button == sf::Mouse::Middle) {
+				panning = false;
+			}
+			if (event.type == sf::Event::MouseMoved && panning) {
+				sf::Vector2i current(event.mouseMove.x, event.mouseMove.y);
+				camera.pan(sf::Vector2f(current - panAnchor));
+				panAnchor = current;
+				scheduler.invalidateAll();
+				interacted();
+			}
+
+			// Selection gestures; moves are batched into one group transform per frame
+			if (event.type == sf::Event::MouseMoved && !panning && gesture != NO_GESTURE) {
+				sf::Vector2f world = camera.toWorld(sf::Vector2f(
+					static_cast<float>(event.mouseMove.x), static_cast<float>(event.mouseMove.y)));
+				if (gesture == MOVING) {
+					dragDelta += world - dragLast;
+				}
+				else if (gesture == LASSOING) {
+					sf::Vector2f step = (world - lasso.back()) * camera.zoom();
+					if (step.x * step.x + step.y * step.y >= 9.0f) lasso.push_back(world);
+				}
+				dragLast = world;
+				scheduler.requestFrame();
+			}
+			if (event.type == sf::Event::MouseButtonReleased &&
+				event.mouseButton.button == sf::Mouse::Left && gesture != NO_GESTURE) {
+				std::vector<ShapeHandle> found;
+				if (gesture == BOXING) {
+					sf::Vector2f size = (dragLast - dragStart) * camera.zoom();
+					if (std::abs(size.x) > 2 && std::abs(size.y) > 2) {
+						sf::FloatRect box(std::min(dragStart.x, dragLast.x), std::min(dragStart.y, dragLast.y),
+							std::abs(dragLast.x - dragStart.x), std::abs(dragLast.y - dragStart.y));
+						scene.queryBox(box, dragLast.x < dragStart.x, found);
+					}
+					select(std::move(found));
+				}
+				else if (gesture == LASSOING) {
+					scene.queryLasso(lasso, found);
+					select(std::move(found));
+					lasso.clear();
+				}
+				gesture = NO_GESTURE;
+			}
+
+			// Snap preview follows the cursor while drawing
+			if (event.type == sf::Event::MouseMoved && !panning) {
+				sf::Vector2f world = camera.toWorld(sf::Vector2f(
+					static_cast<float>(event.mouseMove.x), static_cast<float>(event.mouseMove.y)));
+				sf::Vector2f target;
+				bool visible = snapsPoints() &&
+					scene.snap(world, SNAP_PIXELS / camera.zoom(), target);
+				if (visible != snapVisible || (visible && target != snapTarget)) {
+					snapVisible = visible;
+					snapTarget = target;
+					scheduler.requestFrame();
+				}
+			}
+
 			// Keyboard shortcuts
 			if (event.type == sf::Event::KeyPressed) {
 				switch (event.key.code) {
@@ -903,23 +8194,164 @@ int main() {
 				case sf::Keyboard::Num5: currentMode = DRAW_ELLIPSE; break;
 				case sf::Keyboard::Num6: currentMode = DRAW_POLYGON; break;
 				case sf::Keyboard::Num7: currentMode = DRAW_BEZIER; break;
-				case sf::Keyboard::F: fillPolygon = !fillPolygon; break;
-				case sf::Keyboard::G: showGrid = !showGrid; break;
-				case sf::Keyboard::C:
-					shapes.clear();
-					selectedShape = nullptr;
+				case sf::Keyboard::Num8: currentMode = PLACE_SYMBOL; break;
+				case sf::Keyboard::Num9: currentMode = PAINT_BUCKET; break;
+				case sf::Keyboard::M:
+					// The selection becomes one instance of a new symbol
+					if (!selection.empty()) {
+						sf::Vector2f origin = selectionPivot();
+						std::shared_ptr<Symbol> symbol = scene.makeSymbol(selection, origin,
+							"Symbol " + std::to_string(++symbolsMade));
+						if (!symbol) break;
+						// The instance takes the layer of the first selected shape
+						int layer = scene.layerOf(selection[0]);
+						scheduler.invalidate(selectionScreenBounds(), scene.layersOf(selection));
+						history.begin();
+						history.remove(scene, selection);
+						selection.clear();
+						int previousLayer = scene.activeLayer();
+						scene.setActiveLayer(layer);
+						ShapeHandle instance = scene.add(Instance(symbol, origin, symbol->color));
+						scene.setActiveLayer(previousLayer);
+						history.added({ instance });
+						history.end();
+						scheduler.invalidate(scene.screenBounds(instance, camera.rasterView()), 1u << layer);
+						select({ instance });
+						currentSymbol = symbol;
+						gesture = NO_GESTURE;
+					}
+					break;
+				case sf::Keyboard::F: fillShapes = !fillShapes; break;
+				case sf::Keyboard::B:
+					curveType = static_cast<CurveType>((curveType + 1) % 3);
+					break;
+				case sf::Keyboard::U: combinePolygons(PolygonBoolean::UNION); break;
+				case sf::Keyboard::I: combinePolygons(PolygonBoolean::INTERSECTION); break;
+				case sf::Keyboard::O: combinePolygons(PolygonBoolean::DIFFERENCE); break;
+				case sf::Keyboard::LBracket:
+					currentStroke.width = std::max(0.0f, currentStroke.width - 1);
+					restyleSelection();
+					break;
+				case sf::Keyboard::RBracket:
+					currentStroke.width = std::min(MAX_STROKE_WIDTH, currentStroke.width + 1);
+					restyleSelection();
+					break;
+				case sf::Keyboard::D: {
+					// None, dashed, dotted, dash-dot
+					static const float patterns[][StrokeStyle::MAX_DASHES] = {
+						{ 0 }, { 10, 6 }, { 2, 4 }, { 12, 4, 2, 4 }
+					};
+					static const std::uint8_t counts[] = { 0, 2, 2, 4 };
+					dashPattern = (dashPattern + 1) % 4;
+					currentStroke.dashCount = counts[dashPattern];
+					std::copy(patterns[dashPattern], patterns[dashPattern] + StrokeStyle::MAX_DASHES, currentStroke.dashes);
+					restyleSelection();
+					break;
+				}
+				case sf::Keyboard::J:
+					currentStroke.join = static_cast<LineJoin>((static_cast<int>(currentStroke.join) + 1) % 3);
+					restyleSelection();
+					break;
+				case sf::Keyboard::X:
+					currentStroke.cap = static_cast<LineCap>((static_cast<int>(currentStroke.cap) + 1) % 3);
+					restyleSelection();
+					break;
+				case sf::Keyboard::R:
+					fillRule = (fillRule == FillRule::EVEN_ODD) ? FillRule::NON_ZERO : FillRule::EVEN_ODD;
+					break;
+				case sf::Keyboard::N:
+					snapping = !snapping;
+					snapVisible = false;
+					break;
+				case sf::Keyboard::G:
+					showGrid = !showGrid;
+					break;
+				case sf::Keyboard::A:
+					antialias = !antialias;
+					moving = false;
+					scheduler.clearRough();
+					scheduler.invalidateAll();
+					break;
+				case sf::Keyboard::L: {
+					int layer = scene.addLayer("Layer " + std::to_string(scene.layerCount() + 1));
+					if (layer < 0) {
+						std::cout << "Layer limit (" << MAX_LAYERS << ") reached\n";
+						break;
+					}
+					scene.setActiveLayer(layer);
+					break;
+				}
+				case sf::Keyboard::PageUp:
+					scene.setActiveLayer(scene.activeLayer() + 1);
+					break;
+				case sf::Keyboard::PageDown:
+					scene.setActiveLayer(scene.activeLayer() - 1);
+					break;
+				case sf::Keyboard::H:
+					// Hidden or locked shapes cannot stay selected
+					scene.layer(scene.activeLayer()).visible = !scene.layer(scene.activeLayer()).visible;
+					select({});
+					gesture = NO_GESTURE;
+					break;
+				case sf::Keyboard::K:
+					scene.layer(scene.activeLayer()).locked = !scene.layer(scene.activeLayer()).locked;
+					select({});
+					gesture = NO_GESTURE;
+					break;
+				case sf::Keyboard::T:
+					// Move the selection onto the active layer
+					if (!selection.empty()) {
+						std::uint32_t touched = scene.layersOf(selection) | (1u << scene.activeLayer());
+						scheduler.invalidate(selectionScreenBounds(), touched);
+						history.moveToLayer(scene, selection, scene.activeLayer());
+						if (scene.layer(scene.activeLayer()).locked) select({});
+					}
+					break;
+				case sf::Keyboard::Num0:
+					camera.reset();
+					scheduler.invalidateAll();
+					break;
+				case sf::Keyboard::C: {
+					// Clearing is an ordinary, undoable removal of everything
+					std::vector<ShapeHandle> everything;
+					scene.handles(everything);
+					history.remove(scene, everything);
+					scheduler.invalidateAll();
+					snapVisible = false;
+					selection.clear();
+					gesture = NO_GESTURE;
 					tempPoints.clear();
 					break;
+				}
+				case sf::Keyboard::Z:
+					if (event.key.control) replay(event.key.shift);
+					break;
+				case sf::Keyboard::Y:
+					if (event.key.control) replay(true);
+					break;
 				case sf::Keyboard::Escape:
 					tempPoints.clear();
+					select({});
 					break;
-				case sf::Keyboard::Delete:
-					if (selectedShape) {
-						shapes.erase(std::remove(shapes.begin(), shapes.end(), selectedShape),
-							shapes.end());
-						selectedShape = nullptr;
+				case sf::Keyboard::F5:
+					if (!saveScene(scene, scenePath)) {
+						std::cout << "Could not save scene file: " << scenePath << "\n";
 					}
 					break;
+				case sf::Keyboard::F6:
+					exportScene();
+					break;
+				case sf::Keyboard::F9:
+					gesture = NO_GESTURE;
+					openScene();
+					scheduler.invalidateAll();
+					break;
+				case sf::Keyboard::Delete:
+					scheduler.invalidate(selectionScreenBounds(), scene.layersOf(selection));
+					history.remove(scene, selection);
+					selection.clear();
+					gesture = NO_GESTURE;
+					break;
 				}
 			}
 
@@ -927,37 +8359,58 @@ int main() {
 			if (event.type == sf::Event::MouseButtonPressed &&
 				event.mouseButton.button == sf::Mouse::Left) {
 				sf::Vector2f mousePos = window.mapPixelToCoords(
-					sf::Mouse::getPosition(window));
+					sf::Mouse::getPosition(window), camera.view);
+
+				// New points land on the nearest snap candidate when in reach
+				sf::Vector2f snapped;
+				if (snapsPoints() &&
+					scene.snap(mousePos, SNAP_PIXELS / camera.zoom(), snapped)) {
+					mousePos = snapped;
+				}
 
 				if (currentMode == SELECTION) {
-					// Deselect all
-					for (auto& shape : shapes) {
-						shape->isSelected = false;
+					// Find clicked shape (top-most wins); empty space starts a box
+					// or, with Ctrl held, a lasso
+					ShapeHandle hit = scene.pick(mousePos);
+					bool held = std::find(selection.begin(), selection.end(), hit) != selection.end();
+					bool adding = sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
+						sf::Keyboard::isKeyPressed(sf::Keyboard::RShift);
+
+					if (hit.isNull()) {
+						select({});
+						bool ctrl = sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
+							sf::Keyboard::isKeyPressed(sf::Keyboard::RControl);
+						gesture = ctrl ? LASSOING : BOXING;
+						lasso.assign(1, mousePos);
 					}
-					selectedShape = nullptr;
-
-					// Find clicked shape (reverse order for top-most)
-					for (auto it = shapes.rbegin(); it != shapes.rend(); ++it) {
-						if ((*it)->containsPoint(mousePos)) {
-							(*it)->isSelected = true;
-							selectedShape = *it;
-							break;
+					else {
+						if (adding && !held) {
+							std::vector<ShapeHandle> grown = selection;
+							grown.push_back(hit);
+							select(std::move(grown));
+						}
+						else if (!held) {
+							select({ hit });
 						}
+						// Picking an instance makes its symbol the one to place
+						if (Instance* instance = dynamic_cast<Instance*>(scene.get(hit))) {
+							currentSymbol = instance->symbol;
+						}
+						gesture = MOVING;
 					}
+					dragStart = dragLast = mousePos;
 				}
 				else if (currentMode == DRAW_DDA) {
 					tempPoints.push_back(mousePos);
 					if (tempPoints.size() == 2) {
-						shapes.push_back(std::make_shared<Line>(
-							tempPoints[0], tempPoints[1], Line::DDA, sf::Color::Green));
+						addShape(Line(tempPoints[0], tempPoints[1], Line::DDA, sf::Color::Green));
 						tempPoints.clear();
 					}
 				}
 				else if (currentMode == DRAW_BRESENHAM) {
 					tempPoints.push_back(mousePos);
 					if (tempPoints.size() == 2) {
-						shapes.push_back(std::make_shared<Line>(
-							tempPoints[0], tempPoints[1], Line::BRESENHAM, sf::Color::Red));
+						addShape(Line(tempPoints[0], tempPoints[1], Line::BRESENHAM, sf::Color::Red));
 						tempPoints.clear();
 					}
 				}
@@ -967,8 +8420,7 @@ int main() {
 						float dx = tempPoints[1].x - tempPoints[0].x;
 						float dy = tempPoints[1].y - tempPoints[0].y;
 						float radius = sqrt(dx * dx + dy * dy);
-						shapes.push_back(std::make_shared<Circle>(
-							tempPoints[0], radius, sf::Color::Blue));
+						addShape(Circle(tempPoints[0], radius, sf::Color::Blue));
 						tempPoints.clear();
 					}
 				}
@@ -977,8 +8429,7 @@ int main() {
 					if (tempPoints.size() == 2) {
 						float rx = std::abs(tempPoints[1].x - tempPoints[0].x);
 						float ry = std::abs(tempPoints[1].y - tempPoints[0].y);
-						shapes.push_back(std::make_shared<Ellipse>(
-							tempPoints[0], rx, ry, sf::Color::Magenta));
+						addShape(Ellipse(tempPoints[0], rx, ry, sf::Color::Magenta, fillShapes));
 						tempPoints.clear();
 					}
 				}
@@ -986,83 +8437,204 @@ int main() {
 					tempPoints.push_back(mousePos);
 				}
 				else if (currentMode == DRAW_BEZIER) {
+					// Points cleared elsewhere leave stale weights; drop them here
+					bool heavy = curveType == NURBS && (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
+						sf::Keyboard::isKeyPressed(sf::Keyboard::RShift));
+					tempWeights.resize(tempPoints.size(), 1.0f);
+					tempWeights.push_back(heavy ? NURBS_HEAVY_WEIGHT : 1.0f);
 					tempPoints.push_back(mousePos);
 				}
+				else if (currentMode == PLACE_SYMBOL && currentSymbol) {
+					addShape(Instance(currentSymbol, mousePos, currentSymbol->color));
+				}
+				else if (currentMode == PAINT_BUCKET) {
+					paintBucket(sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+				}
 			}
 
 			// Right click to finish polygon/bezier
 			if (event.type == sf::Event::MouseButtonPressed &&
 				event.mouseButton.button == sf::Mouse::Right) {
 				if (currentMode == DRAW_POLYGON && tempPoints.size() >= 3) {
-					shapes.push_back(std::make_shared<Polygon>(
-						tempPoints, sf::Color::Cyan, fillPolygon));
+					addShape(Polygon(tempPoints, sf::Color::Cyan, fillShapes, fillRule));
 					tempPoints.clear();
 				}
 				else if (currentMode == DRAW_BEZIER && tempPoints.size() >= 2) {
-					shapes.push_back(std::make_shared<BezierCurve>(
-						tempPoints, sf::Color::Yellow));
+					if (curveType == BEZIER_CURVE) {
+						addShape(BezierCurve(tempPoints, sf::Color::Yellow));
+					}
+					else {
+						tempWeights.resize(tempPoints.size(), 1.0f);
+						addShape(SplineCurve(tempPoints, sf::Color::Yellow,
+							curveType == NURBS ? tempWeights : std::vector<float>()));
+					}
 					tempPoints.clear();
+					tempWeights.clear();
 				}
 			}
+
+			hasEvent = window.pollEvent(event);
 		}
 
-		// Real-time transformations
-		if (selectedShape) {
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
-				selectedShape->translate(-MOVE_AMOUNT, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
-				selectedShape->translate(MOVE_AMOUNT, 0);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up))
-				selectedShape->translate(0, -MOVE_AMOUNT);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down))
-				selectedShape->translate(0, MOVE_AMOUNT);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q))
-				selectedShape->rotate(-ROTATE_AMOUNT);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::E))
-				selectedShape->rotate(ROTATE_AMOUNT);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W))
-				selectedShape->scale(SCALE_FACTOR_UP);
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))
-				selectedShape->scale(SCALE_FACTOR_DOWN);
-		}
-
-		// Render
-		window.clear(sf::Color(25, 25, 35));
+		// Real-time transformations: held keys and drag motion are summed
+		// and applied to the whole selection once per frame
+		if (!selection.empty()) {
+			sf::Vector2f move = dragDelta;
+			float turn = 0;
+			float factor = 1;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) move.x -= MOVE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) move.x += MOVE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) move.y -= MOVE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) move.y += MOVE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q)) turn -= ROTATE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::E)) turn += ROTATE_AMOUNT;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) factor *= SCALE_FACTOR_UP;
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) factor *= SCALE_FACTOR_DOWN;
+
+			if (move != sf::Vector2f(0, 0) || turn != 0 || factor != 1) {
+				history.beginTransform(scene, selection);
+				sf::FloatRect before = selectionScreenBounds();
+				std::uint32_t touched = scene.layersOf(selection);
+				if (move != sf::Vector2f(0, 0)) scene.translateGroup(selection, move);
+				if (turn != 0) scene.rotateGroup(selection, turn, selectionPivot());
+				if (factor != 1) scene.scaleGroup(selection, factor, selectionPivot());
+				scheduler.invalidate(before, touched);
+				scheduler.invalidate(selectionScreenBounds(), touched);
+				interacted();
+			}
+			else if (gesture != MOVING) {
+				// A whole drag or key hold undoes as one step
+				history.closeTransform();
+			}
+		}
+		dragDelta = sf::Vector2f(0, 0);
 
-		if (showGrid) {
-			ui.drawGrid(window);
+		if (moving && settleClock.getElapsedTime() >= sf::milliseconds(AA_SETTLE_MS)) {
+			moving = false;
+			scheduler.smoothRough();
+		}
+		if (scheduler.idle()) {
+			if (autosave.backlogged() || moving) sf::sleep(sf::milliseconds(1));
+			continue;
 		}
 
-		std::vector<sf::RectangleShape> pixels;
+		RasterView view = camera.rasterView();
+		view.antialias = antialias;
+		syncCanvases();
+
+		// Re-rasterize the damaged part of each changed layer, clipped to it.
+		// Hidden layers keep their damage until they are shown again.
+		for (int l = 0; l < scene.layerCount(); l++) {
+			if (!scene.layer(l).visible || !scheduler.hasDamage(l)) continue;
+			sf::RenderTexture& canvas = *canvases[l];
+			sf::IntRect area = scheduler.takeDamage(l, canvas.getSize());
+			if (area.width <= 0 || area.height <= 0) continue;
+
+			canvas.setView(clipView(area, canvas.getSize()));
+			sf::RectangleShape erase(sf::Vector2f(static_cast<float>(area.width), static_cast<float>(area.height)));
+			erase.setPosition(static_cast<float>(area.left), static_cast<float>(area.top));
+			erase.setFillColor(sf::Color::Transparent);
+			canvas.draw(erase, sf::RenderStates(sf::BlendNone));
+
+			// Rasterize the layer's shapes overlapping the area across the worker pool
+			RasterView damagedView = view;
+			damagedView.screen = sf::FloatRect(area);
+			if (damagedView.antialias && moving) {
+				damagedView.antialias = false;
+				scheduler.markRough(area, l);
+			}
+			if (damagedView.antialias) {
+				coverageAtlas.rasterize(quads, damagedView, l);
+				if (!quads.empty()) {
+					canvas.draw(quads.data(), quads.size(), sf::Quads, sf::RenderStates(&coverageAtlas.texture()));
+				}
+			}
+			else {
+				scene.rasterize(quads, workers, damagedView, l);
+				if (!quads.empty()) {
+					canvas.draw(quads.data(), quads.size(), sf::Quads);
+				}
+			}
+			canvas.display();
+		}
 
-		// Draw all shapes
-		for (auto& shape : shapes) {
-			shape->draw(pixels);
+		// Composite the background, grid and visible layers, then the overlays
+		window.clear(sf::Color(25, 25, 35));
+		if (showGrid) {
+			ui.drawGrid(window, view);
+		}
+		// Alpha blending onto a transparent canvas leaves its colours
+		// premultiplied, so layers go on with a premultiplied blend; otherwise
+		// the alpha is applied twice and partly covered pixels come out dark
+		const sf::BlendMode premultiplied(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha);
+		for (int l = 0; l < scene.layerCount(); l++) {
+			if (scene.layer(l).visible) window.draw(sf::Sprite(canvases[l]->getTexture()), premultiplied);
 		}
 
-		// Draw temp points for polygon/bezier
-		for (auto& tp : tempPoints) {
-			sf::CircleShape marker(5);
-			marker.setPosition(tp.x - 5, tp.y - 5);
+		// Draw temp points for polygon/curve; heavy NURBS points are larger
+		for (size_t i = 0; i < tempPoints.size(); i++) {
+			sf::Vector2f tp = view.toScreen(tempPoints[i]);
+			bool heavy = currentMode == DRAW_BEZIER && i < tempWeights.size() && tempWeights[i] > 1;
+			float radius = heavy ? 8.0f : 5.0f;
+			sf::CircleShape marker(radius);
+			marker.setPosition(tp.x - radius, tp.y - radius);
 			marker.setFillColor(sf::Color::White);
 			window.draw(marker);
 		}
 
-		// Draw all pixels
-		for (auto& pixel : pixels) {
-			window.draw(pixel);
+		// Snap preview
+		if (snapVisible && snapsPoints()) {
+			sf::Vector2f sp = view.toScreen(snapTarget);
+			sf::RectangleShape marker(sf::Vector2f(10, 10));
+			marker.setPosition(sp.x - 5, sp.y - 5);
+			marker.setFillColor(sf::Color::Transparent);
+			marker.setOutlineColor(sf::Color(255, 140, 0));
+			marker.setOutlineThickness(2);
+			window.draw(marker);
+		}
+
+		// Rubber band or lasso in progress
+		if (gesture == BOXING) {
+			sf::Vector2f a = view.toScreen(dragStart);
+			sf::Vector2f b = view.toScreen(dragLast);
+			sf::RectangleShape band(sf::Vector2f(std::abs(b.x - a.x), std::abs(b.y - a.y)));
+			band.setPosition(std::min(a.x, b.x), std::min(a.y, b.y));
+			band.setFillColor(sf::Color::Transparent);
+			band.setOutlineColor(b.x < a.x ? sf::Color(120, 220, 120) : sf::Color(100, 160, 255));
+			band.setOutlineThickness(1);
+			window.draw(band);
+		}
+		else if (gesture == LASSOING && lasso.size() > 1) {
+			sf::VertexArray outline(sf::LineStrip, lasso.size() + 1);
+			for (size_t i = 0; i <= lasso.size(); i++) {
+				outline[i].position = view.toScreen(lasso[i % lasso.size()]);
+				outline[i].color = sf::Color(100, 160, 255);
+			}
+			window.draw(outline);
 		}
 
-		// Highlight selected shape
-		if (selectedShape) {
+		// Highlight the selected shape, or the box around a group
+		Shape* selected = (selection.size() == 1) ? scene.get(selection[0]) : nullptr;
+		if (selected) {
 			sf::CircleShape highlight(8);
-			sf::Vector2f center = selectedShape->getCenter();
+			sf::Vector2f center = view.toScreen(selected->getCenter());
 			highlight.setPosition(center.x - 8, center.y - 8);
 			highlight.setFillColor(sf::Color::Transparent);
 			highlight.setOutlineColor(sf::Color::Yellow);
 			highlight.setOutlineThickness(2);
 			window.draw(highlight);
 		}
+		else if (selection.size() > 1) {
+			sf::FloatRect world = scene.groupBounds(selection);
+			sf::Vector2f a = view.toScreen(sf::Vector2f(world.left, world.top));
+			sf::Vector2f b = view.toScreen(sf::Vector2f(world.left + world.width, world.top + world.height));
+			sf::RectangleShape highlight(b - a);
+			highlight.setPosition(a);
+			highlight.setFillColor(sf::Color::Transparent);
+			highlight.setOutlineColor(sf::Color::Yellow);
+			highlight.setOutlineThickness(1);
+			window.draw(highlight);
+		}
 
 		// Draw UI
 		std::string modeStr;
@@ -1073,14 +8645,35 @@ int main() {
 		case DRAW_CIRCLE: modeStr = "Circle"; break;
 		case DRAW_ELLIPSE: modeStr = "Ellipse"; break;
 		case DRAW_POLYGON: modeStr = "Polygon"; break;
-		case DRAW_BEZIER: modeStr = "Bezier Curve"; break;
+		case DRAW_BEZIER:
+			modeStr = (curveType == BEZIER_CURVE) ? "Bezier Curve" : (curveType == B_SPLINE) ? "B-Spline Curve" : "NURBS Curve";
+			break;
+		case PLACE_SYMBOL:
+			modeStr = currentSymbol ? "Place " + currentSymbol->name : "Place Symbol (select shapes, press M)";
+			break;
+		case PAINT_BUCKET:
+			modeStr = "Paint Bucket";
+			break;
 		}
 
-		std::string shapeInfo = selectedShape ? selectedShape->getInfo() : "";
-		ui.drawHUD(window, modeStr, shapeInfo, static_cast<int>(shapes.size()));
+		const Scene::Layer& layer = scene.layer(scene.activeLayer());
+		modeStr += " | " + layer.name + " (" + std::to_string(scene.activeLayer() + 1) + "/" +
+			std::to_string(scene.layerCount()) + ")";
+		if (!layer.visible) modeStr += " hidden";
+		if (layer.locked) modeStr += " locked";
+		modeStr += " | " + describeStroke(currentStroke);
+		if (antialias) modeStr += " | AA";
+
+		std::string shapeInfo = selected ? selected->getInfo() : "";
+		if (selection.size() > 1) {
+			shapeInfo = "Selected: " + std::to_string(selection.size()) + " shapes";
+		}
+		ui.drawHUD(window, modeStr, shapeInfo, static_cast<int>(scene.size()));
 
 		window.display();
+		scheduler.frameDone();
 	}
 
+	autosave.stop(true);
 	return 0;
 }
\ No newline at end of file